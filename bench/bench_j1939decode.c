@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "j1939decode.h"
+#include "bench_trace.h"
+
+/* Number of times the trace is decoded for each benchmark */
+#define NUM_ROUNDS 10U
+/* Number of messages handed to the batch API at a time */
+#define BATCH_SIZE 256U
+/* Number of SPNs subscribed to by the subscription benchmark */
+#define NUM_SUBSCRIBED_SPNS 40U
+/* Number of distinct payloads per CAN identifier and cache size of the output cache benchmark */
+#define NUM_REPEATED_PAYLOADS 4U
+#define CACHE_ENTRIES 1024U
+
+static size_t num_log_msgs = 0;
+
+/* Count log messages instead of printing them */
+static void log_counter(const char * msg)
+{
+    (void) msg;
+    num_log_msgs++;
+}
+
+static void report(const char * name, double seconds, double baseline, const char * baseline_name)
+{
+    double rate = (double) NUM_MSGS * NUM_ROUNDS / seconds;
+    printf("%-20s %12.0f msg/s", name, rate);
+    if (baseline > 0)
+    {
+        printf("  (%.2fx %s)", baseline / seconds, baseline_name);
+    }
+    printf("\n");
+}
+
+static double bench_to_json(void)
+{
+    double start = now();
+    for (size_t round = 0; round < NUM_ROUNDS; round++)
+    {
+        for (size_t i = 0; i < NUM_MSGS; i++)
+        {
+            free(j1939decode_to_json(ids[i], dlcs[i], &data[i], false));
+        }
+    }
+    return now() - start;
+}
+
+static double bench_to_json_buffer(void)
+{
+    static char buffer[8192];
+
+    double start = now();
+    for (size_t round = 0; round < NUM_ROUNDS; round++)
+    {
+        for (size_t i = 0; i < NUM_MSGS; i++)
+        {
+            j1939decode_to_json_buffer(ids[i], dlcs[i], &data[i], buffer, sizeof(buffer));
+        }
+    }
+    return now() - start;
+}
+
+static double bench_to_json_values(void)
+{
+    static char buffer[8192];
+
+    j1939decode_set_profile(J1939DECODE_PROFILE_VALUES);
+
+    double start = now();
+    for (size_t round = 0; round < NUM_ROUNDS; round++)
+    {
+        for (size_t i = 0; i < NUM_MSGS; i++)
+        {
+            j1939decode_set_timestamp((double) i * 1e-4);
+            j1939decode_to_json_buffer(ids[i], dlcs[i], &data[i], buffer, sizeof(buffer));
+        }
+    }
+    double seconds = now() - start;
+
+    j1939decode_set_profile(J1939DECODE_PROFILE_FULL);
+    return seconds;
+}
+
+static double bench_to_json_subscribed(void)
+{
+    static char buffer[8192];
+    uint32_t spns[NUM_SUBSCRIBED_SPNS];
+    size_t num_spns = 0;
+
+    /* Subscribe to the first SPN of each PGN met in the trace, as a typical application would */
+    for (size_t i = 0; i < NUM_MSGS && num_spns < NUM_SUBSCRIBED_SPNS; i++)
+    {
+        j1939decode_msg msg;
+        if (j1939decode_to_struct(ids[i], dlcs[i], &data[i], &msg) && msg.num_spns > 0)
+        {
+            bool known = false;
+            for (size_t j = 0; j < num_spns; j++)
+            {
+                known = known || spns[j] == msg.spns[0].spn;
+            }
+            if (!known)
+            {
+                spns[num_spns++] = msg.spns[0].spn;
+            }
+        }
+    }
+    j1939decode_subscribe(spns, num_spns, NULL, 0);
+
+    double start = now();
+    for (size_t round = 0; round < NUM_ROUNDS; round++)
+    {
+        for (size_t i = 0; i < NUM_MSGS; i++)
+        {
+            j1939decode_to_json_buffer(ids[i], dlcs[i], &data[i], buffer, sizeof(buffer));
+        }
+    }
+    double seconds = now() - start;
+
+    j1939decode_subscribe(NULL, 0, NULL, 0);
+    return seconds;
+}
+
+static double bench_to_json_repeated(size_t cache_entries)
+{
+    static char buffer[8192];
+    static uint64_t repeated[NUM_MSGS];
+
+    /* Real buses mostly repeat the same few payloads for each identifier */
+    for (size_t i = 0; i < NUM_MSGS; i++)
+    {
+        repeated[i] = data[ids[i] % NUM_REPEATED_PAYLOADS];
+    }
+    j1939decode_set_cache(cache_entries);
+
+    double start = now();
+    for (size_t round = 0; round < NUM_ROUNDS; round++)
+    {
+        for (size_t i = 0; i < NUM_MSGS; i++)
+        {
+            j1939decode_to_json_buffer(ids[i], dlcs[i], &repeated[i], buffer, sizeof(buffer));
+        }
+    }
+    double seconds = now() - start;
+
+    j1939decode_set_cache(0);
+    return seconds;
+}
+
+static double bench_to_json_pretty(void)
+{
+    double start = now();
+    for (size_t round = 0; round < NUM_ROUNDS; round++)
+    {
+        for (size_t i = 0; i < NUM_MSGS; i++)
+        {
+            free(j1939decode_to_json(ids[i], dlcs[i], &data[i], true));
+        }
+    }
+    return now() - start;
+}
+
+/* Both struct benchmarks fill the same array of results so that they touch the same amount of memory */
+static j1939decode_msg msgs[BATCH_SIZE];
+
+static double bench_to_struct(void)
+{
+    double start = now();
+    for (size_t round = 0; round < NUM_ROUNDS; round++)
+    {
+        for (size_t i = 0; i < NUM_MSGS; i++)
+        {
+            j1939decode_to_struct(ids[i], dlcs[i], &data[i], &msgs[i % BATCH_SIZE]);
+        }
+    }
+    return now() - start;
+}
+
+static double bench_to_struct_batch(void)
+{
+    double start = now();
+    for (size_t round = 0; round < NUM_ROUNDS; round++)
+    {
+        for (size_t i = 0; i < NUM_MSGS; i += BATCH_SIZE)
+        {
+            size_t count = NUM_MSGS - i < BATCH_SIZE ? NUM_MSGS - i : BATCH_SIZE;
+            j1939decode_to_struct_batch(&ids[i], &dlcs[i], &data[i], count, msgs);
+        }
+    }
+    return now() - start;
+}
+
+static double bench_to_columns(void)
+{
+    static uint64_t sorted_data[NUM_MSGS];
+    static uint8_t sorted_dlcs[NUM_MSGS];
+    static uint32_t group_pgns[NUM_MSGS];
+    static size_t group_start[NUM_MSGS + 1];
+    static uint64_t values_raw[J1939DECODE_MAX_SPNS][BATCH_SIZE];
+    static double values_decoded[J1939DECODE_MAX_SPNS][BATCH_SIZE];
+    static bool valid[J1939DECODE_MAX_SPNS][BATCH_SIZE];
+    j1939decode_spn_column columns[J1939DECODE_MAX_SPNS];
+
+    for (size_t i = 0; i < J1939DECODE_MAX_SPNS; i++)
+    {
+        columns[i].value_raw = values_raw[i];
+        columns[i].value_decoded = values_decoded[i];
+        columns[i].valid = valid[i];
+    }
+
+    /* Replay jobs group frames by PGN up front, which is left out of the timing */
+    size_t num_groups = 0;
+    size_t num_sorted = 0;
+    for (size_t i = 0; i < NUM_MSGS; i++)
+    {
+        uint32_t pgn = (ids[i] >> 8U) & 0x3FFFFU;
+        bool known = false;
+        for (size_t g = 0; g < num_groups && !known; g++)
+        {
+            known = group_pgns[g] == pgn;
+        }
+        if (known)
+        {
+            continue;
+        }
+
+        group_pgns[num_groups] = pgn;
+        group_start[num_groups++] = num_sorted;
+        for (size_t j = i; j < NUM_MSGS; j++)
+        {
+            if (((ids[j] >> 8U) & 0x3FFFFU) == pgn)
+            {
+                sorted_data[num_sorted] = data[j];
+                sorted_dlcs[num_sorted++] = dlcs[j];
+            }
+        }
+    }
+    group_start[num_groups] = num_sorted;
+
+    double start = now();
+    for (size_t round = 0; round < NUM_ROUNDS; round++)
+    {
+        for (size_t g = 0; g < num_groups; g++)
+        {
+            for (size_t i = group_start[g]; i < group_start[g + 1]; i += BATCH_SIZE)
+            {
+                size_t count = group_start[g + 1] - i < BATCH_SIZE ? group_start[g + 1] - i : BATCH_SIZE;
+                j1939decode_to_columns(group_pgns[g], &sorted_dlcs[i], &sorted_data[i], count,
+                                       columns, J1939DECODE_MAX_SPNS);
+            }
+        }
+    }
+    return now() - start;
+}
+
+int main(void)
+{
+    j1939decode_set_log_fn(log_counter);
+
+    double start = now();
+    j1939decode_init();
+    printf("%-20s %12.3f ms\n", "init", (now() - start) * 1e3);
+
+    generate_trace();
+
+    printf("%u messages x %u rounds\n", NUM_MSGS, NUM_ROUNDS);
+
+    double to_json_pretty = bench_to_json_pretty();
+    report("to_json (pretty)", to_json_pretty, 0, NULL);
+    report("to_json", bench_to_json(), to_json_pretty, "pretty");
+    double to_json_buffer = bench_to_json_buffer();
+    report("to_json_buffer", to_json_buffer, to_json_pretty, "pretty");
+    report("subscribed", bench_to_json_subscribed(), to_json_buffer, "to_json_buffer");
+    report("values profile", bench_to_json_values(), to_json_pretty, "pretty");
+    double repeated = bench_to_json_repeated(0);
+    report("repeated payloads", repeated, to_json_pretty, "pretty");
+    report("cached", bench_to_json_repeated(CACHE_ENTRIES), repeated, "repeated payloads");
+
+    double to_struct = bench_to_struct();
+    report("to_struct", to_struct, 0, NULL);
+    double to_struct_batch = bench_to_struct_batch();
+    report("to_struct_batch", to_struct_batch, to_struct, "to_struct");
+    report("to_columns", bench_to_columns(), to_struct_batch, "to_struct_batch");
+
+    j1939decode_deinit();
+
+    if (num_log_msgs > 0)
+    {
+        printf("%zu log messages suppressed\n", num_log_msgs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "j1939decode.h"
+#include "bench_trace.h"
+
+/* Number of times each thread decodes the trace */
+#define NUM_ROUNDS 5U
+/* Initial size of each thread's output arena */
+#define ARENA_SIZE 4096U
+/* Upper limit on the number of worker threads */
+#define MAX_THREADS 64U
+
+/* Shared read-only database */
+static j1939decode_db * db;
+
+/* Worker thread state */
+typedef struct
+{
+    pthread_t thread;
+    j1939decode_ctx * ctx;
+    bool use_arena;
+} worker;
+
+/* Discard log messages, a shared counter would only measure contention */
+static void log_discard(const char * msg)
+{
+    (void) msg;
+}
+
+static void * run_worker(void * arg)
+{
+    worker * w = arg;
+
+    for (size_t round = 0; round < NUM_ROUNDS; round++)
+    {
+        for (size_t i = 0; i < NUM_MSGS; i++)
+        {
+            char * json = j1939decode_ctx_to_json(w->ctx, ids[i], dlcs[i], &data[i], false);
+            if (!w->use_arena)
+            {
+                free(json);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* Decode the trace on num_threads threads at once, returns the aggregate rate in messages per second */
+static double bench_threads(size_t num_threads, bool use_arena)
+{
+    worker workers[MAX_THREADS];
+
+    /* Contexts are set up before any thread starts */
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        workers[t].ctx = j1939decode_ctx_create(db);
+        workers[t].use_arena = use_arena;
+        if (workers[t].ctx == NULL || (use_arena && !j1939decode_ctx_set_arena(workers[t].ctx, ARENA_SIZE)))
+        {
+            fprintf(stderr, "Failed to create decoder context\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double start = now();
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        pthread_create(&workers[t].thread, NULL, run_worker, &workers[t]);
+    }
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        pthread_join(workers[t].thread, NULL);
+    }
+    double seconds = now() - start;
+
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        j1939decode_ctx_destroy(workers[t].ctx);
+    }
+
+    return (double) NUM_MSGS * NUM_ROUNDS * num_threads / seconds;
+}
+
+static void report(const char * name, bool use_arena, size_t max_threads)
+{
+    double single = 0;
+
+    for (size_t num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+    {
+        double rate = bench_threads(num_threads, use_arena);
+        if (num_threads == 1)
+        {
+            single = rate;
+        }
+        printf("%-16s %3zu threads %12.0f msg/s  (%.2fx 1 thread)\n", name, num_threads, rate, rate / single);
+
+        /* Always finish with the full core count */
+        if (num_threads < max_threads && num_threads * 2 > max_threads)
+        {
+            num_threads = max_threads / 2;
+        }
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 10) : (cores > 0 ? (size_t) cores : 1);
+    if (max_threads < 1 || max_threads > MAX_THREADS)
+    {
+        fprintf(stderr, "Usage: %s [threads (1 to %u)]\n", argv[0], MAX_THREADS);
+        return EXIT_FAILURE;
+    }
+
+    db = j1939decode_db_load(NULL, log_discard);
+    if (db == NULL)
+    {
+        fprintf(stderr, "Failed to load J1939 database\n");
+        return EXIT_FAILURE;
+    }
+
+    generate_trace();
+
+    printf("%u messages x %u rounds per thread, up to %zu threads\n", NUM_MSGS, NUM_ROUNDS, max_threads);
+
+    report("to_json heap", false, max_threads);
+    report("to_json arena", true, max_threads);
+
+    j1939decode_db_free(db);
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "j1939decode.h"
+#include "j1939db.h"
+#include "bench_trace.h"
+
+/* Number of times the trace is run through */
+#define NUM_ROUNDS 10U
+
+/* Extract an SPN one bit at a time, as a straightforward reference */
+static uint64_t extract_bitwise(const j1939db_spn * spn, uint64_t payload, uint8_t dlc)
+{
+    uint64_t value = 0;
+    for (uint32_t bit = 0; bit < spn->length && bit < 64U; bit++)
+    {
+        uint32_t position = spn->start_bit + bit;
+        if (position < 8U * dlc && ((payload >> position) & 1U))
+        {
+            value |= UINT64_C(1) << bit;
+        }
+    }
+    return value;
+}
+
+static double bench_kernel(const j1939db * db, uint64_t * checksum)
+{
+    uint64_t sum = 0;
+    double start = now();
+    for (size_t round = 0; round < NUM_ROUNDS; round++)
+    {
+        /* Cycle through the SPNs without a division per extraction */
+        const j1939db_spn * spn = db->spns;
+        for (size_t i = 0; i < NUM_MSGS; i++)
+        {
+            sum += j1939db_extract(spn, j1939db_payload(data[i], dlcs[i]));
+            spn = spn + 1 < db->spns + db->num_spns ? spn + 1 : db->spns;
+        }
+    }
+    double seconds = now() - start;
+
+    *checksum = sum;
+    return seconds;
+}
+
+static double bench_bitwise(const j1939db * db, uint64_t * checksum)
+{
+    uint64_t sum = 0;
+    double start = now();
+    for (size_t round = 0; round < NUM_ROUNDS; round++)
+    {
+        /* Cycle through the SPNs without a division per extraction */
+        const j1939db_spn * spn = db->spns;
+        for (size_t i = 0; i < NUM_MSGS; i++)
+        {
+            sum += extract_bitwise(spn, data[i], dlcs[i]);
+            spn = spn + 1 < db->spns + db->num_spns ? spn + 1 : db->spns;
+        }
+    }
+    double seconds = now() - start;
+
+    *checksum = sum;
+    return seconds;
+}
+
+int main(void)
+{
+    const j1939db * db = j1939decode_db_load(NULL, NULL);
+    if (db == NULL || db->num_spns == 0)
+    {
+        return 1;
+    }
+
+    generate_trace();
+
+    uint64_t kernel_checksum = 0;
+    uint64_t bitwise_checksum = 0;
+    double kernel = bench_kernel(db, &kernel_checksum);
+    double bitwise = bench_bitwise(db, &bitwise_checksum);
+
+    printf("%u extractions x %u rounds over %zu SPNs\n", NUM_MSGS, NUM_ROUNDS, db->num_spns);
+    printf("%-20s %12.2f ns/extraction\n", "bitwise", bitwise * 1e9 / ((double) NUM_MSGS * NUM_ROUNDS));
+    printf("%-20s %12.2f ns/extraction  (%.2fx bitwise)\n", "kernel",
+           kernel * 1e9 / ((double) NUM_MSGS * NUM_ROUNDS), bitwise / kernel);
+
+    j1939decode_db_free((j1939decode_db *) db);
+
+    /* Both ways must agree on every value */
+    return kernel_checksum == bitwise_checksum ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "bench_trace.h"
+
+uint32_t ids[NUM_MSGS];
+uint8_t dlcs[NUM_MSGS];
+uint64_t data[NUM_MSGS];
+
+/* Monotonic time in seconds */
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/* Simple xorshift pseudo-random number generator so every run uses the same trace */
+static uint64_t next_random(void)
+{
+    static uint64_t state = 0x9E3779B97F4A7C15ULL;
+    state ^= state << 13U;
+    state ^= state >> 7U;
+    state ^= state << 17U;
+    return state;
+}
+
+/* Build a trace that looks like a typical truck bus:
+ * mostly a handful of high rate PGNs, with some lower rate and unknown ones */
+void generate_trace(void)
+{
+    const uint32_t pgns[] = {61444, 61444, 61444, 61443, 65265, 65265, 0, 65262, 65263, 65215, 65266, 65269, 65270, 65276, 1};
+    const uint8_t sas[] = {0, 0, 0, 3, 11, 23, 33, 49};
+
+    for (size_t i = 0; i < NUM_MSGS; i++)
+    {
+        uint64_t r = next_random();
+        uint32_t pgn = pgns[r % (sizeof(pgns) / sizeof(pgns[0]))];
+        uint8_t sa = sas[(r >> 8U) % (sizeof(sas) / sizeof(sas[0]))];
+
+        ids[i] = (6U << 26U) | (pgn << 8U) | sa;
+        dlcs[i] = 8;
+        data[i] = next_random();
+    }
+}
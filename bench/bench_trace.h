@@ -0,0 +1,20 @@
+#ifndef BENCH_TRACE_H
+#define BENCH_TRACE_H
+
+#include <stdint.h>
+
+/* Number of messages in the generated trace */
+#define NUM_MSGS 100000U
+
+/* Generated trace, shared by the benchmark programs */
+extern uint32_t ids[NUM_MSGS];
+extern uint8_t dlcs[NUM_MSGS];
+extern uint64_t data[NUM_MSGS];
+
+/* Monotonic time in seconds */
+double now(void);
+
+/* Build the same pseudo-random trace on every run */
+void generate_trace(void);
+
+#endif //BENCH_TRACE_H
@@ -0,0 +1,268 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "j1939db.h"
+
+/* Column decode kernels
+ * One SPN is decoded across a batch of frames of the same PGN, writing its raw values,
+ * decoded values and valid flags into separate arrays. The AVX2 kernel is picked at run time
+ * if the CPU has it, SSE2 is always there on x86-64, and every other target gets the scalar kernel.
+ * All kernels produce exactly what decoding one frame at a time does. */
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define J1939COLUMN_X86 1
+#include <immintrin.h>
+#else
+#define J1939COLUMN_X86 0
+#endif
+
+/* Exponent bits of 2^52 and 2^84, and their sum, for converting unsigned 64-bit integers to doubles */
+#define EXP_2_52 0x4330000000000000ULL
+#define EXP_2_84 0x4530000000000000ULL
+#define MAGIC_2_84_2_52 19342813118337666422669312.0
+
+static void decode_column_scalar(const j1939db_spn * spn, const uint64_t * data, const uint8_t * dlcs, size_t count,
+                                 uint64_t * raw, double * decoded, bool * valid);
+#if J1939COLUMN_X86
+static void decode_column_sse2(const j1939db_spn * spn, const uint64_t * data, const uint8_t * dlcs, size_t count,
+                               uint64_t * raw, double * decoded, bool * valid);
+static void decode_column_avx2(const j1939db_spn * spn, const uint64_t * data, const uint8_t * dlcs, size_t count,
+                               uint64_t * raw, double * decoded, bool * valid);
+#endif
+
+/* Kernel forced by j1939db_set_column_kernel(), picked by CPU when J1939DB_COLUMN_AUTO */
+static j1939db_column_kernel forced_kernel = J1939DB_COLUMN_AUTO;
+
+/* DLC as used by the kernels, anything above 8 is taken as a full frame */
+static inline uint8_t clamp_dlc(uint8_t dlc)
+{
+    return dlc < 8U ? dlc : 8U;
+}
+
+/**************************************************************************//**
+
+  \brief Decode one SPN across a batch of frames of the same PGN
+
+  \param spn        pointer to the compiled SPN decode descriptor
+  \param data       pointer to array of count payloads
+  \param dlcs       pointer to array of count data length codes, above 8 taken as 8
+  \param count      number of frames
+  \param raw        pointer to array of count raw values to fill in
+  \param decoded    pointer to array of count decoded values to fill in
+  \param valid      pointer to array of count valid flags to fill in
+
+  \return void
+
+******************************************************************************/
+void j1939db_decode_column(const j1939db_spn * spn, const uint64_t * data, const uint8_t * dlcs, size_t count,
+                           uint64_t * raw, double * decoded, bool * valid)
+{
+#if J1939COLUMN_X86
+    /* Reads the CPU features found by CPUID at start up, cheap enough to check on every call */
+    j1939db_column_kernel kernel = forced_kernel;
+    if (kernel == J1939DB_COLUMN_AUTO)
+    {
+        kernel = __builtin_cpu_supports("avx2") ? J1939DB_COLUMN_AVX2 : J1939DB_COLUMN_SSE2;
+    }
+
+    if (kernel == J1939DB_COLUMN_AVX2)
+    {
+        decode_column_avx2(spn, data, dlcs, count, raw, decoded, valid);
+    }
+    else if (kernel == J1939DB_COLUMN_SSE2)
+    {
+        decode_column_sse2(spn, data, dlcs, count, raw, decoded, valid);
+    }
+    else
+    {
+        decode_column_scalar(spn, data, dlcs, count, raw, decoded, valid);
+    }
+#else
+    decode_column_scalar(spn, data, dlcs, count, raw, decoded, valid);
+#endif
+}
+
+/**************************************************************************//**
+
+  \brief Force the kernel used by j1939db_decode_column()
+
+  Meant for tests, which run every kernel the CPU has on the same input.
+
+  \param kernel     kernel to use, or J1939DB_COLUMN_AUTO to pick the widest the CPU supports
+
+  \return bool      boolean indicating if the kernel is available in this build and on this CPU
+
+******************************************************************************/
+bool j1939db_set_column_kernel(j1939db_column_kernel kernel)
+{
+    bool available = kernel == J1939DB_COLUMN_AUTO || kernel == J1939DB_COLUMN_SCALAR;
+#if J1939COLUMN_X86
+    available = available || kernel == J1939DB_COLUMN_SSE2 ||
+                (kernel == J1939DB_COLUMN_AVX2 && __builtin_cpu_supports("avx2"));
+#endif
+
+    if (available)
+    {
+        forced_kernel = kernel;
+    }
+
+    return available;
+}
+
+/**************************************************************************//**
+
+  \brief Decode one SPN across a batch of frames, one frame at a time
+
+  \param spn        pointer to the compiled SPN decode descriptor
+  \param data       pointer to array of count payloads
+  \param dlcs       pointer to array of count data length codes
+  \param count      number of frames
+  \param raw        pointer to array of count raw values to fill in
+  \param decoded    pointer to array of count decoded values to fill in
+  \param valid      pointer to array of count valid flags to fill in
+
+  \return void
+
+******************************************************************************/
+void decode_column_scalar(const j1939db_spn * spn, const uint64_t * data, const uint8_t * dlcs, size_t count,
+                          uint64_t * raw, double * decoded, bool * valid)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t dlc = clamp_dlc(dlcs[i]);
+
+        raw[i] = j1939db_extract(spn, j1939db_payload(data[i], dlc));
+        decoded[i] = (double) raw[i] * spn->resolution + spn->offset;
+        valid[i] = decoded[i] >= spn->operational_low && decoded[i] <= spn->operational_high &&
+                   spn->num_bytes <= dlc;
+    }
+}
+
+#if J1939COLUMN_X86
+
+/**************************************************************************//**
+
+  \brief Decode one SPN across a batch of frames, two frames at a time with SSE2
+
+  \param spn        pointer to the compiled SPN decode descriptor
+  \param data       pointer to array of count payloads
+  \param dlcs       pointer to array of count data length codes
+  \param count      number of frames
+  \param raw        pointer to array of count raw values to fill in
+  \param decoded    pointer to array of count decoded values to fill in
+  \param valid      pointer to array of count valid flags to fill in
+
+  \return void
+
+******************************************************************************/
+void decode_column_sse2(const j1939db_spn * spn, const uint64_t * data, const uint8_t * dlcs, size_t count,
+                        uint64_t * raw, double * decoded, bool * valid)
+{
+    const __m128i shift = _mm_cvtsi32_si128(spn->shift);
+    const __m128i mask = _mm_set1_epi64x((long long) spn->mask);
+    const __m128i low_half = _mm_set1_epi64x(0xFFFFFFFFLL);
+    const __m128i exp_2_52 = _mm_set1_epi64x((long long) EXP_2_52);
+    const __m128i exp_2_84 = _mm_set1_epi64x((long long) EXP_2_84);
+    const __m128d magic = _mm_set1_pd(MAGIC_2_84_2_52);
+    const __m128d resolution = _mm_set1_pd(spn->resolution);
+    const __m128d offset = _mm_set1_pd(spn->offset);
+    const __m128d operational_low = _mm_set1_pd(spn->operational_low);
+    const __m128d operational_high = _mm_set1_pd(spn->operational_high);
+
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        /* SSE2 has no per-lane shifts, so bytes beyond the DLC are cleared one frame at a time */
+        uint8_t dlc0 = clamp_dlc(dlcs[i]);
+        uint8_t dlc1 = clamp_dlc(dlcs[i + 1]);
+        __m128i payload = _mm_set_epi64x((long long) j1939db_payload(data[i + 1], dlc1),
+                                         (long long) j1939db_payload(data[i], dlc0));
+
+        __m128i value = _mm_and_si128(_mm_srl_epi64(payload, shift), mask);
+        _mm_storeu_si128((__m128i *) &raw[i], value);
+
+        /* Exact conversion of the high and low 32 bits, rounded once when added up */
+        __m128d high = _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(value, 32), exp_2_84)), magic);
+        __m128d low = _mm_castsi128_pd(_mm_or_si128(_mm_and_si128(value, low_half), exp_2_52));
+        __m128d result = _mm_add_pd(_mm_mul_pd(_mm_add_pd(high, low), resolution), offset);
+        _mm_storeu_pd(&decoded[i], result);
+
+        int in_range = _mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(result, operational_low),
+                                                  _mm_cmple_pd(result, operational_high)));
+        valid[i] = (in_range & 1) != 0 && spn->num_bytes <= dlc0;
+        valid[i + 1] = (in_range & 2) != 0 && spn->num_bytes <= dlc1;
+    }
+
+    decode_column_scalar(spn, &data[i], &dlcs[i], count - i, &raw[i], &decoded[i], &valid[i]);
+}
+
+/**************************************************************************//**
+
+  \brief Decode one SPN across a batch of frames, four frames at a time with AVX2
+
+  \param spn        pointer to the compiled SPN decode descriptor
+  \param data       pointer to array of count payloads
+  \param dlcs       pointer to array of count data length codes
+  \param count      number of frames
+  \param raw        pointer to array of count raw values to fill in
+  \param decoded    pointer to array of count decoded values to fill in
+  \param valid      pointer to array of count valid flags to fill in
+
+  \return void
+
+******************************************************************************/
+__attribute__((target("avx2")))
+void decode_column_avx2(const j1939db_spn * spn, const uint64_t * data, const uint8_t * dlcs, size_t count,
+                        uint64_t * raw, double * decoded, bool * valid)
+{
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i eight = _mm256_set1_epi64x(8);
+    const __m256i shift = _mm256_set1_epi64x(spn->shift);
+    const __m256i mask = _mm256_set1_epi64x((long long) spn->mask);
+    const __m256i num_bytes = _mm256_set1_epi64x(spn->num_bytes);
+    const __m256i exp_2_52 = _mm256_set1_epi64x((long long) EXP_2_52);
+    const __m256i exp_2_84 = _mm256_set1_epi64x((long long) EXP_2_84);
+    const __m256d magic = _mm256_set1_pd(MAGIC_2_84_2_52);
+    const __m256d resolution = _mm256_set1_pd(spn->resolution);
+    const __m256d offset = _mm256_set1_pd(spn->offset);
+    const __m256d operational_low = _mm256_set1_pd(spn->operational_low);
+    const __m256d operational_high = _mm256_set1_pd(spn->operational_high);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        int32_t dlc_bytes;
+        memcpy(&dlc_bytes, &dlcs[i], sizeof(dlc_bytes));
+        __m256i dlc = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(dlc_bytes));
+        dlc = _mm256_blendv_epi8(dlc, eight, _mm256_cmpgt_epi64(dlc, eight));
+
+        /* Per-lane shifts of 64 bits or more give zero, so a full frame keeps every byte */
+        __m256i dlc_mask = _mm256_sub_epi64(_mm256_sllv_epi64(one, _mm256_slli_epi64(dlc, 3)), one);
+
+        __m256i payload = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) &data[i]), dlc_mask);
+        __m256i value = _mm256_and_si256(_mm256_srlv_epi64(payload, shift), mask);
+        _mm256_storeu_si256((__m256i *) &raw[i], value);
+
+        /* Exact conversion of the high and low 32 bits, rounded once when added up */
+        __m256d high = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(value, 32), exp_2_84)),
+                                     magic);
+        __m256d low = _mm256_castsi256_pd(_mm256_blend_epi32(exp_2_52, value, 0x55));
+        __m256d result = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(high, low), resolution), offset);
+        _mm256_storeu_pd(&decoded[i], result);
+
+        __m256d in_range = _mm256_and_pd(_mm256_cmp_pd(result, operational_low, _CMP_GE_OQ),
+                                         _mm256_cmp_pd(result, operational_high, _CMP_LE_OQ));
+        __m256d fits = _mm256_castsi256_pd(_mm256_cmpgt_epi64(num_bytes, dlc));
+        int flags = _mm256_movemask_pd(_mm256_andnot_pd(fits, in_range));
+
+        valid[i] = (flags & 1) != 0;
+        valid[i + 1] = (flags & 2) != 0;
+        valid[i + 2] = (flags & 4) != 0;
+        valid[i + 3] = (flags & 8) != 0;
+    }
+
+    decode_column_scalar(spn, &data[i], &dlcs[i], count - i, &raw[i], &decoded[i], &valid[i]);
+}
+
+#endif
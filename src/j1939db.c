@@ -0,0 +1,2082 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define J1939DB_HAVE_MMAP
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#ifdef J1939DB_HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "j1939db.h"
+#include "j1939json.h"
+#include "cJSON.h"
+
+/* Binary image format
+ *
+ * The image is a header followed by the PGN records, SPN descriptors, PGN page table,
+ * SPN index, source address, state, string and pre-rendered JSON sections. Records and page tables are stored in the
+ * exact form the decoder uses, and refer to each other by index or offset only, so the
+ * image is position-independent and is used in place: it is mapped read-only and shared
+ * between processes, and loading it does not depend on the size of the database.
+ * Integers and doubles are stored in native byte order and records in native struct layout;
+ * the header records both. */
+#define J1939DB_IMAGE_MAGIC "J1939DB"
+#define J1939DB_IMAGE_VERSION 7U
+#define J1939DB_IMAGE_BYTE_ORDER 0x01020304U
+/* Alignment of every section within the image */
+#define J1939DB_IMAGE_ALIGN 8U
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t image_size;
+    /* Record sizes, which tie the image to the struct layout it was written with */
+    uint32_t pgn_size;
+    uint32_t spn_size;
+    uint32_t num_pgns;
+    uint32_t num_spns;
+    uint32_t num_pgn_pages;
+    uint32_t num_spn_pages;
+    uint32_t num_spn_refs;
+    uint32_t num_states;
+    uint32_t strings_size;
+    uint32_t json_size;
+    uint32_t pgns_offset;
+    uint32_t spns_offset;
+    /* Page number plus one of every PGN page table entry, zero for the empty page */
+    uint32_t pgn_directory_offset;
+    uint32_t pgn_pages_offset;
+    /* SPN page table is stored the same way */
+    uint32_t spn_directory_offset;
+    uint32_t spn_pages_offset;
+    uint32_t spn_refs_offset;
+    uint32_t sa_names_offset;
+    /* JSON fragments of the source address names follow the names */
+    uint32_t sa_names_json_offset;
+    uint32_t states_offset;
+    uint32_t states_json_offset;
+    uint32_t strings_offset;
+    uint32_t json_offset;
+} j1939db_image_header;
+
+/* Strings of each SPN descriptor: name, units, data range and operational range */
+#define SPN_NUM_STRINGS 4U
+
+/* Records being compiled from JSON, which the database only holds as read-only arrays
+ * Strings point into the parsed JSON, indexed like the records, until they are packed into the string pool */
+typedef struct
+{
+    j1939db_pgn * pgns;
+    j1939db_spn * spns;
+    uint32_t * states;
+    const char ** pgn_names;
+    const char ** spn_strings;
+    const char * sa_names[256];
+    const char ** state_strings;
+} json_build;
+
+/* Page shared by every PGN page table entry with no PGNs in it */
+static const uint16_t empty_page[J1939DB_PAGE_SIZE];
+
+/* Sixteen PDU formats sharing a PS field mask */
+#define PS_MASKS_16(mask) mask, mask, mask, mask, mask, mask, mask, mask, \
+                          mask, mask, mask, mask, mask, mask, mask, mask
+
+const uint8_t j1939db_ps_masks[256] = {
+    /* PDU1, PF 0 to 239 */
+    PS_MASKS_16(0x00), PS_MASKS_16(0x00), PS_MASKS_16(0x00), PS_MASKS_16(0x00),
+    PS_MASKS_16(0x00), PS_MASKS_16(0x00), PS_MASKS_16(0x00), PS_MASKS_16(0x00),
+    PS_MASKS_16(0x00), PS_MASKS_16(0x00), PS_MASKS_16(0x00), PS_MASKS_16(0x00),
+    PS_MASKS_16(0x00), PS_MASKS_16(0x00), PS_MASKS_16(0x00),
+    /* PDU2, PF 240 to 255 */
+    PS_MASKS_16(0xFF)
+};
+
+/* Static helper functions */
+static void log_msg(log_fn_ptr fn, const char * fmt, ...);
+static char * file_read(const j1939db * db, const char * filename, const char * mode);
+static bool in_array(uint32_t val, const uint32_t * array, size_t len);
+static bool add_pgn_index(j1939db * db, uint32_t pgn);
+static bool load_json(j1939db * db, const char * filename);
+static bool compile_pgns(j1939db * db, json_build * build, const cJSON * pgns, const cJSON * spns);
+static bool compile_spn(j1939db * db, j1939db_spn * spn_out, const char ** strings_out, uint32_t spn,
+                        const cJSON * start_bit_json, const cJSON * spns);
+static void compile_sa_names(json_build * build, const cJSON * source_addresses);
+static bool compile_states(j1939db * db, json_build * build, const cJSON * bit_decodings);
+static bool alloc_states(j1939db * db, json_build * build, size_t num_states);
+static uint32_t * string_slot(j1939db * db, json_build * build, size_t i, const char ** source);
+static size_t num_string_slots(const j1939db * db);
+static bool pack_strings(j1939db * db, json_build * build);
+static bool index_spns(j1939db * db);
+static bool render_json(j1939db * db, json_build * build);
+static void render_fragments(j1939db * db, json_build * build, j1939db_fragment * states_json,
+                             j1939json_writer * writer);
+static void set_fragment(const j1939json_writer * writer, j1939db_fragment * fragment, size_t start);
+static bool load_image(j1939db * db, const char * filename);
+static bool map_image(j1939db * db, const char * filename);
+static bool map_pages(const uint16_t ** pages, size_t num_pages, const uint16_t * directory,
+                      const uint16_t * stored, uint32_t num_stored);
+static uint32_t count_pages(const uint16_t * const * pages, size_t num_pages);
+static void store_pages(const uint16_t * const * pages, size_t num_pages, uint16_t * directory, uint16_t * stored);
+static uint32_t align_offset(uint32_t offset);
+static void write_c_string_ref(FILE * fp, uint32_t offset);
+
+/* Get the SPN metadata published by j1939db_spn_infos(), or NULL if it has not been resolved yet */
+static inline j1939decode_spn_info * load_infos(const j1939db * db)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _InterlockedCompareExchangePointer((void * volatile *) &db->infos, NULL, NULL);
+#else
+    return __atomic_load_n(&db->infos, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/* Publish resolved SPN metadata unless another thread got there first, returns the metadata in use */
+static inline j1939decode_spn_info * publish_infos(const j1939db * db, j1939decode_spn_info * infos)
+{
+    /* The database is only written through here, and never once the metadata is set */
+    j1939decode_spn_info ** target = (j1939decode_spn_info **) &db->infos;
+#if defined(_MSC_VER) && !defined(__clang__)
+    j1939decode_spn_info * current = _InterlockedCompareExchangePointer((void * volatile *) target, infos, NULL);
+#else
+    j1939decode_spn_info * current = NULL;
+    __atomic_compare_exchange_n(target, &current, infos, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+    return current != NULL ? current : infos;
+}
+static void write_c_double(FILE * fp, double d);
+static void write_c_fragment(FILE * fp, const j1939db_fragment * fragment);
+
+/**************************************************************************//**
+
+  \brief Log formatted message to the database log handler
+
+  \return void
+
+******************************************************************************/
+void log_msg(log_fn_ptr fn, const char * fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    j1939decode_vlog(fn, fmt, args);
+    va_end(args);
+}
+
+/**************************************************************************//**
+
+  \brief  Read file contents into allocated memory
+
+  \return pointer to string containing file contents
+
+******************************************************************************/
+char * file_read(const j1939db * db, const char * filename, const char * mode)
+{
+    FILE * fp = fopen(filename, mode);
+    if (fp == NULL)
+    {
+        log_msg(db->log_fn, "Could not open file %s", filename);
+        /* No need to close the file before returning since it was never opened */
+        return NULL;
+    }
+
+    /* Get total file size */
+    fseek(fp, 0, SEEK_END);
+    long file_size = ftell(fp);
+    rewind(fp);
+
+    /* Allocate enough memory for entire file */
+    char * buf = malloc(file_size + 1);
+    if (buf == NULL)
+    {
+        log_msg(db->log_fn, "Memory allocation failure");
+        fclose(fp);
+        return NULL;
+    }
+
+    /* Read the entire file into a buffer */
+    long read_size = fread(buf, 1, file_size, fp);
+    if (read_size != file_size)
+    {
+        log_msg(db->log_fn, "Read %ld of %ld total bytes in file %s", read_size, file_size, filename);
+        free(buf);
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+
+    // Null terminator
+    buf[file_size] = '\0';
+
+    return buf;
+}
+
+/**************************************************************************//**
+
+  \brief
+
+  \param val    value to search
+  \param array  array of values to search in
+  \param len    number of elements in array
+
+  \return bool  boolean indicating if value was found in array
+
+******************************************************************************/
+bool in_array(uint32_t val, const uint32_t * array, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (val == array[i])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**************************************************************************//**
+
+  \brief Precompute the extraction kernel of an SPN from the start bit and length in its metadata
+
+  Every length up to 64 bits gets a full 64-bit mask. An SPN starting beyond
+  the last bit of a frame extracts as zero, so the kernel never shifts by 64 or more.
+
+  \param spn    pointer to the compiled SPN decode descriptor
+
+  \return void
+
+******************************************************************************/
+void j1939db_compile_extraction(j1939db_spn * spn)
+{
+    uint32_t start_bit = spn->start_bit;
+    uint32_t length = spn->length;
+
+    if (start_bit >= 64U || length == 0)
+    {
+        spn->shift = 0;
+        spn->mask = 0;
+    }
+    else
+    {
+        spn->shift = (uint8_t) start_bit;
+        spn->mask = length >= 64U ? UINT64_MAX : (UINT64_C(1) << length) - 1;
+    }
+
+    /* Saturates well above 8 so that oversized SPNs never fit any DLC */
+    uint64_t num_bytes = ((uint64_t) start_bit + length + 7U) / 8U;
+    spn->num_bytes = (uint8_t) (num_bytes < UINT8_MAX ? num_bytes : UINT8_MAX);
+}
+
+/**************************************************************************//**
+
+  \brief Add the last PGN record to the PGN lookup table
+
+  \param db     pointer to the database
+  \param pgn    parameter group number of the record
+
+  \return bool  boolean indicating if the record was added
+
+******************************************************************************/
+bool add_pgn_index(j1939db * db, uint32_t pgn)
+{
+    /* Lookups only ever see PDU1 PGNs with their destination address cleared */
+    if (j1939db_normalize_pgn(pgn) != pgn)
+    {
+        log_msg(db->log_fn, "PDU1 PGN %d found in database with a destination address, skipping", pgn);
+        return false;
+    }
+
+    const uint16_t * page = db->pgn_pages[pgn >> J1939DB_PAGE_BITS];
+    if (page == empty_page)
+    {
+        uint16_t * new_page = calloc(J1939DB_PAGE_SIZE, sizeof(uint16_t));
+        if (new_page == NULL)
+        {
+            log_msg(db->log_fn, "Memory allocation failure");
+            return false;
+        }
+        db->pgn_pages[pgn >> J1939DB_PAGE_BITS] = new_page;
+        page = new_page;
+    }
+
+    if (page[pgn & (J1939DB_PAGE_SIZE - 1)] != 0)
+    {
+        log_msg(db->log_fn, "Duplicate PGN %d found in database, skipping", pgn);
+        return false;
+    }
+
+    ((uint16_t *) page)[pgn & (J1939DB_PAGE_SIZE - 1)] = (uint16_t) db->num_pgns;
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Load J1939 database from either a JSON file or a binary image file
+
+  The file format is detected from the first bytes of the file.
+
+  \param filename   database filename
+  \param log_fn     log handler, or NULL to log to stderr
+
+  \return j1939db * pointer to the loaded database, or NULL on failure
+
+******************************************************************************/
+j1939db * j1939db_load(const char * filename, log_fn_ptr log_fn)
+{
+    j1939db * db = calloc(1, sizeof(j1939db));
+    if (db == NULL)
+    {
+        log_msg(log_fn, "Memory allocation failure");
+        return NULL;
+    }
+
+    db->log_fn = log_fn;
+    for (size_t i = 0; i < J1939DB_NUM_PAGES; i++)
+    {
+        db->pgn_pages[i] = empty_page;
+    }
+    for (size_t i = 0; i < J1939DB_NUM_SPN_PAGES; i++)
+    {
+        db->spn_pages[i] = empty_page;
+    }
+
+    FILE * fp = fopen(filename, "rb");
+    if (fp == NULL)
+    {
+        log_msg(db->log_fn, "Could not open file %s", filename);
+        j1939db_free(db);
+        return NULL;
+    }
+
+    char magic[sizeof(J1939DB_IMAGE_MAGIC)] = {0};
+    size_t magic_size = fread(magic, 1, sizeof(magic), fp);
+    fclose(fp);
+
+    bool loaded;
+    if (magic_size == sizeof(magic) && memcmp(magic, J1939DB_IMAGE_MAGIC, sizeof(magic)) == 0)
+    {
+        loaded = load_image(db, filename);
+    }
+    else
+    {
+        loaded = load_json(db, filename);
+    }
+
+    if (!loaded)
+    {
+        j1939db_free(db);
+        return NULL;
+    }
+
+    return db;
+}
+
+/**************************************************************************//**
+
+  \brief Free J1939 database
+
+  \param db     pointer to the database
+
+  \return void
+
+******************************************************************************/
+void j1939db_free(j1939db * db)
+{
+    if (db == NULL || db->embedded)
+    {
+        return;
+    }
+
+    free(db->infos);
+
+    if (db->image != NULL)
+    {
+#ifdef J1939DB_HAVE_MMAP
+        if (db->image_mapped)
+        {
+            munmap(db->image, db->image_size);
+        }
+        else
+#endif
+        {
+            free(db->image);
+        }
+    }
+    else
+    {
+        /* Records, page tables, string pool and JSON fragments are only owned when they were compiled from JSON */
+        for (size_t i = 0; i < J1939DB_NUM_PAGES; i++)
+        {
+            if (db->pgn_pages[i] != empty_page)
+            {
+                free((uint16_t *) db->pgn_pages[i]);
+            }
+        }
+
+        for (size_t i = 0; i < J1939DB_NUM_SPN_PAGES; i++)
+        {
+            if (db->spn_pages[i] != empty_page)
+            {
+                free((uint16_t *) db->spn_pages[i]);
+            }
+        }
+
+        free((j1939db_pgn *) db->pgns);
+        free((j1939db_spn *) db->spns);
+        free((j1939db_spn_ref *) db->spn_refs);
+        free((uint32_t *) db->states);
+        free((j1939db_fragment *) db->states_json);
+        free((char *) db->strings);
+        free((char *) db->json);
+    }
+
+    free(db);
+}
+
+/**************************************************************************//**
+
+  \brief Load J1939 database from a JSON file
+
+  The JSON file is parsed, every PGN and SPN is compiled into decode plans,
+  all strings are copied into a single string pool and the JSON output is
+  pre-rendered, after which the parsed JSON is no longer needed and is freed.
+
+  \param db         pointer to the database
+  \param filename   JSON database filename
+
+  \return bool      boolean indicating if the database was loaded
+
+******************************************************************************/
+bool load_json(j1939db * db, const char * filename)
+{
+    char * s = file_read(db, filename, "r");
+    if (s == NULL)
+    {
+        return false;
+    }
+
+    cJSON * json = cJSON_Parse(s);
+    free(s);
+    if (json == NULL)
+    {
+        log_msg(db->log_fn, "Unable to parse J1939db");
+        return false;
+    }
+
+    json_build build;
+    memset(&build, 0, sizeof(build));
+
+    compile_sa_names(&build, cJSON_GetObjectItemCaseSensitive(json, "J1939SATabledb"));
+
+    bool ok = compile_pgns(db, &build,
+                           cJSON_GetObjectItemCaseSensitive(json, "J1939PGNdb"),
+                           cJSON_GetObjectItemCaseSensitive(json, "J1939SPNdb"));
+    if (!ok)
+    {
+        log_msg(db->log_fn, "Unable to build PGN lookup table");
+    }
+    else
+    {
+        /* Strings still point into the parsed JSON until they are packed */
+        ok = compile_states(db, &build, cJSON_GetObjectItemCaseSensitive(json, "J1939BitDecodings")) &&
+             pack_strings(db, &build) && render_json(db, &build) && index_spns(db);
+    }
+
+    /* The records themselves are owned by the database */
+    free(build.pgn_names);
+    free(build.spn_strings);
+    free(build.state_strings);
+    cJSON_Delete(json);
+    return ok;
+}
+
+/**************************************************************************//**
+
+  \brief Build PGN lookup table from the J1939 database
+
+  Every PGN object found in the database is resolved once into a record,
+  and the record index is stored in a two-level table indexed by PGN number.
+  Each record points at its own contiguous slice of compiled SPN decode plans.
+
+  \param db     pointer to the database
+  \param build  pointer to the records being compiled
+  \param pgns   JSON object for all PGNs
+  \param spns   JSON object for all SPNs
+
+  \return bool  boolean indicating if the table was built successfully
+
+******************************************************************************/
+bool compile_pgns(j1939db * db, json_build * build, const cJSON * pgns, const cJSON * spns)
+{
+    size_t num_pgns = (size_t) cJSON_GetArraySize(pgns);
+    if (num_pgns == 0)
+    {
+        log_msg(db->log_fn, "No PGNs found in database");
+        return true;
+    }
+
+    /* Record indices are stored plus one in a 16-bit table entry */
+    if (num_pgns >= UINT16_MAX)
+    {
+        log_msg(db->log_fn, "Too many PGNs in database (%zu)", num_pgns);
+        return false;
+    }
+
+    build->pgns = calloc(num_pgns, sizeof(j1939db_pgn));
+    build->pgn_names = calloc(num_pgns, sizeof(const char *));
+    db->pgns = build->pgns;
+    if (build->pgns == NULL || build->pgn_names == NULL)
+    {
+        log_msg(db->log_fn, "Memory allocation failure");
+        return false;
+    }
+
+    /* Size the SPN array for the worst case of every listed SPN being decodable */
+    size_t max_spns = 0;
+    const cJSON * pgn_data;
+    cJSON_ArrayForEach(pgn_data, pgns)
+    {
+        max_spns += (size_t) cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(pgn_data, "SPNs"));
+    }
+
+    if (max_spns > 0)
+    {
+        build->spns = calloc(max_spns, sizeof(j1939db_spn));
+        build->spn_strings = calloc(SPN_NUM_STRINGS * max_spns, sizeof(const char *));
+        db->spns = build->spns;
+        if (build->spns == NULL || build->spn_strings == NULL)
+        {
+            log_msg(db->log_fn, "Memory allocation failure");
+            return false;
+        }
+    }
+
+    /* Number of SPNs skipped because the database gives no start bit for them */
+    size_t num_skipped = 0;
+
+    cJSON_ArrayForEach(pgn_data, pgns)
+    {
+        char * end;
+        unsigned long pgn = strtoul(pgn_data->string, &end, 10);
+        if (*end != '\0' || pgn >= (1UL << 18U) || !cJSON_IsObject(pgn_data))
+        {
+            log_msg(db->log_fn, "Invalid PGN entry \"%s\" found in database, skipping", pgn_data->string);
+            continue;
+        }
+
+        j1939db_pgn * record = &build->pgns[db->num_pgns];
+        record->pgn = (uint32_t) pgn;
+        build->pgn_names[db->num_pgns] = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(pgn_data, "Name"));
+        record->first_spn = (uint32_t) db->num_spns;
+        record->num_spns = 0;
+        record->num_delimited = 0;
+
+        const cJSON * spn_list_array = cJSON_GetObjectItemCaseSensitive(pgn_data, "SPNs");
+        const cJSON * start_bit_array = cJSON_GetObjectItemCaseSensitive(pgn_data, "SPNStartBits");
+        size_t first_spn = db->num_spns;
+        size_t first_delimited = db->num_spns;
+
+        /* Fixed position SPNs are compiled first, then the delimited ones the database gives a negative start bit */
+        for (int delimited = 0; delimited <= 1; delimited++)
+        {
+            /* Walk the SPN list and start bit list side by side */
+            const cJSON * spn_json = cJSON_IsArray(spn_list_array) ? spn_list_array->child : NULL;
+            const cJSON * start_bit_json = cJSON_IsArray(start_bit_array) ? start_bit_array->child : NULL;
+            for (; spn_json != NULL; spn_json = spn_json->next)
+            {
+                if (!cJSON_IsNumber(start_bit_json))
+                {
+                    num_skipped += delimited ? 0U : 1U;
+                }
+                else if ((start_bit_json->valueint < 0) == (delimited != 0) &&
+                         compile_spn(db, &build->spns[db->num_spns], &build->spn_strings[SPN_NUM_STRINGS * db->num_spns],
+                                     (uint32_t) spn_json->valueint, start_bit_json, spns))
+                {
+                    db->num_spns++;
+                }
+
+                start_bit_json = start_bit_json ? start_bit_json->next : NULL;
+            }
+
+            if (!delimited)
+            {
+                first_delimited = db->num_spns;
+            }
+        }
+
+        /* Only keep the record once it has been indexed */
+        db->num_pgns++;
+        if (add_pgn_index(db, record->pgn))
+        {
+            record->num_spns = (uint32_t) (first_delimited - first_spn);
+            record->num_delimited = (uint32_t) (db->num_spns - first_delimited);
+        }
+        else
+        {
+            db->num_pgns--;
+            db->num_spns = first_spn;
+        }
+    }
+
+    if (num_skipped > 0)
+    {
+        log_msg(db->log_fn, "Skipped %zu SPNs with no start bit in database", num_skipped);
+    }
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Compile the decode descriptor for one SPN of a PGN
+
+  A negative start bit marks a variable-length field found by its '*' delimiter,
+  which is given J1939DECODE_NO_START_BIT and an extraction kernel that always gives zero.
+
+  \param db               pointer to the database
+  \param spn_out          pointer to the descriptor to fill in
+  \param strings_out      pointer to the name, units, data range and operational range to fill in
+  \param spn              suspect parameter number
+  \param start_bit_json   starting bit of SPN in PGN as found in the database
+  \param spns             JSON object for all SPNs
+
+  \return bool            boolean indicating if the SPN can be decoded
+
+******************************************************************************/
+bool compile_spn(j1939db * db, j1939db_spn * spn_out, const char ** strings_out, uint32_t spn,
+                 const cJSON * start_bit_json, const cJSON * spns)
+{
+    /* Array of all possible proprietary SPNs */
+    const uint32_t proprietary_spns[] = {2550, 2551, 3328};
+
+    /* Check for proprietary SPNs */
+    if (in_array(spn, proprietary_spns, sizeof(proprietary_spns) / sizeof(proprietary_spns[0])))
+    {
+        /* Silently ignore proprietary SPNs */
+        return false;
+    }
+
+    /* Start bit is found in the PGN data object, not in the SPN data object */
+    if (!cJSON_IsNumber(start_bit_json))
+    {
+        return false;
+    }
+    bool delimited = start_bit_json->valueint < 0;
+
+    /* String large enough to fit a six-digit number */
+    char spn_string[7];
+    snprintf(spn_string, sizeof(spn_string), "%d", spn);
+
+    /* JSON object for specific SPN data */
+    const cJSON * spn_data = cJSON_GetObjectItemCaseSensitive(spns, spn_string);
+    if (!cJSON_IsObject(spn_data))
+    {
+        log_msg(db->log_fn, "No SPN data found in database for SPN %d", spn);
+        return false;
+    }
+
+    const cJSON * length_json = cJSON_GetObjectItemCaseSensitive(spn_data, "SPNLength");
+    const cJSON * offset_json = cJSON_GetObjectItemCaseSensitive(spn_data, "Offset");
+    const cJSON * resolution_json = cJSON_GetObjectItemCaseSensitive(spn_data, "Resolution");
+    const cJSON * operational_high_json = cJSON_GetObjectItemCaseSensitive(spn_data, "OperationalHigh");
+    const cJSON * operational_low_json = cJSON_GetObjectItemCaseSensitive(spn_data, "OperationalLow");
+    if (length_json == NULL || offset_json == NULL || resolution_json == NULL ||
+        operational_high_json == NULL || operational_low_json == NULL)
+    {
+        log_msg(db->log_fn, "Incomplete SPN data found in database for SPN %d", spn);
+        return false;
+    }
+
+    spn_out->spn = spn;
+    spn_out->start_bit = delimited ? J1939DECODE_NO_START_BIT : (uint32_t) start_bit_json->valueint;
+    /* Variable-length fields have a negative length, or the longest they may be */
+    spn_out->length = (delimited && length_json->valueint < 0) ? 0U : (uint32_t) length_json->valueint;
+    spn_out->resolution = resolution_json->valuedouble;
+    spn_out->offset = offset_json->valuedouble;
+    spn_out->operational_high = operational_high_json->valuedouble;
+    spn_out->operational_low = operational_low_json->valuedouble;
+    strings_out[0] = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(spn_data, "Name"));
+    strings_out[1] = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(spn_data, "Units"));
+    strings_out[2] = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(spn_data, "DataRange"));
+    strings_out[3] = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(spn_data, "OperationalRange"));
+    j1939db_compile_extraction(spn_out);
+    memcpy(spn_out->key, spn_string, sizeof(spn_string));
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Build source address name table from the J1939 database
+
+  \param build              pointer to the records being compiled
+  \param source_addresses   JSON object for all source addresses
+
+  \return void
+
+******************************************************************************/
+void compile_sa_names(json_build * build, const cJSON * source_addresses)
+{
+    for (uint32_t sa = 0; sa < 256; sa++)
+    {
+        /* Preferred Addresses are in the range of 0 to 127 and 248 to 255 */
+        if (sa <= 127 || sa >= 248)
+        {
+            /* Source addresses 92 through to 127 have not yet been assigned */
+            if (sa >= 92 && sa <= 127)
+            {
+                build->sa_names[sa] = "Reserved";
+            }
+            else
+            {
+                /* String large enough to fit a three-digit number (8 bits) */
+                char sa_string[4];
+                snprintf(sa_string, sizeof(sa_string), "%d", sa);
+
+                build->sa_names[sa] = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(source_addresses, sa_string));
+            }
+        }
+        /* Industry Group specific addresses are in the range of 128 to 247 */
+        else
+        {
+            build->sa_names[sa] = "Industry Group specific";
+        }
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Build the state tables of every SPN with bit decodings in the J1939 database
+
+  Each table has one entry per raw value of the SPN, so looking up the state
+  of a decoded value is a single array load. SPNs longer than
+  J1939DB_MAX_STATE_BITS are left without a table. The states still point
+  into the parsed JSON until the strings are packed.
+
+  \param db             pointer to the database
+  \param build          pointer to the records being compiled
+  \param bit_decodings  JSON object of the raw value to state objects of every SPN
+
+  \return bool          boolean indicating if the tables were built
+
+******************************************************************************/
+bool compile_states(j1939db * db, json_build * build, const cJSON * bit_decodings)
+{
+    if (!cJSON_IsObject(bit_decodings))
+    {
+        return true;
+    }
+
+    /* First pass only sizes the tables */
+    size_t num_states = 0;
+    for (size_t i = 0; i < db->num_spns; i++)
+    {
+        const j1939db_spn * spn = &build->spns[i];
+        if (spn->length > 0 && spn->length <= J1939DB_MAX_STATE_BITS &&
+            cJSON_IsObject(cJSON_GetObjectItemCaseSensitive(bit_decodings, spn->key)))
+        {
+            num_states += 1UL << spn->length;
+        }
+    }
+
+    if (!alloc_states(db, build, num_states))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < db->num_spns; i++)
+    {
+        j1939db_spn * spn = &build->spns[i];
+        const cJSON * decodings = cJSON_GetObjectItemCaseSensitive(bit_decodings, spn->key);
+        if (spn->length == 0 || spn->length > J1939DB_MAX_STATE_BITS || !cJSON_IsObject(decodings))
+        {
+            continue;
+        }
+
+        spn->states = (uint32_t) db->num_states;
+        spn->num_states = (uint16_t) (1U << spn->length);
+
+        const cJSON * decoding;
+        cJSON_ArrayForEach(decoding, decodings)
+        {
+            char * end;
+            unsigned long raw = strtoul(decoding->string, &end, 10);
+            if (*end != '\0' || raw >= spn->num_states || !cJSON_IsString(decoding))
+            {
+                log_msg(db->log_fn, "Invalid bit decoding \"%s\" found in database for SPN %u, skipping",
+                        decoding->string, spn->spn);
+                continue;
+            }
+
+            build->state_strings[db->num_states + raw] = decoding->valuestring;
+        }
+
+        db->num_states += spn->num_states;
+    }
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Allocate the state tables, every state starting out as NULL
+
+  \param db             pointer to the database
+  \param build          pointer to the records being compiled
+  \param num_states     total number of entries of all state tables
+
+  \return bool          boolean indicating if the tables were allocated
+
+******************************************************************************/
+bool alloc_states(j1939db * db, json_build * build, size_t num_states)
+{
+    if (num_states == 0)
+    {
+        return true;
+    }
+
+    build->states = calloc(num_states, sizeof(uint32_t));
+    build->state_strings = calloc(num_states, sizeof(const char *));
+    db->states = build->states;
+    if (build->states == NULL || build->state_strings == NULL)
+    {
+        log_msg(db->log_fn, "Memory allocation failure");
+        return false;
+    }
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Get the i-th string reference in the database
+
+  String references are numbered PGN names first, then the four strings of
+  each SPN, then the source address names, then the states.
+
+  \param db             pointer to the database
+  \param build          pointer to the records being compiled
+  \param i              string reference number
+  \param source         set to the string as found in the parsed JSON, or NULL if there is none
+
+  \return uint32_t *    pointer to the string pool offset of the reference
+
+******************************************************************************/
+uint32_t * string_slot(j1939db * db, json_build * build, size_t i, const char ** source)
+{
+    if (i < db->num_pgns)
+    {
+        *source = build->pgn_names[i];
+        return &build->pgns[i].name;
+    }
+    i -= db->num_pgns;
+
+    if (i < SPN_NUM_STRINGS * db->num_spns)
+    {
+        j1939db_spn * spn = &build->spns[i / SPN_NUM_STRINGS];
+        *source = build->spn_strings[i];
+        switch (i % SPN_NUM_STRINGS)
+        {
+            case 0: return &spn->name;
+            case 1: return &spn->units;
+            case 2: return &spn->data_range;
+            default: return &spn->operational_range;
+        }
+    }
+    i -= SPN_NUM_STRINGS * db->num_spns;
+
+    if (i < 256)
+    {
+        *source = build->sa_names[i];
+        return &db->sa_names[i];
+    }
+    i -= 256;
+
+    *source = build->state_strings[i];
+    return &build->states[i];
+}
+
+/**************************************************************************//**
+
+  \brief Number of string references in the database
+
+  \param db       pointer to the database
+
+  \return size_t  number of string references
+
+******************************************************************************/
+size_t num_string_slots(const j1939db * db)
+{
+    return db->num_pgns + SPN_NUM_STRINGS * db->num_spns + 256 + db->num_states;
+}
+
+/**************************************************************************//**
+
+  \brief Copy every string in the database into one deduplicated string pool
+
+  \param db     pointer to the database
+  \param build  pointer to the records being compiled
+
+  \return bool  boolean indicating if the strings were packed
+
+******************************************************************************/
+bool pack_strings(j1939db * db, json_build * build)
+{
+    size_t num_slots = num_string_slots(db);
+
+    /* Upper bound on the pool size, assuming no duplicates */
+    size_t max_size = 1;
+    for (size_t i = 0; i < num_slots; i++)
+    {
+        const char * s;
+        string_slot(db, build, i, &s);
+        max_size += s ? strlen(s) + 1 : 0;
+    }
+
+    if (max_size >= J1939DB_NULL_STRING)
+    {
+        log_msg(db->log_fn, "J1939 database strings are too large");
+        return false;
+    }
+
+    /* Open addressing hash table of pool offsets plus one, kept at most half full */
+    size_t num_buckets = 1;
+    while (num_buckets < 2 * num_slots)
+    {
+        num_buckets <<= 1U;
+    }
+
+    char * pool = malloc(max_size);
+    uint32_t * buckets = calloc(num_buckets, sizeof(uint32_t));
+    if (pool == NULL || buckets == NULL)
+    {
+        log_msg(db->log_fn, "Memory allocation failure");
+        free(pool);
+        free(buckets);
+        return false;
+    }
+
+    /* Pool always starts with the empty string */
+    size_t pool_size = 1;
+    pool[0] = '\0';
+
+    for (size_t i = 0; i < num_slots; i++)
+    {
+        const char * s;
+        uint32_t * slot = string_slot(db, build, i, &s);
+        if (s == NULL)
+        {
+            *slot = J1939DB_NULL_STRING;
+            continue;
+        }
+
+        /* FNV-1a hash */
+        uint32_t hash = 2166136261U;
+        for (const char * c = s; *c != '\0'; c++)
+        {
+            hash = (hash ^ (uint8_t) *c) * 16777619U;
+        }
+
+        size_t bucket = hash & (num_buckets - 1);
+        while (buckets[bucket] != 0 && strcmp(&pool[buckets[bucket] - 1], s) != 0)
+        {
+            bucket = (bucket + 1) & (num_buckets - 1);
+        }
+
+        if (buckets[bucket] == 0)
+        {
+            size_t len = strlen(s) + 1;
+            memcpy(&pool[pool_size], s, len);
+            buckets[bucket] = (uint32_t) pool_size + 1;
+            pool_size += len;
+        }
+
+        *slot = buckets[bucket] - 1;
+    }
+
+    /* References are offsets, so the pool can be shrunk afterwards */
+    char * shrunk_pool = realloc(pool, pool_size);
+    if (shrunk_pool != NULL)
+    {
+        pool = shrunk_pool;
+    }
+
+    db->strings = pool;
+    db->strings_size = pool_size;
+
+    free(buckets);
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Build the reverse index from SPN number to every place the SPN is carried
+
+  The references are counting sorted by SPN number through the index pages
+  themselves: the page entries first count the references to each SPN,
+  then become the position of the first one. Delimited SPNs are indexed
+  along with the fixed position ones, so they can be located and filtered.
+
+  \param db     pointer to the database
+
+  \return bool  boolean indicating if the index was built
+
+******************************************************************************/
+bool index_spns(j1939db * db)
+{
+    uint16_t * next = NULL;
+    bool result = false;
+
+    if (db->num_spns >= UINT16_MAX)
+    {
+        log_msg(db->log_fn, "Too many SPNs in database to index");
+        return false;
+    }
+
+    j1939db_spn_ref * refs = calloc(db->num_spns > 0 ? db->num_spns : 1, sizeof(j1939db_spn_ref));
+    next = calloc(db->num_spns > 0 ? db->num_spns : 1, sizeof(uint16_t));
+    db->spn_refs = refs;
+    if (refs == NULL || next == NULL)
+    {
+        log_msg(db->log_fn, "Memory allocation failure");
+        goto cleanup;
+    }
+
+    /* Count the references to each SPN */
+    for (size_t i = 0; i < db->num_pgns; i++)
+    {
+        for (size_t j = 0; j < db->pgns[i].num_spns + db->pgns[i].num_delimited; j++)
+        {
+            uint32_t spn = j1939db_pgn_spns(db, &db->pgns[i])[j].spn;
+            if (spn >= (1UL << J1939DB_SPN_BITS))
+            {
+                log_msg(db->log_fn, "SPN %u out of range, left out of the SPN index", spn);
+                continue;
+            }
+
+            uint16_t * page = (uint16_t *) db->spn_pages[spn >> J1939DB_PAGE_BITS];
+            if (page == empty_page)
+            {
+                page = calloc(J1939DB_PAGE_SIZE, sizeof(uint16_t));
+                if (page == NULL)
+                {
+                    log_msg(db->log_fn, "Memory allocation failure");
+                    goto cleanup;
+                }
+                db->spn_pages[spn >> J1939DB_PAGE_BITS] = page;
+            }
+            page[spn & (J1939DB_PAGE_SIZE - 1)]++;
+        }
+    }
+
+    /* Turn the counts into the position of the first reference plus one, in SPN order */
+    uint16_t position = 0;
+    for (size_t i = 0; i < J1939DB_NUM_SPN_PAGES; i++)
+    {
+        if (db->spn_pages[i] == empty_page)
+        {
+            continue;
+        }
+
+        uint16_t * page = (uint16_t *) db->spn_pages[i];
+        for (size_t j = 0; j < J1939DB_PAGE_SIZE; j++)
+        {
+            uint16_t count = page[j];
+            if (count > 0)
+            {
+                page[j] = (uint16_t) (position + 1U);
+                position = (uint16_t) (position + count);
+            }
+        }
+    }
+    db->num_spn_refs = position;
+
+    /* Place the references, walking the records in order keeps the references to each SPN in record order */
+    for (size_t i = 0; i < db->num_pgns; i++)
+    {
+        for (size_t j = 0; j < db->pgns[i].num_spns + db->pgns[i].num_delimited; j++)
+        {
+            uint32_t spn = j1939db_pgn_spns(db, &db->pgns[i])[j].spn;
+            if (spn >= (1UL << J1939DB_SPN_BITS))
+            {
+                continue;
+            }
+
+            size_t first = db->spn_pages[spn >> J1939DB_PAGE_BITS][spn & (J1939DB_PAGE_SIZE - 1)] - 1U;
+            refs[first + next[first]].pgn = (uint16_t) i;
+            refs[first + next[first]].spn = (uint16_t) j;
+            next[first]++;
+        }
+    }
+
+    result = true;
+
+    cleanup:
+    free(next);
+    return result;
+}
+
+/**************************************************************************//**
+
+  \brief Find every place an SPN is carried
+
+  \param db     pointer to the database
+  \param spn    suspect parameter number
+  \param refs   pointer set to the first reference, or NULL if the SPN is not in the database
+
+  \return size_t    number of references
+
+******************************************************************************/
+size_t j1939db_find_spn(const j1939db * db, uint32_t spn, const j1939db_spn_ref ** refs)
+{
+    *refs = NULL;
+    if (spn >= (1UL << J1939DB_SPN_BITS))
+    {
+        return 0;
+    }
+
+    uint16_t index = db->spn_pages[spn >> J1939DB_PAGE_BITS][spn & (J1939DB_PAGE_SIZE - 1)];
+    if (index == 0)
+    {
+        return 0;
+    }
+
+    /* References to the same SPN are adjacent, and an SPN is carried by a handful of PGNs at most */
+    size_t first = index - 1U;
+    size_t last = first + 1;
+    while (last < db->num_spn_refs &&
+           j1939db_pgn_spns(db, &db->pgns[db->spn_refs[last].pgn])[db->spn_refs[last].spn].spn == spn)
+    {
+        last++;
+    }
+
+    *refs = &db->spn_refs[first];
+    return last - first;
+}
+
+/**************************************************************************//**
+
+  \brief Get the SPN metadata of every SPN descriptor
+
+  Descriptors keep their strings as string pool offsets so that they can be
+  used in place from a binary image. The metadata handed out to struct decode
+  users needs pointers instead, so it is resolved once, the first time it is
+  needed, rather than for every descriptor whenever a database is loaded.
+  Threads racing to resolve it each build a copy and the first one published wins.
+
+  \param db     pointer to the database
+
+  \return const j1939decode_spn_info *  metadata indexed like the descriptors, or NULL on failure
+
+******************************************************************************/
+const j1939decode_spn_info * j1939db_spn_infos(const j1939db * db)
+{
+    j1939decode_spn_info * infos = load_infos(db);
+    if (infos != NULL)
+    {
+        return infos;
+    }
+
+    infos = malloc((db->num_spns > 0 ? db->num_spns : 1) * sizeof(j1939decode_spn_info));
+    if (infos == NULL)
+    {
+        log_msg(db->log_fn, "Memory allocation failure");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < db->num_spns; i++)
+    {
+        const j1939db_spn * spn = &db->spns[i];
+        infos[i].spn = spn->spn;
+        infos[i].start_bit = spn->start_bit;
+        infos[i].length = spn->length;
+        infos[i].resolution = spn->resolution;
+        infos[i].offset = spn->offset;
+        infos[i].operational_high = spn->operational_high;
+        infos[i].operational_low = spn->operational_low;
+        infos[i].name = j1939db_string(db, spn->name);
+        infos[i].units = j1939db_string(db, spn->units);
+        infos[i].data_range = j1939db_string(db, spn->data_range);
+        infos[i].operational_range = j1939db_string(db, spn->operational_range);
+    }
+
+    j1939decode_spn_info * published = publish_infos(db, infos);
+    if (published != infos)
+    {
+        free(infos);
+    }
+
+    return published;
+}
+
+/**************************************************************************//**
+
+  \brief Pre-render the static parts of the JSON output into one fragment pool
+
+  Everything that only depends on the database, the SPN metadata, PGN names
+  and source address names, is escaped and formatted once here so that
+  decoding a message only has to copy it and format the decoded values.
+  Binary images store the pool along with the fragment offsets, so this
+  is only done when compiling the database from JSON.
+
+  \param db     pointer to the database
+  \param build  pointer to the records being compiled
+
+  \return bool  boolean indicating if the fragments were rendered
+
+******************************************************************************/
+bool render_json(j1939db * db, json_build * build)
+{
+    j1939json_writer writer;
+
+    j1939db_fragment * states_json = calloc(db->num_states > 0 ? db->num_states : 1, sizeof(j1939db_fragment));
+    db->states_json = states_json;
+    if (states_json == NULL)
+    {
+        log_msg(db->log_fn, "Memory allocation failure");
+        return false;
+    }
+
+    /* First pass only measures the pool */
+    j1939json_init(&writer, NULL, 0);
+    render_fragments(db, build, states_json, &writer);
+
+    bool too_large = writer.length > UINT32_MAX;
+    for (size_t i = 0; i < db->num_spns; i++)
+    {
+        too_large = too_large || build->spns[i].json.length > UINT16_MAX;
+    }
+
+    if (too_large)
+    {
+        log_msg(db->log_fn, "J1939 database strings are too large");
+        return false;
+    }
+
+    char * pool = malloc(writer.length > 0 ? writer.length : 1);
+    if (pool == NULL)
+    {
+        log_msg(db->log_fn, "Memory allocation failure");
+        return false;
+    }
+
+    j1939json_init(&writer, pool, writer.length);
+    render_fragments(db, build, states_json, &writer);
+
+    db->json = pool;
+    db->json_size = writer.length;
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Render every JSON fragment of the database
+
+  Uses the same keys, order and formatting as the cJSON tree built by
+  extract_spn_data() and j1939decode_to_json().
+
+  \param db             pointer to the database
+  \param build          pointer to the records being compiled
+  \param states_json    pointer to the state fragments to fill in
+  \param writer         pointer to the JSON writer, only measuring if it has no buffer
+
+  \return void
+
+******************************************************************************/
+void render_fragments(j1939db * db, json_build * build, j1939db_fragment * states_json, j1939json_writer * writer)
+{
+    for (size_t i = 0; i < db->num_spns; i++)
+    {
+        j1939db_spn * spn = &build->spns[i];
+        uint16_t * json_fields = spn->json_fields;
+        const char * data_range = j1939db_string(db, spn->data_range);
+        const char * name = j1939db_string(db, spn->name);
+        const char * operational_range = j1939db_string(db, spn->operational_range);
+        const char * units = j1939db_string(db, spn->units);
+        size_t start = writer->length;
+
+        j1939json_write_string(writer, spn->key);
+        J1939JSON_WRITE_LITERAL(writer, ":{");
+
+        json_fields[J1939DB_SPN_DATA_RANGE] = (uint16_t) (writer->length - start);
+        if (data_range != NULL)
+        {
+            J1939JSON_WRITE_LITERAL(writer, "\"DataRange\":");
+            j1939json_write_string(writer, data_range);
+            J1939JSON_WRITE_LITERAL(writer, ",");
+        }
+
+        json_fields[J1939DB_SPN_NAME] = (uint16_t) (writer->length - start);
+        if (name != NULL)
+        {
+            J1939JSON_WRITE_LITERAL(writer, "\"Name\":");
+            j1939json_write_string(writer, name);
+            J1939JSON_WRITE_LITERAL(writer, ",");
+        }
+
+        json_fields[J1939DB_SPN_OFFSET] = (uint16_t) (writer->length - start);
+        J1939JSON_WRITE_LITERAL(writer, "\"Offset\":");
+        j1939json_write_number(writer, spn->offset);
+        J1939JSON_WRITE_LITERAL(writer, ",");
+
+        json_fields[J1939DB_SPN_OPERATIONAL_HIGH] = (uint16_t) (writer->length - start);
+        J1939JSON_WRITE_LITERAL(writer, "\"OperationalHigh\":");
+        j1939json_write_number(writer, spn->operational_high);
+        J1939JSON_WRITE_LITERAL(writer, ",");
+
+        json_fields[J1939DB_SPN_OPERATIONAL_LOW] = (uint16_t) (writer->length - start);
+        J1939JSON_WRITE_LITERAL(writer, "\"OperationalLow\":");
+        j1939json_write_number(writer, spn->operational_low);
+        J1939JSON_WRITE_LITERAL(writer, ",");
+
+        json_fields[J1939DB_SPN_OPERATIONAL_RANGE] = (uint16_t) (writer->length - start);
+        if (operational_range != NULL)
+        {
+            J1939JSON_WRITE_LITERAL(writer, "\"OperationalRange\":");
+            j1939json_write_string(writer, operational_range);
+            J1939JSON_WRITE_LITERAL(writer, ",");
+        }
+
+        json_fields[J1939DB_SPN_RESOLUTION] = (uint16_t) (writer->length - start);
+        J1939JSON_WRITE_LITERAL(writer, "\"Resolution\":");
+        j1939json_write_number(writer, spn->resolution);
+        J1939JSON_WRITE_LITERAL(writer, ",");
+
+        json_fields[J1939DB_SPN_LENGTH] = (uint16_t) (writer->length - start);
+        J1939JSON_WRITE_LITERAL(writer, "\"SPNLength\":");
+        j1939json_write_number(writer, spn->length);
+        J1939JSON_WRITE_LITERAL(writer, ",");
+
+        json_fields[J1939DB_SPN_UNITS] = (uint16_t) (writer->length - start);
+        if (units != NULL)
+        {
+            J1939JSON_WRITE_LITERAL(writer, "\"Units\":");
+            j1939json_write_string(writer, units);
+            J1939JSON_WRITE_LITERAL(writer, ",");
+        }
+
+        json_fields[J1939DB_SPN_START_BIT] = (uint16_t) (writer->length - start);
+        J1939JSON_WRITE_LITERAL(writer, "\"StartBit\":");
+        j1939json_write_number(writer, spn->start_bit);
+        J1939JSON_WRITE_LITERAL(writer, ",");
+
+        json_fields[J1939DB_SPN_NUM_FIELDS] = (uint16_t) (writer->length - start);
+        J1939JSON_WRITE_LITERAL(writer, "\"ValueRaw\":");
+
+        set_fragment(writer, &spn->json, start);
+    }
+
+    for (size_t i = 0; i < db->num_pgns; i++)
+    {
+        const char * name = j1939db_string(db, build->pgns[i].name);
+        size_t start = writer->length;
+        if (name != NULL)
+        {
+            j1939json_write_string(writer, name);
+        }
+        set_fragment(writer, &build->pgns[i].name_json, start);
+    }
+
+    for (size_t sa = 0; sa < 256; sa++)
+    {
+        const char * name = j1939db_sa_name(db, (uint8_t) sa);
+        size_t start = writer->length;
+        if (name != NULL)
+        {
+            j1939json_write_string(writer, name);
+        }
+        set_fragment(writer, &db->sa_names_json[sa], start);
+    }
+
+    for (size_t i = 0; i < db->num_states; i++)
+    {
+        const char * state = j1939db_string(db, db->states[i]);
+        size_t start = writer->length;
+        if (state != NULL)
+        {
+            j1939json_write_string(writer, state);
+        }
+        set_fragment(writer, &states_json[i], start);
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Point a fragment at the text written since start
+
+  \param writer     pointer to the JSON writer
+  \param fragment   pointer to the fragment to set
+  \param start      writer length where the fragment starts
+
+  \return void
+
+******************************************************************************/
+void set_fragment(const j1939json_writer * writer, j1939db_fragment * fragment, size_t start)
+{
+    fragment->offset = (uint32_t) start;
+    fragment->length = (uint32_t) (writer->length - start);
+}
+
+/**************************************************************************//**
+
+  \brief Map a binary image file read-only into memory
+
+  Falls back to reading the file into allocated memory where memory mapping is not available.
+
+  \param db         pointer to the database
+  \param filename   binary image filename
+
+  \return bool      boolean indicating if the image was mapped
+
+******************************************************************************/
+bool map_image(j1939db * db, const char * filename)
+{
+#ifdef J1939DB_HAVE_MMAP
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        log_msg(db->log_fn, "Could not open file %s", filename);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        log_msg(db->log_fn, "Could not get size of file %s", filename);
+        close(fd);
+        return false;
+    }
+
+    void * image = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    /* The mapping stays valid after the file is closed */
+    close(fd);
+    if (image == MAP_FAILED)
+    {
+        log_msg(db->log_fn, "Could not map file %s", filename);
+        return false;
+    }
+
+    db->image = image;
+    db->image_size = (size_t) st.st_size;
+    db->image_mapped = true;
+#else
+    FILE * fp = fopen(filename, "rb");
+    if (fp == NULL)
+    {
+        log_msg(db->log_fn, "Could not open file %s", filename);
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long file_size = ftell(fp);
+    rewind(fp);
+
+    void * image = file_size > 0 ? malloc((size_t) file_size) : NULL;
+    if (image == NULL || fread(image, 1, (size_t) file_size, fp) != (size_t) file_size)
+    {
+        log_msg(db->log_fn, "Could not read file %s", filename);
+        free(image);
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+
+    db->image = image;
+    db->image_size = (size_t) file_size;
+    db->image_mapped = false;
+#endif
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Load J1939 database from a binary image file
+
+  The image is mapped read-only, and the records, PGN page table, SPN index,
+  states, strings and pre-rendered JSON fragments are all used in place
+  without being copied, parsed, rendered or indexed. Only the
+  header, the section bounds and the page table directories are checked,
+  so loading takes the same time whatever the size of the database.
+
+  \param db         pointer to the database
+  \param filename   binary image filename
+
+  \return bool      boolean indicating if the database was loaded
+
+******************************************************************************/
+bool load_image(j1939db * db, const char * filename)
+{
+    if (!map_image(db, filename))
+    {
+        return false;
+    }
+
+    const uint8_t * image = db->image;
+    const j1939db_image_header * header = db->image;
+
+    if (db->image_size < sizeof(j1939db_image_header) ||
+        memcmp(header->magic, J1939DB_IMAGE_MAGIC, sizeof(header->magic)) != 0)
+    {
+        log_msg(db->log_fn, "File %s is not a J1939 database image", filename);
+        return false;
+    }
+
+    if (header->byte_order != J1939DB_IMAGE_BYTE_ORDER)
+    {
+        log_msg(db->log_fn, "J1939 database image %s was built for a different byte order", filename);
+        return false;
+    }
+
+    if (header->version != J1939DB_IMAGE_VERSION)
+    {
+        log_msg(db->log_fn, "J1939 database image %s is version %u, expected version %u", filename, header->version, J1939DB_IMAGE_VERSION);
+        return false;
+    }
+
+    if (header->pgn_size != sizeof(j1939db_pgn) || header->spn_size != sizeof(j1939db_spn))
+    {
+        log_msg(db->log_fn, "J1939 database image %s was built with a different record layout", filename);
+        return false;
+    }
+
+    /* Check every section lies within the image, using 64-bit sums so they cannot overflow */
+    if (header->image_size != db->image_size ||
+        header->num_pgns >= UINT16_MAX || header->num_pgn_pages > J1939DB_NUM_PAGES ||
+        header->num_spn_pages > J1939DB_NUM_SPN_PAGES || header->num_spn_refs >= UINT16_MAX ||
+        (uint64_t) header->pgns_offset + (uint64_t) header->num_pgns * sizeof(j1939db_pgn) > db->image_size ||
+        (uint64_t) header->spns_offset + (uint64_t) header->num_spns * sizeof(j1939db_spn) > db->image_size ||
+        (uint64_t) header->pgn_directory_offset + J1939DB_NUM_PAGES * sizeof(uint16_t) > db->image_size ||
+        (uint64_t) header->pgn_pages_offset +
+        (uint64_t) header->num_pgn_pages * J1939DB_PAGE_SIZE * sizeof(uint16_t) > db->image_size ||
+        (uint64_t) header->spn_directory_offset + J1939DB_NUM_SPN_PAGES * sizeof(uint16_t) > db->image_size ||
+        (uint64_t) header->spn_pages_offset +
+        (uint64_t) header->num_spn_pages * J1939DB_PAGE_SIZE * sizeof(uint16_t) > db->image_size ||
+        (uint64_t) header->spn_refs_offset + (uint64_t) header->num_spn_refs * sizeof(j1939db_spn_ref) > db->image_size ||
+        (uint64_t) header->sa_names_offset + 256U * sizeof(uint32_t) > db->image_size ||
+        (uint64_t) header->sa_names_json_offset + 256U * sizeof(j1939db_fragment) > db->image_size ||
+        (uint64_t) header->states_offset + (uint64_t) header->num_states * sizeof(uint32_t) > db->image_size ||
+        (uint64_t) header->states_json_offset +
+        (uint64_t) header->num_states * sizeof(j1939db_fragment) > db->image_size ||
+        (uint64_t) header->strings_offset + header->strings_size > db->image_size ||
+        (uint64_t) header->json_offset + header->json_size > db->image_size ||
+        header->strings_size == 0 || image[header->strings_offset + header->strings_size - 1] != '\0' ||
+        header->pgns_offset % J1939DB_IMAGE_ALIGN != 0 || header->spns_offset % J1939DB_IMAGE_ALIGN != 0 ||
+        header->pgn_directory_offset % J1939DB_IMAGE_ALIGN != 0 || header->pgn_pages_offset % J1939DB_IMAGE_ALIGN != 0 ||
+        header->spn_directory_offset % J1939DB_IMAGE_ALIGN != 0 || header->spn_pages_offset % J1939DB_IMAGE_ALIGN != 0 ||
+        header->spn_refs_offset % J1939DB_IMAGE_ALIGN != 0 ||
+        header->sa_names_offset % J1939DB_IMAGE_ALIGN != 0 || header->sa_names_json_offset % J1939DB_IMAGE_ALIGN != 0 ||
+        header->states_offset % J1939DB_IMAGE_ALIGN != 0 || header->states_json_offset % J1939DB_IMAGE_ALIGN != 0)
+    {
+        log_msg(db->log_fn, "J1939 database image %s is corrupt", filename);
+        return false;
+    }
+
+    db->pgns = (const j1939db_pgn *) &image[header->pgns_offset];
+    db->num_pgns = header->num_pgns;
+    db->spns = (const j1939db_spn *) &image[header->spns_offset];
+    db->num_spns = header->num_spns;
+    db->states = (const uint32_t *) &image[header->states_offset];
+    db->states_json = (const j1939db_fragment *) &image[header->states_json_offset];
+    db->num_states = header->num_states;
+    db->strings = (const char *) &image[header->strings_offset];
+    db->strings_size = header->strings_size;
+    db->json = (const char *) &image[header->json_offset];
+    db->json_size = header->json_size;
+    memcpy(db->sa_names, &image[header->sa_names_offset], sizeof(db->sa_names));
+    memcpy(db->sa_names_json, &image[header->sa_names_json_offset], sizeof(db->sa_names_json));
+
+    db->spn_refs = (const j1939db_spn_ref *) &image[header->spn_refs_offset];
+    db->num_spn_refs = header->num_spn_refs;
+
+    if (!map_pages(db->pgn_pages, J1939DB_NUM_PAGES, (const uint16_t *) &image[header->pgn_directory_offset],
+                   (const uint16_t *) &image[header->pgn_pages_offset], header->num_pgn_pages) ||
+        !map_pages(db->spn_pages, J1939DB_NUM_SPN_PAGES, (const uint16_t *) &image[header->spn_directory_offset],
+                   (const uint16_t *) &image[header->spn_pages_offset], header->num_spn_pages))
+    {
+        log_msg(db->log_fn, "J1939 database image %s is corrupt", filename);
+        return false;
+    }
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Point a page table at the pages stored in a binary image
+
+  \param pages        page table to fill in
+  \param num_pages    number of entries in the page table
+  \param directory    stored page number plus one of every entry, zero for the empty page
+  \param stored       pages stored in the image, one after another
+  \param num_stored   number of pages stored in the image
+
+  \return bool        boolean indicating if every directory entry was in range
+
+******************************************************************************/
+bool map_pages(const uint16_t ** pages, size_t num_pages, const uint16_t * directory,
+               const uint16_t * stored, uint32_t num_stored)
+{
+    for (size_t i = 0; i < num_pages; i++)
+    {
+        if (directory[i] > num_stored)
+        {
+            return false;
+        }
+
+        pages[i] = directory[i] != 0 ? &stored[(directory[i] - 1U) * J1939DB_PAGE_SIZE] : empty_page;
+    }
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Count the pages of a page table that are not the empty page
+
+  \param pages        page table
+  \param num_pages    number of entries in the page table
+
+  \return uint32_t    number of pages to store in a binary image
+
+******************************************************************************/
+uint32_t count_pages(const uint16_t * const * pages, size_t num_pages)
+{
+    uint32_t count = 0;
+    for (size_t i = 0; i < num_pages; i++)
+    {
+        count += pages[i] != empty_page;
+    }
+
+    return count;
+}
+
+/**************************************************************************//**
+
+  \brief Store the pages of a page table in a binary image
+
+  \param pages        page table
+  \param num_pages    number of entries in the page table
+  \param directory    directory to fill in with the stored page number plus one of every entry
+  \param stored       pointer to where the pages are stored, one after another
+
+  \return void
+
+******************************************************************************/
+void store_pages(const uint16_t * const * pages, size_t num_pages, uint16_t * directory, uint16_t * stored)
+{
+    uint16_t num_stored = 0;
+    for (size_t i = 0; i < num_pages; i++)
+    {
+        if (pages[i] != empty_page)
+        {
+            memcpy(&stored[num_stored * J1939DB_PAGE_SIZE], pages[i], J1939DB_PAGE_SIZE * sizeof(uint16_t));
+            directory[i] = ++num_stored;
+        }
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Round an image offset up to the section alignment
+
+  \param offset     image offset
+
+  \return uint32_t  aligned image offset
+
+******************************************************************************/
+uint32_t align_offset(uint32_t offset)
+{
+    return (offset + J1939DB_IMAGE_ALIGN - 1) & ~(J1939DB_IMAGE_ALIGN - 1);
+}
+
+/**************************************************************************//**
+
+  \brief Write J1939 database to a binary image file
+
+  \param db         pointer to the database
+  \param filename   binary image filename
+
+  \return bool      boolean indicating if the image was written
+
+******************************************************************************/
+bool j1939db_write_image(const j1939db * db, const char * filename)
+{
+    j1939db_image_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, J1939DB_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = J1939DB_IMAGE_VERSION;
+    header.byte_order = J1939DB_IMAGE_BYTE_ORDER;
+    header.pgn_size = sizeof(j1939db_pgn);
+    header.spn_size = sizeof(j1939db_spn);
+    header.num_pgns = (uint32_t) db->num_pgns;
+    header.num_spns = (uint32_t) db->num_spns;
+    header.num_pgn_pages = count_pages(db->pgn_pages, J1939DB_NUM_PAGES);
+    header.num_spn_pages = count_pages(db->spn_pages, J1939DB_NUM_SPN_PAGES);
+    header.num_spn_refs = (uint32_t) db->num_spn_refs;
+    header.num_states = (uint32_t) db->num_states;
+    header.strings_size = (uint32_t) db->strings_size;
+    header.json_size = (uint32_t) db->json_size;
+    header.pgns_offset = align_offset(sizeof(header));
+    header.spns_offset = align_offset(header.pgns_offset + header.num_pgns * sizeof(j1939db_pgn));
+    header.pgn_directory_offset = align_offset(header.spns_offset + header.num_spns * sizeof(j1939db_spn));
+    header.pgn_pages_offset = align_offset(header.pgn_directory_offset + J1939DB_NUM_PAGES * sizeof(uint16_t));
+    header.spn_directory_offset = align_offset(header.pgn_pages_offset +
+                                               header.num_pgn_pages * J1939DB_PAGE_SIZE * sizeof(uint16_t));
+    header.spn_pages_offset = align_offset(header.spn_directory_offset + J1939DB_NUM_SPN_PAGES * sizeof(uint16_t));
+    header.spn_refs_offset = align_offset(header.spn_pages_offset +
+                                          header.num_spn_pages * J1939DB_PAGE_SIZE * sizeof(uint16_t));
+    header.sa_names_offset = align_offset(header.spn_refs_offset + header.num_spn_refs * sizeof(j1939db_spn_ref));
+    header.sa_names_json_offset = align_offset(header.sa_names_offset + 256U * sizeof(uint32_t));
+    header.states_offset = align_offset(header.sa_names_json_offset + 256U * sizeof(j1939db_fragment));
+    header.states_json_offset = align_offset(header.states_offset + header.num_states * sizeof(uint32_t));
+    header.strings_offset = align_offset(header.states_json_offset + header.num_states * sizeof(j1939db_fragment));
+    header.json_offset = header.strings_offset + header.strings_size;
+    header.image_size = header.json_offset + header.json_size;
+
+    uint8_t * image = calloc(1, header.image_size);
+    if (image == NULL)
+    {
+        log_msg(db->log_fn, "Memory allocation failure");
+        return false;
+    }
+
+    /* Records hold no pointers, so they are written exactly as they are held */
+    memcpy(image, &header, sizeof(header));
+    memcpy(&image[header.pgns_offset], db->pgns, db->num_pgns * sizeof(j1939db_pgn));
+    memcpy(&image[header.spns_offset], db->spns, db->num_spns * sizeof(j1939db_spn));
+
+    store_pages(db->pgn_pages, J1939DB_NUM_PAGES, (uint16_t *) &image[header.pgn_directory_offset],
+                (uint16_t *) &image[header.pgn_pages_offset]);
+    store_pages(db->spn_pages, J1939DB_NUM_SPN_PAGES, (uint16_t *) &image[header.spn_directory_offset],
+                (uint16_t *) &image[header.spn_pages_offset]);
+    memcpy(&image[header.spn_refs_offset], db->spn_refs, db->num_spn_refs * sizeof(j1939db_spn_ref));
+    memcpy(&image[header.sa_names_offset], db->sa_names, sizeof(db->sa_names));
+    memcpy(&image[header.sa_names_json_offset], db->sa_names_json, sizeof(db->sa_names_json));
+    memcpy(&image[header.states_offset], db->states, db->num_states * sizeof(uint32_t));
+    memcpy(&image[header.states_json_offset], db->states_json, db->num_states * sizeof(j1939db_fragment));
+    memcpy(&image[header.strings_offset], db->strings, db->strings_size);
+    memcpy(&image[header.json_offset], db->json, db->json_size);
+
+    bool ok = false;
+    FILE * fp = fopen(filename, "wb");
+    if (fp == NULL)
+    {
+        log_msg(db->log_fn, "Could not open file %s", filename);
+    }
+    else
+    {
+        ok = fwrite(image, 1, header.image_size, fp) == header.image_size;
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok)
+        {
+            log_msg(db->log_fn, "Could not write file %s", filename);
+        }
+    }
+
+    free(image);
+    return ok;
+}
+
+/**************************************************************************//**
+
+  \brief Write a reference into the string pool as a C expression
+
+  \param fp         output file
+  \param offset     string pool offset, or J1939DB_NULL_STRING
+
+  \return void
+
+******************************************************************************/
+void write_c_string_ref(FILE * fp, uint32_t offset)
+{
+    if (offset == J1939DB_NULL_STRING)
+    {
+        fprintf(fp, "NULL");
+    }
+    else
+    {
+        fprintf(fp, "&strings[%u]", offset);
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Write a double as a C literal that reads back to exactly the same value
+
+  \param fp     output file
+  \param d      value to write
+
+  \return void
+
+******************************************************************************/
+void write_c_double(FILE * fp, double d)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", d);
+
+    /* Make sure the literal is a floating point constant */
+    fprintf(fp, "%s%s", buf, strpbrk(buf, ".eEni") ? "" : ".0");
+}
+
+/**************************************************************************//**
+
+  \brief Write a pre-rendered JSON fragment as a C initializer
+
+  \param fp         output file
+  \param fragment   fragment in the fragment pool
+
+  \return void
+
+******************************************************************************/
+void write_c_fragment(FILE * fp, const j1939db_fragment * fragment)
+{
+    fprintf(fp, "{%u, %u}", fragment->offset, fragment->length);
+}
+
+/**************************************************************************//**
+
+  \brief Write J1939 database as C source defining j1939db_embedded
+
+  The generated source holds the string pool, the pre-rendered JSON
+  fragments, the state tables, the decode plans, the PGN records, the PGN page table,
+  the source address names and the resolved SPN metadata as const tables, so a library built with it
+  needs no database file and does no parsing or allocation at initialization.
+
+  \param db         pointer to the database
+  \param filename   C source filename
+
+  \return bool      boolean indicating if the source was written
+
+******************************************************************************/
+bool j1939db_write_c_source(const j1939db * db, const char * filename)
+{
+    FILE * fp = fopen(filename, "w");
+    if (fp == NULL)
+    {
+        log_msg(db->log_fn, "Could not open file %s", filename);
+        return false;
+    }
+
+    fprintf(fp, "/* J1939 database generated by j1939dbconv %s, do not edit */\n\n", j1939decode_version());
+    fprintf(fp, "#include \"j1939db.h\"\n\n");
+
+    /* String pool as bytes rather than one long literal, which some compilers limit in length */
+    fprintf(fp, "static const char strings[%zu] =\n{", db->strings_size);
+    for (size_t i = 0; i < db->strings_size; i++)
+    {
+        fprintf(fp, "%s0x%02x,", i % 16 == 0 ? "\n    " : " ", (uint8_t) db->strings[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "static const char json_fragments[%zu] =\n{", db->json_size > 0 ? db->json_size : 1);
+    for (size_t i = 0; i < db->json_size; i++)
+    {
+        fprintf(fp, "%s0x%02x,", i % 16 == 0 ? "\n    " : " ", (uint8_t) db->json[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "static const uint32_t states[%zu] =\n{", db->num_states > 0 ? db->num_states : 1);
+    for (size_t i = 0; i < db->num_states; i++)
+    {
+        fprintf(fp, "%s%uU,", i % 8 == 0 ? "\n    " : " ", db->states[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "static const j1939db_fragment states_json[%zu] =\n{", db->num_states > 0 ? db->num_states : 1);
+    for (size_t i = 0; i < db->num_states; i++)
+    {
+        fprintf(fp, "%s", i % 4 == 0 ? "\n    " : " ");
+        write_c_fragment(fp, &db->states_json[i]);
+        fprintf(fp, ",");
+    }
+    fprintf(fp, "\n};\n\n");
+
+    fprintf(fp, "static const j1939db_spn spns[%zu] =\n{\n", db->num_spns > 0 ? db->num_spns : 1);
+    for (size_t i = 0; i < db->num_spns; i++)
+    {
+        const j1939db_spn * spn = &db->spns[i];
+        fprintf(fp, "    {.spn = %u, .start_bit = %uU, .length = %u, .name = %uU, .units = %uU, "
+                ".data_range = %uU, .operational_range = %uU, .states = %uU, .resolution = ",
+                spn->spn, spn->start_bit, spn->length, spn->name, spn->units,
+                spn->data_range, spn->operational_range, spn->states);
+        write_c_double(fp, spn->resolution);
+        fprintf(fp, ", .offset = ");
+        write_c_double(fp, spn->offset);
+        fprintf(fp, ", .operational_high = ");
+        write_c_double(fp, spn->operational_high);
+        fprintf(fp, ", .operational_low = ");
+        write_c_double(fp, spn->operational_low);
+        fprintf(fp, ", .mask = UINT64_C(0x%llx), .shift = %u, .num_bytes = %u, .num_states = %u, ",
+                (unsigned long long) spn->mask, spn->shift, spn->num_bytes, spn->num_states);
+        fprintf(fp, ".key = \"%s\", .json = ", spn->key);
+        write_c_fragment(fp, &spn->json);
+        fprintf(fp, ", .json_fields = {");
+        for (size_t field = 0; field <= J1939DB_SPN_NUM_FIELDS; field++)
+        {
+            fprintf(fp, "%s%u", field > 0 ? ", " : "", spn->json_fields[field]);
+        }
+        fprintf(fp, "}},\n");
+    }
+    fprintf(fp, "};\n\n");
+
+    /* SPN metadata is resolved here so the embedded database never allocates it */
+    fprintf(fp, "static const j1939decode_spn_info infos[%zu] =\n{\n", db->num_spns > 0 ? db->num_spns : 1);
+    for (size_t i = 0; i < db->num_spns; i++)
+    {
+        const j1939db_spn * spn = &db->spns[i];
+        fprintf(fp, "    {.spn = %u, .start_bit = %uU, .length = %u, .resolution = ", spn->spn, spn->start_bit, spn->length);
+        write_c_double(fp, spn->resolution);
+        fprintf(fp, ", .offset = ");
+        write_c_double(fp, spn->offset);
+        fprintf(fp, ", .operational_high = ");
+        write_c_double(fp, spn->operational_high);
+        fprintf(fp, ", .operational_low = ");
+        write_c_double(fp, spn->operational_low);
+        fprintf(fp, ", .name = ");
+        write_c_string_ref(fp, spn->name);
+        fprintf(fp, ", .units = ");
+        write_c_string_ref(fp, spn->units);
+        fprintf(fp, ", .data_range = ");
+        write_c_string_ref(fp, spn->data_range);
+        fprintf(fp, ", .operational_range = ");
+        write_c_string_ref(fp, spn->operational_range);
+        fprintf(fp, "},\n");
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "static const j1939db_pgn pgns[%zu] =\n{\n", db->num_pgns > 0 ? db->num_pgns : 1);
+    for (size_t i = 0; i < db->num_pgns; i++)
+    {
+        const j1939db_pgn * record = &db->pgns[i];
+        fprintf(fp, "    {.pgn = %u, .name = %uU, .name_json = ", record->pgn, record->name);
+        write_c_fragment(fp, &record->name_json);
+        fprintf(fp, ", .first_spn = %u, .num_spns = %u, .num_delimited = %u},\n",
+                record->first_spn, record->num_spns, record->num_delimited);
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "static const uint16_t empty_page[J1939DB_PAGE_SIZE];\n\n");
+    for (size_t page = 0; page < J1939DB_NUM_PAGES; page++)
+    {
+        if (db->pgn_pages[page] == empty_page)
+        {
+            continue;
+        }
+
+        fprintf(fp, "static const uint16_t page_%zu[J1939DB_PAGE_SIZE] =\n{", page);
+        for (size_t i = 0; i < J1939DB_PAGE_SIZE; i++)
+        {
+            fprintf(fp, "%s%u,", i % 16 == 0 ? "\n    " : " ", db->pgn_pages[page][i]);
+        }
+        fprintf(fp, "\n};\n\n");
+    }
+
+    fprintf(fp, "static const j1939db_spn_ref spn_refs[%zu] =\n{", db->num_spn_refs > 0 ? db->num_spn_refs : 1);
+    for (size_t i = 0; i < db->num_spn_refs; i++)
+    {
+        fprintf(fp, "%s{%u, %u},", i % 8 == 0 ? "\n    " : " ", db->spn_refs[i].pgn, db->spn_refs[i].spn);
+    }
+    fprintf(fp, "\n};\n\n");
+
+    for (size_t page = 0; page < J1939DB_NUM_SPN_PAGES; page++)
+    {
+        if (db->spn_pages[page] == empty_page)
+        {
+            continue;
+        }
+
+        fprintf(fp, "static const uint16_t spn_page_%zu[J1939DB_PAGE_SIZE] =\n{", page);
+        for (size_t i = 0; i < J1939DB_PAGE_SIZE; i++)
+        {
+            fprintf(fp, "%s%u,", i % 16 == 0 ? "\n    " : " ", db->spn_pages[page][i]);
+        }
+        fprintf(fp, "\n};\n\n");
+    }
+
+    /* Tables are never written through, the casts only drop const to fit the shared struct */
+    fprintf(fp, "const j1939db j1939db_embedded =\n{\n");
+    fprintf(fp, "    .pgn_pages =\n    {");
+    for (size_t page = 0; page < J1939DB_NUM_PAGES; page++)
+    {
+        if (db->pgn_pages[page] == empty_page)
+        {
+            fprintf(fp, "%sempty_page,", page % 8 == 0 ? "\n        " : " ");
+        }
+        else
+        {
+            fprintf(fp, "%spage_%zu,", page % 8 == 0 ? "\n        " : " ", page);
+        }
+    }
+    fprintf(fp, "\n    },\n");
+    fprintf(fp, "    .pgns = pgns,\n");
+    fprintf(fp, "    .num_pgns = %zu,\n", db->num_pgns);
+    fprintf(fp, "    .spns = spns,\n");
+    fprintf(fp, "    .num_spns = %zu,\n", db->num_spns);
+    fprintf(fp, "    .infos = (j1939decode_spn_info *) infos,\n");
+    fprintf(fp, "    .spn_pages =\n    {");
+    for (size_t page = 0; page < J1939DB_NUM_SPN_PAGES; page++)
+    {
+        if (db->spn_pages[page] == empty_page)
+        {
+            fprintf(fp, "%sempty_page,", page % 8 == 0 ? "\n        " : " ");
+        }
+        else
+        {
+            fprintf(fp, "%sspn_page_%zu,", page % 8 == 0 ? "\n        " : " ", page);
+        }
+    }
+    fprintf(fp, "\n    },\n");
+    fprintf(fp, "    .spn_refs = spn_refs,\n");
+    fprintf(fp, "    .num_spn_refs = %zu,\n", db->num_spn_refs);
+    fprintf(fp, "    .sa_names =\n    {");
+    for (size_t sa = 0; sa < 256; sa++)
+    {
+        fprintf(fp, "%s%uU,", sa % 8 == 0 ? "\n        " : " ", db->sa_names[sa]);
+    }
+    fprintf(fp, "\n    },\n");
+    fprintf(fp, "    .sa_names_json =\n    {");
+    for (size_t sa = 0; sa < 256; sa++)
+    {
+        fprintf(fp, "%s", sa % 4 == 0 ? "\n        " : " ");
+        write_c_fragment(fp, &db->sa_names_json[sa]);
+        fprintf(fp, ",");
+    }
+    fprintf(fp, "\n    },\n");
+    fprintf(fp, "    .states = states,\n");
+    fprintf(fp, "    .states_json = states_json,\n");
+    fprintf(fp, "    .num_states = %zu,\n", db->num_states);
+    fprintf(fp, "    .strings = strings,\n");
+    fprintf(fp, "    .strings_size = sizeof(strings),\n");
+    fprintf(fp, "    .json = json_fragments,\n");
+    fprintf(fp, "    .json_size = %zu,\n", db->json_size);
+    fprintf(fp, "    .embedded = true,\n");
+    fprintf(fp, "};\n");
+
+    bool ok = !ferror(fp);
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok)
+    {
+        log_msg(db->log_fn, "Could not write file %s", filename);
+    }
+
+    return ok;
+}
@@ -0,0 +1,342 @@
+#ifndef J1939DB_H
+#define J1939DB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "j1939decode.h"
+
+/* Compiled J1939 database
+ * Internal to the library and its tools, not installed with the public header
+ * Records hold offsets and indices rather than pointers, so that a binary image can be used in place */
+
+/* String pool offset of a string that is not in the database */
+#define J1939DB_NULL_STRING UINT32_MAX
+
+/* Pre-rendered JSON text in the fragment pool, not terminated; zero length if there is none */
+typedef struct
+{
+    uint32_t offset;
+    uint32_t length;
+} j1939db_fragment;
+
+/* Static SPN fields in JSON output order */
+enum
+{
+    J1939DB_SPN_DATA_RANGE,
+    J1939DB_SPN_NAME,
+    J1939DB_SPN_OFFSET,
+    J1939DB_SPN_OPERATIONAL_HIGH,
+    J1939DB_SPN_OPERATIONAL_LOW,
+    J1939DB_SPN_OPERATIONAL_RANGE,
+    J1939DB_SPN_RESOLUTION,
+    J1939DB_SPN_LENGTH,
+    J1939DB_SPN_UNITS,
+    J1939DB_SPN_START_BIT,
+    J1939DB_SPN_NUM_FIELDS
+};
+
+/* Compiled SPN decode descriptor */
+typedef struct
+{
+    /* SPN metadata, the same fields as j1939decode_spn_info with the strings as string pool offsets
+     * j1939db_spn_infos() resolves them for struct decode users */
+    uint32_t spn;
+    uint32_t start_bit;
+    uint32_t length;
+    uint32_t name;
+    uint32_t units;
+    uint32_t data_range;
+    uint32_t operational_range;
+    /* Enumerated states from the database bit decodings are the num_states entries of the database
+     * state tables from this index on, indexed by raw value
+     * num_states is zero if the SPN has no bit decodings */
+    uint32_t states;
+    double resolution;
+    double offset;
+    double operational_high;
+    double operational_low;
+    /* Extraction kernel, the raw value is (payload >> shift) & mask for any start bit and length */
+    uint64_t mask;
+    uint8_t shift;
+    /* Number of payload bytes the SPN spans, more than 8 if it does not fit in a frame */
+    uint8_t num_bytes;
+    uint16_t num_states;
+    /* SPN number as a JSON key string (six digits at most) */
+    char key[8];
+    /* Everything written for the SPN before its raw value, e.g. "904":{"DataRange":...,"StartBit":0,"ValueRaw":
+     * json_fields[i] is the offset of static field i, which runs up to and including its trailing comma;
+     * the key comes before json_fields[0] and "ValueRaw": starts at json_fields[J1939DB_SPN_NUM_FIELDS] */
+    j1939db_fragment json;
+    uint16_t json_fields[J1939DB_SPN_NUM_FIELDS + 1];
+} j1939db_spn;
+
+/* Pre-resolved PGN record */
+typedef struct
+{
+    uint32_t pgn;
+    /* String pool offset of the name */
+    uint32_t name;
+    /* Name as a quoted and escaped JSON string, zero length if there is no name */
+    j1939db_fragment name_json;
+    /* Decode plan: num_spns SPN descriptors from first_spn on, see j1939db_pgn_spns() */
+    uint32_t first_spn;
+    uint32_t num_spns;
+    /* Variable-length fields in the order they are sent, each ended by a '*' delimiter
+     * SPN descriptors right after the decode plan, see j1939db_pgn_delimited() */
+    uint32_t num_delimited;
+} j1939db_pgn;
+
+/* Place where an SPN is carried: record index into the PGN records and SPN index within the record
+ * Indices from the record's num_spns on are its delimited SPNs */
+typedef struct
+{
+    uint16_t pgn;
+    uint16_t spn;
+} j1939db_spn_ref;
+
+/* PGN lookup table is split into two levels:
+ * the upper 10 bits of the 18-bit PGN (DP, EDP and PF) select a page,
+ * the lower 8 bits (PS) select the entry within the page */
+#define J1939DB_PAGE_BITS 8U
+#define J1939DB_PAGE_SIZE (1U << J1939DB_PAGE_BITS)
+#define J1939DB_NUM_PAGES (1U << (18U - J1939DB_PAGE_BITS))
+
+/* Longest SPN given a state table, which holds one entry per raw value */
+#define J1939DB_MAX_STATE_BITS 8U
+
+/* SPN reverse index uses the same pages for the 19-bit SPN number */
+#define J1939DB_SPN_BITS 19U
+#define J1939DB_NUM_SPN_PAGES (1U << (J1939DB_SPN_BITS - J1939DB_PAGE_BITS))
+
+/* Backs the opaque j1939decode_db handle of the public API */
+typedef struct j1939decode_db
+{
+    /* Page table of PGN record indices
+     * Entries hold the record index plus one so that zero means "not found"
+     * Unused pages all point at the same read-only empty page */
+    const uint16_t * pgn_pages[J1939DB_NUM_PAGES];
+
+    /* Array of all PGN records found in the database */
+    const j1939db_pgn * pgns;
+    size_t num_pgns;
+
+    /* Array of all compiled SPN decode descriptors, grouped by PGN */
+    const j1939db_spn * spns;
+    size_t num_spns;
+
+    /* SPN metadata handed out to struct decode users, indexed like spns
+     * Resolved from the descriptors on first use by j1939db_spn_infos(), NULL until then */
+    j1939decode_spn_info * infos;
+
+    /* Reverse index from SPN number to every place the SPN is carried, delimited SPNs included
+     * Page entries hold the index of the first reference plus one, zero means "not found",
+     * references to the same SPN are adjacent and in PGN record order */
+    const uint16_t * spn_pages[J1939DB_NUM_SPN_PAGES];
+    const j1939db_spn_ref * spn_refs;
+    size_t num_spn_refs;
+
+    /* String pool offsets of the source address names indexed by source address
+     * J1939DB_NULL_STRING entries are preferred addresses with no name found in the database */
+    uint32_t sa_names[256];
+    /* Source address names as quoted and escaped JSON strings, zero length where there is no name */
+    j1939db_fragment sa_names_json[256];
+
+    /* State tables of every SPN with bit decodings, one after another, as string pool offsets */
+    const uint32_t * states;
+    /* States as quoted and escaped JSON strings, zero length where there is no state */
+    const j1939db_fragment * states_json;
+    size_t num_states;
+
+    /* String pool holding every string referenced above */
+    const char * strings;
+    size_t strings_size;
+
+    /* Pool holding every pre-rendered JSON fragment above */
+    const char * json;
+    size_t json_size;
+
+    /* Binary image backing the records, pages, string pool and JSON fragments, if loaded from one */
+    void * image;
+    size_t image_size;
+    bool image_mapped;
+
+    /* Log handler used while loading and writing the database */
+    log_fn_ptr log_fn;
+
+    /* Database is a compile-time constant and must not be freed */
+    bool embedded;
+} j1939db;
+
+#ifdef J1939DECODE_EMBEDDED_DB
+/* Database compiled into the library, generated by j1939dbconv --c-source */
+extern const j1939db j1939db_embedded;
+#endif
+
+/* Load J1939 database from either a JSON file or a binary image file */
+j1939db * j1939db_load(const char * filename, log_fn_ptr log_fn);
+
+/* Free J1939 database */
+void j1939db_free(j1939db * db);
+
+/* Get the SPN metadata of every SPN descriptor, indexed like the descriptors, or NULL on failure
+ * Resolved on first use and shared by every thread using the database */
+const j1939decode_spn_info * j1939db_spn_infos(const j1939db * db);
+
+/* Find every place an SPN is carried, returns the number of references and points refs at the first one */
+size_t j1939db_find_spn(const j1939db * db, uint32_t spn, const j1939db_spn_ref ** refs);
+
+/* Precompute the extraction kernel of an SPN from the start bit and length in its metadata */
+void j1939db_compile_extraction(j1939db_spn * spn);
+
+/* Decode one SPN across a batch of frames of the same PGN into separate arrays of raw values,
+ * decoded values and valid flags, with the widest SIMD kernel the CPU supports
+ * Gives the same values as decoding one frame at a time; DLCs above 8 are taken as 8 */
+void j1939db_decode_column(const j1939db_spn * spn, const uint64_t * data, const uint8_t * dlcs, size_t count,
+                           uint64_t * raw, double * decoded, bool * valid);
+
+/* Column decode kernels j1939db_decode_column() can use */
+typedef enum
+{
+    /* Widest kernel the CPU supports */
+    J1939DB_COLUMN_AUTO,
+    J1939DB_COLUMN_SCALAR,
+    J1939DB_COLUMN_SSE2,
+    J1939DB_COLUMN_AVX2
+} j1939db_column_kernel;
+
+/* Force the kernel used by j1939db_decode_column(), so tests can check the kernels against each other
+ * Not thread-safe; returns false, leaving the kernel as it was, if this build or CPU does not have it */
+bool j1939db_set_column_kernel(j1939db_column_kernel kernel);
+
+/* Write J1939 database to a binary image file */
+bool j1939db_write_image(const j1939db * db, const char * filename);
+
+/* Write J1939 database as C source defining j1939db_embedded */
+bool j1939db_write_c_source(const j1939db * db, const char * filename);
+
+/* Log formatted message to the given handler, or stderr if NULL */
+void j1939decode_vlog(log_fn_ptr fn, const char * fmt, va_list args);
+
+/* Part of the PS field belonging to the PGN, indexed by PF
+ * PDU1 formats (PF below 240) carry the destination address in the PS field instead, so none of it is kept */
+extern const uint8_t j1939db_ps_masks[256];
+
+/* Clear the destination address out of a PGN as found in a CAN identifier */
+static inline uint32_t j1939db_normalize_pgn(uint32_t pgn)
+{
+    return pgn & (~UINT32_C(0xFF) | j1939db_ps_masks[(pgn >> 8U) & 0xFFU]);
+}
+
+/* Get the destination address of a PGN as found in a CAN identifier, the global address 255 for PDU2 formats */
+static inline uint8_t j1939db_get_da(uint32_t pgn)
+{
+    return (uint8_t) (pgn | j1939db_ps_masks[(pgn >> 8U) & 0xFFU]);
+}
+
+/* Get a string from the string pool, or NULL for J1939DB_NULL_STRING */
+static inline const char * j1939db_string(const j1939db * db, uint32_t offset)
+{
+    return offset != J1939DB_NULL_STRING ? &db->strings[offset] : NULL;
+}
+
+/* Get the text of a pre-rendered JSON fragment */
+static inline const char * j1939db_fragment_text(const j1939db * db, const j1939db_fragment * fragment)
+{
+    return &db->json[fragment->offset];
+}
+
+/* Get the source address name of a source address, or NULL if there is none */
+static inline const char * j1939db_sa_name(const j1939db * db, uint8_t sa)
+{
+    return j1939db_string(db, db->sa_names[sa]);
+}
+
+/* Get the decode plan of a PGN record */
+static inline const j1939db_spn * j1939db_pgn_spns(const j1939db * db, const j1939db_pgn * record)
+{
+    return &db->spns[record->first_spn];
+}
+
+/* Get the variable-length fields of a PGN record */
+static inline const j1939db_spn * j1939db_pgn_delimited(const j1939db * db, const j1939db_pgn * record)
+{
+    return &db->spns[record->first_spn + record->num_spns];
+}
+
+/* Get pre-resolved PGN record, or NULL if the PGN is not in the database
+ * PDU1 PGNs are found whatever destination address they carry */
+static inline const j1939db_pgn * j1939db_get_pgn(const j1939db * db, uint32_t pgn)
+{
+    const uint16_t * page = db->pgn_pages[(pgn >> J1939DB_PAGE_BITS) & (J1939DB_NUM_PAGES - 1)];
+    uint16_t index = page[pgn & j1939db_ps_masks[(pgn >> 8U) & 0xFFU]];
+
+    return index ? &db->pgns[index - 1] : NULL;
+}
+
+/* Clear the payload bytes beyond the DLC, which must be at most 8
+ * Two shifts of at most 32 bits each keep DLC 0 and 8 free of undefined shifts and branches */
+static inline uint64_t j1939db_payload(uint64_t data, uint8_t dlc)
+{
+    return data & (((UINT64_C(1) << (4U * dlc)) << (4U * dlc)) - 1);
+}
+
+/* Extract the raw value of an SPN from a payload */
+static inline uint64_t j1939db_extract(const j1939db_spn * spn, uint64_t payload)
+{
+    return (payload >> spn->shift) & spn->mask;
+}
+
+/* Extract the raw value of an SPN from the bytes it spans in a payload of any length
+ * Reads the payload one 64-bit word from the first byte on, plus a ninth byte for 64-bit SPNs not on a byte
+ * boundary; bytes beyond the end of the payload read as zero. Little-endian hosts only, like the frame decoders */
+static inline uint64_t j1939db_extract_bytes(const j1939db_spn * spn, const uint8_t * payload, size_t length)
+{
+    size_t first = spn->start_bit / 8U;
+    uint32_t shift = spn->start_bit % 8U;
+    uint64_t value = 0;
+    uint64_t high = 0;
+
+    if (first + 8U <= length)
+    {
+        memcpy(&value, &payload[first], sizeof(value));
+        high = first + 8U < length ? payload[first + 8U] : 0;
+    }
+    else
+    {
+        for (size_t i = first; i < length; i++)
+        {
+            value |= (uint64_t) payload[i] << (8U * (i - first));
+        }
+    }
+
+    /* Two shifts keep a zero shift free of a 64-bit shift */
+    value = (value >> shift) | ((high << 1U) << (63U - shift));
+    return spn->length >= 64U ? value : value & ((UINT64_C(1) << spn->length) - 1);
+}
+
+/* Get the enumerated state of an SPN raw value, or NULL if there is none */
+static inline const char * j1939db_state(const j1939db * db, const j1939db_spn * spn, uint64_t raw)
+{
+    return raw < spn->num_states ? j1939db_string(db, db->states[spn->states + raw]) : NULL;
+}
+
+/* Get the enumerated state of an SPN raw value as a quoted and escaped JSON string, zero length if there is none
+ * The raw value must be below num_states */
+static inline const j1939db_fragment * j1939db_state_json(const j1939db * db, const j1939db_spn * spn, uint64_t raw)
+{
+    return &db->states_json[spn->states + raw];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //J1939DB_H
@@ -2,33 +2,297 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 
 #include "j1939decode.h"
+#include "j1939db.h"
+#include "j1939json.h"
 #include "cJSON.h"
 
-/* Log function pointer */
-static log_fn_ptr log_fn = NULL;
+/* Number of messages resolved and grouped together at a time by j1939decode_to_struct_batch() */
+#define BATCH_CHUNK_SIZE 256U
+/* Size of the hash table used to group a chunk by PGN record, kept at most half full */
+#define BATCH_GROUP_SLOTS (2U * BATCH_CHUNK_SIZE)
+
+/* Initial size of the change detection table, doubled whenever it gets half full */
+#define CHANGE_TABLE_SIZE 256U
+
+/* Index slots of the output cache per entry, keeps the index at most half full */
+#define CACHE_SLOTS_PER_ENTRY 2U
+
+/* Hint the CPU to start loading data that will be needed soon */
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void) (addr))
+#endif
+
+/* Thread-local storage class, used to route cJSON allocations to the arena of the calling thread */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define THREAD_LOCAL _Thread_local
+#elif defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/* Smallest scratch buffer allocated for unformatted JSON output */
+#define JSON_BUFFER_SIZE 2048U
+
+/* Alignment of every arena allocation, enough for any cJSON type */
+#define ARENA_ALIGN 16U
+
+/* Heap block holding an allocation that did not fit in the arena */
+typedef struct arena_block
+{
+    struct arena_block * next;
+} arena_block;
+
+/* Bump allocator for the JSON tree and string built by j1939decode_ctx_to_json() */
+typedef struct
+{
+    char * base;
+    size_t size;
+    size_t used;
+    /* Bytes requested since the last reset, including those that did not fit */
+    size_t requested;
+    /* Overflow blocks allocated since the last reset */
+    arena_block * overflow;
+} arena;
+
+/* Output field mask, compiled into the runs of adjacent pre-rendered SPN fields it selects */
+typedef struct
+{
+    uint32_t mask;
+    /* First and last static SPN field of each run, J1939DB_SPN_NUM_FIELDS standing for the "ValueRaw" key */
+    uint8_t spn_runs[J1939DB_SPN_NUM_FIELDS + 1][2];
+    size_t num_spn_runs;
+} field_plan;
+
+/* SPN subscription compiled against the context's database */
+typedef struct
+{
+    /* Every SPN of every PGN is decoded while inactive */
+    bool active;
+    /* Bitmap of subscribed source addresses, all of them if all_sas is set */
+    bool all_sas;
+    uint8_t sas[256 / 8];
+    /* Subscribed SPNs of PGN record i are spns[pgn_start[i]] up to spns[pgn_start[i + 1]],
+     * given as indices into the record's SPNs */
+    uint32_t * pgn_start;
+    uint16_t * spns;
+} subscription;
+
+/* PGN record of a message and the SPNs decoded from it */
+typedef struct
+{
+    const j1939db_pgn * record;
+    /* SPN decode descriptors of the record */
+    const j1939db_spn * spns;
+    /* Indices into the SPNs of the record, NULL to decode all of them */
+    const uint16_t * selected;
+    size_t num_spns;
+} spn_selection;
+
+/* Last message of one (SA, PGN) pair seen by the change detection mode */
+typedef struct
+{
+    /* CAN identifier without the priority, plus one so that zero means empty slot */
+    uint32_t key;
+    uint8_t dlc;
+    uint64_t data;
+    /* Timestamp of the last message produced in full */
+    double full_timestamp;
+} change_entry;
+
+/* Change detection state */
+typedef struct
+{
+    bool enabled;
+    double heartbeat;
+    /* Open addressing hash table of the last message of each pair, size is a power of two */
+    change_entry * entries;
+    size_t size;
+    size_t count;
+    /* Changed SPNs of the current message as indices into the SPNs of its record */
+    uint16_t * spns;
+    /* Current message, stored once its output has been produced */
+    bool pending;
+    bool pending_full;
+    uint32_t pending_id;
+    uint8_t pending_dlc;
+    uint64_t pending_data;
+} change_detection;
+
+/* Output of one message held by the output cache */
+typedef struct
+{
+    uint32_t id;
+    uint8_t dlc;
+    /* Set on every hit, cleared as the clock hand sweeps past */
+    bool referenced;
+    uint64_t data;
+    size_t hash;
+    /* Unformatted JSON output, not terminated, in a buffer reused by the next message in this entry */
+    char * text;
+    size_t length;
+    size_t capacity;
+} cache_entry;
+
+/* Output cache, a fixed number of entries replaced in CLOCK order */
+typedef struct
+{
+    cache_entry * entries;
+    size_t size;
+    size_t count;
+    /* Next entry looked at for replacement once the cache is full */
+    size_t hand;
+    /* Open addressing index of entry numbers plus one, zero means empty slot, num_slots is a power of two */
+    uint32_t * slots;
+    size_t num_slots;
+    uint64_t hits;
+    uint64_t misses;
+} output_cache;
+
+/* Decoder context */
+struct j1939decode_ctx
+{
+    /* Shared read-only J1939 lookup table */
+    const j1939db * database;
+
+    /* Log function pointer */
+    log_fn_ptr log_fn;
+
+    /* JSON output profile */
+    j1939decode_profile profile;
+
+    /* Timestamp of the messages decoded next, written by the values profile once set */
+    double timestamp;
+    bool has_timestamp;
+
+    /* Fields produced by the full profile and the struct decoders */
+    field_plan fields;
 
-/* J1939 lookup table pointer */
-static cJSON * j1939db_json = NULL;
+    /* SPNs and source addresses decoded */
+    subscription subscription;
 
-/* JSON object for all PGNs */
-static cJSON * j1939db_pgns = NULL;
-/* JSON object for all SPNs */
-static cJSON * j1939db_spns = NULL;
-/* JSON object for all source addresses */
-static cJSON * j1939db_source_addresses = NULL;
+    /* Last message of each (SA, PGN) pair, while only changes are produced */
+    change_detection changes;
+
+    /* Unformatted JSON output of recent messages, unused while size is zero */
+    output_cache cache;
+
+    /* Output arena for the thread-safe JSON mode, unused while base is NULL */
+    arena arena;
+
+    /* Scratch buffer that unformatted JSON is written into, grown as needed */
+    char * json;
+    size_t json_size;
+
+    /* Scratch space for grouping a chunk of messages in j1939decode_ctx_to_struct_batch() */
+    struct
+    {
+        /* PGN record of each message in the current chunk */
+        const j1939db_pgn * records[BATCH_CHUNK_SIZE];
+        /* Group number of each message in the current chunk */
+        uint16_t msg_group[BATCH_CHUNK_SIZE];
+        /* PGN record and message count of each group, later reused for group start positions */
+        const j1939db_pgn * group_record[BATCH_CHUNK_SIZE];
+        uint16_t group_size[BATCH_CHUNK_SIZE + 1];
+        /* Hash table from PGN record to group number plus one, zero means empty slot */
+        uint16_t group_slots[BATCH_GROUP_SLOTS];
+        /* Message indices in the current chunk, ordered by group */
+        uint16_t order[BATCH_CHUNK_SIZE];
+        /* Next free position of each group while sorting */
+        uint16_t next[BATCH_CHUNK_SIZE];
+    } batch;
+};
+
+/* Default context used by the non-reentrant API, producing every field */
+static j1939decode_ctx default_ctx = {
+    .fields = {J1939DECODE_FIELDS_ALL, {{0, J1939DB_SPN_NUM_FIELDS}}, 1}
+};
+
+/* J1939 lookup table loaded by j1939decode_init() for the default context */
+static j1939db * database = NULL;
+
+/* Arena that cJSON allocations of the calling thread are routed to, NULL to use the heap */
+static THREAD_LOCAL arena * current_arena = NULL;
+
+/* Guards the one-time installation of the cJSON allocator hooks */
+#if defined(_WIN32)
+static INIT_ONCE hooks_once = INIT_ONCE_STATIC_INIT;
+#else
+static pthread_once_t hooks_once = PTHREAD_ONCE_INIT;
+#endif
+
+/* Write a key given as a string literal, preceded by a comma unless it is the first in its object */
+#define WRITE_KEY(writer, first, literal) write_key((writer), (first), (literal), sizeof(literal) - 1)
+
+/* Version string built at compile time */
+#define STRINGIFY(x) #x
+#define VERSION_STRING(major, minor, patch) STRINGIFY(major) "." STRINGIFY(minor) "." STRINGIFY(patch)
 
 /* Static helper functions */
-static void log_msg(const char * fmt, ...);
-static char * file_read(const char * filename, const char * mode);
-static bool in_array(uint32_t val, const uint32_t * array, size_t len);
+static void log_msg(const j1939decode_ctx * ctx, const char * fmt, ...);
 static cJSON * create_byte_array(const uint64_t * data);
-static const cJSON * get_pgn_data(uint32_t pgn);
-static const cJSON * get_spn_data(uint32_t spn);
-static cJSON * extract_spn_data(uint32_t spn, const uint64_t * data, uint32_t start_bit);
-static char * get_sa_name(uint8_t sa);
-static char * get_pgn_name(uint32_t pgn);
+static void decode_spn(const j1939db * db, const j1939decode_spn_info * infos, const j1939db_spn * plan,
+                       const uint64_t * data, uint8_t dlc, j1939decode_spn_value * value);
+static void decode_spn_bytes(const j1939db * db, const j1939decode_spn_info * infos, const j1939db_spn * plan,
+                             const uint8_t * payload, size_t length,
+                             j1939decode_spn_value * value);
+static cJSON * extract_spn_data(const j1939db * db, const j1939db_spn * plan, const j1939decode_spn_value * value,
+                                uint32_t fields);
+static bool select_spns(const j1939decode_ctx * ctx, uint32_t id, spn_selection * selection);
+static const uint16_t * get_subscribed_spns(const j1939decode_ctx * ctx, const j1939db_pgn * record, size_t * num_spns);
+static void unsubscribe(subscription * sub);
+static bool detect_changes(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                           spn_selection * selection);
+static void commit_changes(j1939decode_ctx * ctx);
+static change_entry * find_change_entry(const change_detection * changes, uint32_t id);
+static bool grow_changes(change_detection * changes);
+static void clear_changes(change_detection * changes);
+static void free_changes(change_detection * changes);
+static size_t render_json(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                          const spn_selection * selection, char * buffer, size_t size);
+static bool use_cache(const j1939decode_ctx * ctx);
+static size_t hash_message(uint32_t id, uint8_t dlc, const uint64_t * data);
+static void store_output(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                         const char * text, size_t length);
+static void remove_cache_slot(output_cache * cache, size_t entry);
+static void clear_cache(output_cache * cache);
+static void free_cache(output_cache * cache);
+static size_t write_json(const j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                         const spn_selection * selection, char * buffer, size_t size);
+static size_t write_values_json(const j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                                const spn_selection * selection, char * buffer, size_t size);
+static void write_key(j1939json_writer * writer, bool * first, const char * key, size_t length);
+static void write_sa_name(const j1939decode_ctx * ctx, j1939json_writer * writer, uint8_t sa);
+static void write_pgn_name(const j1939decode_ctx * ctx, j1939json_writer * writer, const j1939db_pgn * record);
+static char * print_json(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                         const spn_selection * selection);
+static void decode_msg_group(const j1939decode_ctx * ctx, const j1939decode_spn_info * infos, const j1939db_pgn * record,
+                             const uint16_t * order, size_t count, const uint64_t * data, j1939decode_msg * msgs);
+static char * get_sa_name(const j1939decode_ctx * ctx, uint8_t sa);
+static char * get_pgn_name(const j1939decode_ctx * ctx, uint32_t pgn);
+static void * arena_alloc(arena * a, size_t size);
+static void arena_reset(arena * a);
+static void arena_release(arena * a);
+static void install_hooks(void);
+#if defined(_WIN32)
+static BOOL CALLBACK init_hooks(PINIT_ONCE once, PVOID parameter, PVOID * context);
+#else
+static void init_hooks(void);
+#endif
+static void * CJSON_CDECL arena_malloc_hook(size_t size);
+static void CJSON_CDECL arena_free_hook(void * ptr);
 
 /* Extract J1939 sub fields from CAN ID */
 static inline uint8_t get_pri(uint32_t id)
@@ -38,8 +302,13 @@ static inline uint8_t get_pri(uint32_t id)
 }
 static inline uint32_t get_pgn(uint32_t id)
 {
-    /* 18-bit parameter group number */
-    return (uint32_t) ((id >> 8U) & ((1U << 18U) - 1));
+    /* 18-bit parameter group number, without the destination address of PDU1 formats */
+    return j1939db_normalize_pgn((uint32_t) ((id >> 8U) & ((1U << 18U) - 1)));
+}
+static inline uint8_t get_da(uint32_t id)
+{
+    /* 8-bit destination address of PDU1 formats, global address for PDU2 formats */
+    return j1939db_get_da((uint32_t) ((id >> 8U) & ((1U << 18U) - 1)));
 }
 static inline uint8_t get_sa(uint32_t id)
 {
@@ -47,24 +316,31 @@ static inline uint8_t get_sa(uint32_t id)
     return (uint8_t) ((id >> 0U) & ((1U << 8U) - 1));
 }
 
+/* Get the i-th SPN decode descriptor of a selection */
+static inline const j1939db_spn * get_spn(const spn_selection * selection, size_t i)
+{
+    return &selection->spns[selection->selected != NULL ? selection->selected[i] : i];
+}
+
 /**************************************************************************//**
 
   \brief Log formatted message to user defined handler, or stderr as default
 
+  \param fn     log handler, or NULL to log to stderr
+  \param fmt    format string
+  \param args   format arguments
+
   \return void
 
 ******************************************************************************/
-void log_msg(const char * fmt, ...)
+void j1939decode_vlog(log_fn_ptr fn, const char * fmt, va_list args)
 {
     char buf[4096];
-    va_list args;
-    va_start(args, fmt);
     vsnprintf(buf, sizeof(buf), fmt, args);
-    va_end(args);
 
-    if (log_fn)
+    if (fn)
     {
-        (*log_fn)(buf);
+        (*fn)(buf);
     }
     else
     {
@@ -75,50 +351,19 @@ void log_msg(const char * fmt, ...)
 
 /**************************************************************************//**
 
-  \brief  Read file contents into allocated memory
+  \brief Log formatted message to the log handler of a context
+
+  \param ctx    pointer to the decoder context
 
-  \return pointer to string containing file contents
+  \return void
 
 ******************************************************************************/
-char * file_read(const char * filename, const char * mode)
+void log_msg(const j1939decode_ctx * ctx, const char * fmt, ...)
 {
-    FILE * fp = fopen(filename, mode);
-    if (fp == NULL)
-    {
-        log_msg("Could not open file %s", filename);
-        /* No need to close the file before returning since it was never opened */
-        return NULL;
-    }
-
-    /* Get total file size */
-    fseek(fp, 0, SEEK_END);
-    long file_size = ftell(fp);
-    rewind(fp);
-
-    /* Allocate enough memory for entire file */
-    char * buf = malloc(file_size + 1);
-    if (buf == NULL)
-    {
-        log_msg("Memory allocation failure");
-        fclose(fp);
-        return NULL;
-    }
-
-    /* Read the entire file into a buffer */
-    long read_size = fread(buf, 1, file_size, fp);
-    if (read_size != file_size)
-    {
-        log_msg("Read %ld of %ld total bytes in file %s", read_size, file_size, filename);
-        fclose(fp);
-        return NULL;
-    }
-
-    fclose(fp);
-
-    // Null terminator
-    buf[file_size] = '\0';
-
-    return buf;
+    va_list args;
+    va_start(args, fmt);
+    j1939decode_vlog(ctx->log_fn, fmt, args);
+    va_end(args);
 }
 
 /**************************************************************************//**
@@ -132,7 +377,7 @@ void j1939decode_set_log_fn(log_fn_ptr fn)
 {
     if (fn)
     {
-        log_fn = fn;
+        default_ctx.log_fn = fn;
     }
 }
 
@@ -145,10 +390,8 @@ void j1939decode_set_log_fn(log_fn_ptr fn)
 ******************************************************************************/
 const char * j1939decode_version(void)
 {
-    static char version[15];
-    sprintf(version, "%i.%i.%i", J1939DECODE_VERSION_MAJOR, J1939DECODE_VERSION_MINOR, J1939DECODE_VERSION_PATCH);
-
-    return version;
+    /* Constant string so that concurrent callers never share a writable buffer */
+    return VERSION_STRING(J1939DECODE_VERSION_MAJOR, J1939DECODE_VERSION_MINOR, J1939DECODE_VERSION_PATCH);
 }
 
 /**************************************************************************//**
@@ -160,23 +403,8 @@ const char * j1939decode_version(void)
 ******************************************************************************/
 void j1939decode_init(void)
 {
-    char * s;
-    /* Memory-map all file contents */
-    s = file_read(J1939DECODE_DB, "r");
-    if (s != NULL)
-    {
-        j1939db_json = cJSON_Parse(s);
-        free(s);
-        if (j1939db_json == NULL)
-        {
-            log_msg("Unable to parse J1939db");
-        }
-    }
-
-    /* Pre-allocate large JSON objects */
-    j1939db_pgns = cJSON_GetObjectItemCaseSensitive(j1939db_json, "J1939PGNdb");
-    j1939db_spns = cJSON_GetObjectItemCaseSensitive(j1939db_json, "J1939SPNdb");
-    j1939db_source_addresses = cJSON_GetObjectItemCaseSensitive(j1939db_json, "J1939SATabledb");
+    database = j1939decode_db_load(NULL, default_ctx.log_fn);
+    default_ctx.database = database;
 }
 
 /**************************************************************************//**
@@ -188,472 +416,2978 @@ void j1939decode_init(void)
 ******************************************************************************/
 void j1939decode_deinit(void)
 {
-    /* cJSON_Delete() checks if pointer is NULL before freeing */
-    cJSON_Delete(j1939db_json);
+    /* j1939db_free() checks if pointer is NULL before freeing */
+    j1939db_free(database);
 
     /* Explicitly set pointer to NULL */
-    j1939db_json = NULL;
+    database = NULL;
+    default_ctx.database = NULL;
+
+    /* Subscription and change detection were set up against the database just freed */
+    unsubscribe(&default_ctx.subscription);
+    free_changes(&default_ctx.changes);
+    free_cache(&default_ctx.cache);
+
+    free(default_ctx.json);
+    default_ctx.json = NULL;
+    default_ctx.json_size = 0;
 }
 
 /**************************************************************************//**
 
-  \brief
+  \brief Load J1939 database for use by decoder contexts
 
-  \param val    value to search
-  \param array  array of values to search in
-  \param len    number of elements in array
+  \param filename   JSON or binary image filename, or NULL for the default database
+  \param fn         log handler used while loading, or NULL to log to stderr
 
-  \return bool  boolean indicating if value was found in array
+  \return j1939decode_db *  pointer to the database, or NULL on failure
 
 ******************************************************************************/
-bool in_array(uint32_t val, const uint32_t * array, size_t len)
+j1939decode_db * j1939decode_db_load(const char * filename, log_fn_ptr fn)
 {
-    for (size_t i = 0; i < len; i++)
+    if (filename == NULL)
     {
-        if (val == array[i])
-        {
-            return true;
-        }
+#ifdef J1939DECODE_EMBEDDED_DB
+        /* Use the database compiled into the library, nothing to load */
+        return (j1939db *) &j1939db_embedded;
+#else
+        filename = J1939DECODE_DB;
+#endif
     }
-    return false;
+
+    /* Parse and compile the JSON database, or map a binary database image */
+    return j1939db_load(filename, fn);
 }
 
 /**************************************************************************//**
 
-  \brief Split 64 bit number into JSON array object of bytes
+  \brief Free J1939 database loaded by j1939decode_db_load()
 
-  \param data     pointer to data (8 bytes total)
+  \param db     pointer to the database
 
-  \return cJSON * pointer to the JSON array object
+  \return void
 
 ******************************************************************************/
-cJSON * create_byte_array(const uint64_t * data)
+void j1939decode_db_free(j1939decode_db * db)
 {
-    cJSON * array = cJSON_CreateArray();
-    if (array == NULL)
+    /* j1939db_free() checks if pointer is NULL or embedded before freeing */
+    j1939db_free(db);
+}
+
+/**************************************************************************//**
+
+  \brief Find every PGN carrying an SPN in the default database
+
+  \param spn        suspect parameter number
+  \param locations  pointer to array of locations to fill in, may be NULL if max is zero
+  \param max        number of locations the array holds
+
+  \return size_t    total number of locations, which may be more than max
+
+******************************************************************************/
+size_t j1939decode_spn_locations(uint32_t spn, j1939decode_spn_location * locations, size_t max)
+{
+    /* Fail and return zero if database is not loaded
+     * Remember to call j1939decode_init() first! */
+    if (database == NULL)
     {
-        goto cleanup;
+        log_msg(&default_ctx, "J1939 database not loaded");
+        return 0;
     }
 
-    for (uint32_t i = 0; i < sizeof(data); i++)
+    return j1939decode_db_spn_locations(database, spn, locations, max);
+}
+
+/**************************************************************************//**
+
+  \brief Generate SocketCAN filters for a set of PGNs, SPNs and source addresses in the default database
+
+  \param pgns           pointer to array of PGNs, may be NULL if num_pgns is zero
+  \param num_pgns       number of PGNs
+  \param spns           pointer to array of SPNs, may be NULL if num_spns is zero
+  \param num_spns       number of SPNs
+  \param sas            pointer to array of source addresses, may be NULL if num_sas is zero
+  \param num_sas        number of source addresses, or zero for any source address
+  \param filters        pointer to array of filters to fill in
+  \param max_filters    number of filters the array holds
+
+  \return size_t        number of filters filled in, zero if nothing is subscribed or on failure
+
+******************************************************************************/
+size_t j1939decode_can_filters(const uint32_t * pgns, size_t num_pgns, const uint32_t * spns, size_t num_spns,
+                               const uint8_t * sas, size_t num_sas,
+                               j1939decode_can_filter * filters, size_t max_filters)
+{
+    /* Fail and return zero if database is not loaded
+     * Remember to call j1939decode_init() first! */
+    if (database == NULL)
     {
-        /* Cast to uint8 pointer and then index */
-        cJSON * num = cJSON_CreateNumber(((uint8_t *) data)[i]);
-        if (num == NULL)
+        log_msg(&default_ctx, "J1939 database not loaded");
+        return 0;
+    }
+
+    return j1939decode_db_can_filters(database, pgns, num_pgns, spns, num_spns, sas, num_sas, filters, max_filters);
+}
+
+/**************************************************************************//**
+
+  \brief Find every PGN carrying an SPN
+
+  \param db         pointer to a loaded database
+  \param spn        suspect parameter number
+  \param locations  pointer to array of locations to fill in, may be NULL if max is zero
+  \param max        number of locations the array holds
+
+  \return size_t    total number of locations, which may be more than max
+
+******************************************************************************/
+size_t j1939decode_db_spn_locations(const j1939decode_db * db, uint32_t spn,
+                                    j1939decode_spn_location * locations, size_t max)
+{
+    const j1939db_spn_ref * refs;
+    size_t num_refs = j1939db_find_spn(db, spn, &refs);
+
+    /* SPN metadata is only resolved once a location is asked for */
+    const j1939decode_spn_info * infos = NULL;
+    if (num_refs > 0 && max > 0)
+    {
+        infos = j1939db_spn_infos(db);
+        if (infos == NULL)
         {
-            goto cleanup;
+            return 0;
         }
-        cJSON_AddItemToArray(array, num);
     }
 
-    return array;
+    for (size_t i = 0; i < num_refs && i < max; i++)
+    {
+        const j1939db_pgn * record = &db->pgns[refs[i].pgn];
+        locations[i].pgn = record->pgn;
+        locations[i].start_bit = j1939db_pgn_spns(db, record)[refs[i].spn].start_bit;
+        locations[i].info = &infos[record->first_spn + refs[i].spn];
+    }
 
-    cleanup:
-    cJSON_Delete(array);
-    return NULL;
+    return num_refs;
 }
 
 /**************************************************************************//**
 
-  \brief Get parameter group number data
+  \brief Create decoder context
 
-  \param pgn      parameter group number
+  \param db     pointer to a loaded database, shared with other contexts
 
-  \return cJSON * pointer to the PGN data JSON object
+  \return j1939decode_ctx *  pointer to the context, or NULL on failure
 
 ******************************************************************************/
-const cJSON * get_pgn_data(uint32_t pgn)
+j1939decode_ctx * j1939decode_ctx_create(const j1939decode_db * db)
 {
-    /* String large enough to fit a six-digit number (18 bits) */
-    char pgn_string[7];
-    snprintf(pgn_string, sizeof(pgn_string), "%d", pgn);
+    if (db == NULL)
+    {
+        return NULL;
+    }
+
+    j1939decode_ctx * ctx = calloc(1, sizeof(j1939decode_ctx));
+    if (ctx == NULL)
+    {
+        return NULL;
+    }
+
+    ctx->database = db;
+    ctx->log_fn = db->log_fn;
+    j1939decode_ctx_set_fields(ctx, J1939DECODE_FIELDS_ALL);
+
+    return ctx;
+}
+
+/**************************************************************************//**
+
+  \brief Destroy decoder context
+
+  \param ctx    pointer to the context
+
+  \return void
 
-    const cJSON * pgn_data = cJSON_GetObjectItemCaseSensitive(j1939db_pgns, pgn_string);
+******************************************************************************/
+void j1939decode_ctx_destroy(j1939decode_ctx * ctx)
+{
+    if (ctx == NULL)
+    {
+        return;
+    }
 
-    return pgn_data;
+    arena_release(&ctx->arena);
+    unsubscribe(&ctx->subscription);
+    free_changes(&ctx->changes);
+    free_cache(&ctx->cache);
+    free(ctx->json);
+    free(ctx);
 }
 
 /**************************************************************************//**
 
-  \brief Get suspect parameter number data
+  \brief Set log function handler of a context
 
-  \param spn      suspect parameter number
+  \param ctx    pointer to the context
+  \param fn     log handler, or NULL to log to stderr
 
-  \return cJSON * pointer to the SPN data JSON object
+  \return void
 
 ******************************************************************************/
-const cJSON * get_spn_data(uint32_t spn)
+void j1939decode_ctx_set_log_fn(j1939decode_ctx * ctx, log_fn_ptr fn)
 {
-    /* String large enough to fit a six-digit number */
-    char spn_string[7];
-    snprintf(spn_string, sizeof(spn_string), "%d", spn);
+    ctx->log_fn = fn;
+}
+
+/**************************************************************************//**
 
-    const cJSON * spn_data = cJSON_GetObjectItemCaseSensitive(j1939db_spns, spn_string);
+  \brief Select JSON output profile of the default context
 
-    return spn_data;
+  \param profile    output profile
+
+  \return void
+
+******************************************************************************/
+void j1939decode_set_profile(j1939decode_profile profile)
+{
+    j1939decode_ctx_set_profile(&default_ctx, profile);
 }
 
 /**************************************************************************//**
 
-  \brief Extract suspect parameter number data items and decode SPN value
+  \brief Select JSON output profile of a context
 
-  \param spn        suspect parameter number
-  \param data       pointer to data (8 bytes total)
-  \param start_bit  starting bit of SPN in PGN (zero-order)
+  \param ctx        pointer to the context
+  \param profile    output profile
 
-  \return cJSON *   pointer to the SPN data JSON object
+  \return void
 
 ******************************************************************************/
-cJSON * extract_spn_data(uint32_t spn, const uint64_t * data, uint32_t start_bit)
+void j1939decode_ctx_set_profile(j1939decode_ctx * ctx, j1939decode_profile profile)
 {
-    /* JSON object for specific SPN data */
-    const cJSON * spn_data = get_spn_data(spn);
+    ctx->profile = profile;
+    clear_cache(&ctx->cache);
+}
 
-    /* Mutable copy of SPN data object
-     * We are keeping all existing fields and then adding more of our own */
-    /* TODO: Create our own SPN data JSON object rather than copying the existing one
-     * By creating our own JSON object and adding all fields explicitly we have control over what the key names are */
-    cJSON * spn_data_copy = cJSON_Duplicate(spn_data, 1);
+/**************************************************************************//**
 
-    /* TODO: Use PascalCase or snake_case for JSON key names?
-     * Existing J1939 lookup table uses PascalCase but snake_case may be more appropriate */
+  \brief Set timestamp of the messages decoded next by the default context
 
-    if (cJSON_IsObject(spn_data))
-    {
-        int length_in_bits = cJSON_GetObjectItemCaseSensitive(spn_data, "SPNLength")->valueint;
-        int offset = cJSON_GetObjectItemCaseSensitive(spn_data, "Offset")->valueint;
-        double resolution = cJSON_GetObjectItemCaseSensitive(spn_data, "Resolution")->valuedouble;
-        double operational_high = cJSON_GetObjectItemCaseSensitive(spn_data, "OperationalHigh")->valuedouble;
-        double operational_low = cJSON_GetObjectItemCaseSensitive(spn_data, "OperationalLow")->valuedouble;
-        /* Not currently using name or units
-        char * name = cJSON_GetObjectItemCaseSensitive(spn_data, "Name")->valuestring;
-        char * units = cJSON_GetObjectItemCaseSensitive(spn_data, "Units")->valuestring;
-        */
+  \param timestamp  timestamp in seconds
 
-        /* TODO: Support bit decodings for when the units are "Bits" */
-        /* TODO: Support decoding of ASCII values when resolution is "ASCII" */
+  \return void
 
-        /* Decode the data for this SPN */
-        uint64_t mask = (1U << (unsigned int) length_in_bits) - 1;
-        uint64_t value_raw = ((*data) >> start_bit) & mask;
-        double value = value_raw * resolution + offset;
+******************************************************************************/
+void j1939decode_set_timestamp(double timestamp)
+{
+    j1939decode_ctx_set_timestamp(&default_ctx, timestamp);
+}
 
-        if (cJSON_AddNumberToObject(spn_data_copy, "StartBit", start_bit) == NULL)
-        {
-            goto cleanup;
-        }
+/**************************************************************************//**
 
-        if (cJSON_AddNumberToObject(spn_data_copy, "ValueRaw", value_raw) == NULL)
-        {
-            goto cleanup;
-        }
+  \brief Set timestamp of the messages decoded next by a context
 
-        /* Decoded value is valid boolean defaulting to false */
-        cJSON_bool valid = false;
+  \param ctx        pointer to the context
+  \param timestamp  timestamp in seconds
 
-        /* Check that decoded value is within operational range */
-        if (value >= operational_low && value <= operational_high)
-        {
-            if (cJSON_AddNumberToObject(spn_data_copy, "ValueDecoded", value) == NULL)
-            {
-                goto cleanup;
-            }
+  \return void
 
-            valid = true;
-        }
-        else
-        {
-            /* Decoded value is invalid or not available if outside of operation range
-             * Use the "Valid" boolean key when checking if decoded data is valid or not */
-            if (cJSON_AddStringToObject(spn_data_copy, "ValueDecoded", "Not available") == NULL)
-            {
-                goto cleanup;
-            }
-        }
+******************************************************************************/
+void j1939decode_ctx_set_timestamp(j1939decode_ctx * ctx, double timestamp)
+{
+    ctx->timestamp = timestamp;
+    ctx->has_timestamp = true;
+}
 
-        if (cJSON_AddBoolToObject(spn_data_copy, "Valid", valid) == NULL)
-        {
-            goto cleanup;
-        }
-    }
-    else
-    {
-        log_msg("No SPN data found in database for SPN %d", spn);
-        goto cleanup;
-    }
+/**************************************************************************//**
 
-    return spn_data_copy;
+  \brief Select the output fields of the default context
 
-    cleanup:
-    cJSON_Delete(spn_data_copy);
-    /* Do not return the freed cJSON pointer to avoid use-after-free flaw
-     * cJSON_Delete() does not set the freed pointer to NULL */
-    return NULL;
+  \param fields     mask of J1939DECODE_FIELD_* bits
+
+  \return void
+
+******************************************************************************/
+void j1939decode_set_fields(uint32_t fields)
+{
+    j1939decode_ctx_set_fields(&default_ctx, fields);
 }
 
 /**************************************************************************//**
 
-  \brief Get source address name
+  \brief Select the output fields of a context
 
-  \param sa      source address number
+  The mask is compiled once here into runs of adjacent static SPN fields,
+  each of which is then copied from the pre-rendered SPN fragment in one go.
 
-  \return char * pointer to the source address name string
+  \param ctx        pointer to the context
+  \param fields     mask of J1939DECODE_FIELD_* bits
+
+  \return void
 
 ******************************************************************************/
-char * get_sa_name(uint8_t sa)
+void j1939decode_ctx_set_fields(j1939decode_ctx * ctx, uint32_t fields)
 {
-    char * sa_name;
+    field_plan * plan = &ctx->fields;
 
-    /* Preferred Addresses are in the range of 0 to 127 and 248 to 255 */
-    if (sa <= 127 || sa >= 248)
+    plan->mask = fields & J1939DECODE_FIELDS_ALL;
+    plan->num_spn_runs = 0;
+    clear_cache(&ctx->cache);
+
+    /* SPN field bits follow the static field order of the fragment, with "ValueRaw" right after the last one */
+    bool in_run = false;
+    for (uint8_t i = 0; i <= J1939DB_SPN_NUM_FIELDS; i++)
     {
-        /* Source addresses 92 through to 127 have not yet been assigned */
-        if (sa >= 92 && sa <= 127)
+        if ((plan->mask & (J1939DECODE_FIELD_SPN_DATA_RANGE << i)) == 0)
         {
-            sa_name = "Reserved";
+            in_run = false;
+            continue;
         }
-        else
-        {
-            /* String large enough to fit a three-digit number (8 bits) */
-            char sa_string[4];
-            snprintf(sa_string, sizeof(sa_string), "%d", sa);
 
-            sa_name = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(j1939db_source_addresses, sa_string));
-            if (sa_name == NULL)
-            {
-                sa_name = "Unknown";
-                log_msg("No source address name found in database for source address %d", sa);
-            }
+        if (!in_run)
+        {
+            plan->spn_runs[plan->num_spn_runs++][0] = i;
+            in_run = true;
         }
+        plan->spn_runs[plan->num_spn_runs - 1][1] = i;
     }
-        /* Industry Group specific addresses are in the range of 128 to 247 */
-    else if (sa >= 128 && sa <= 247)
-    {
-        sa_name = "Industry Group specific";
-    }
-    else
-    {
-        sa_name = "Unknown";
-        log_msg("Unknown source address %d outside of expected range", sa);
-    }
-
-    return sa_name;
 }
 
 /**************************************************************************//**
 
-  \brief Get parameter group number name
+  \brief Subscribe the default context to a set of SPNs
 
-  \param pgn     parameter group number
+  \param spns       pointer to array of SPNs, may be NULL if num_spns is zero
+  \param num_spns   number of SPNs, or zero to decode every SPN again
+  \param sas        pointer to array of source addresses, may be NULL if num_sas is zero
+  \param num_sas    number of source addresses, or zero for any source address
 
-  \return char * pointer to the PGN name string
+  \return bool      boolean indicating if the subscription was set up
 
 ******************************************************************************/
-char * get_pgn_name(uint32_t pgn)
+bool j1939decode_subscribe(const uint32_t * spns, size_t num_spns, const uint8_t * sas, size_t num_sas)
 {
-    char * pgn_name = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(get_pgn_data(pgn), "Name"));
-    if (pgn_name == NULL)
-    {
-        pgn_name = "Unknown";
-        log_msg("No PGN name found in database for PGN %d", pgn);
-    }
-
-    return pgn_name;
+    return j1939decode_ctx_subscribe(&default_ctx, spns, num_spns, sas, num_sas);
 }
 
 /**************************************************************************//**
 
-  \brief Build JSON string for j1939 decoded data
+  \brief Subscribe a context to a set of SPNs
 
-  \param id         CAN identifier
-  \param dlc        data length code
-  \param data       pointer to data (8 bytes total)
-  \param pretty     pretty print returned JSON string
+  The subscription is compiled once here, through the reverse SPN index, into
+  a list of SPN indices per PGN record, so that a message of an unsubscribed PGN is rejected right after the
+  PGN lookup and a subscribed PGN only decodes the SPNs asked for.
 
-  \return char *    pointer to the JSON string
+  \param ctx        pointer to the context
+  \param spns       pointer to array of SPNs, may be NULL if num_spns is zero
+  \param num_spns   number of SPNs, or zero to decode every SPN again
+  \param sas        pointer to array of source addresses, may be NULL if num_sas is zero
+  \param num_sas    number of source addresses, or zero for any source address
+
+  \return bool      boolean indicating if the subscription was set up
 
 ******************************************************************************/
-char * j1939decode_to_json(uint32_t id, uint8_t dlc, const uint64_t * data, bool pretty)
+bool j1939decode_ctx_subscribe(j1939decode_ctx * ctx, const uint32_t * spns, size_t num_spns,
+                               const uint8_t * sas, size_t num_sas)
 {
-    /* Fail and return NULL if database is not loaded
-     * Remember to call j1939decode_init() first! */
-    if (j1939db_json == NULL)
-    {
-        log_msg("J1939 database not loaded");
-        return NULL;
-    }
-
-    if (dlc > 8)
-    {
-        log_msg("DLC cannot be greater than 8 bytes");
-        return NULL;
-    }
+    subscription * sub = &ctx->subscription;
+    const j1939db * db = ctx->database;
+    bool * selected = NULL;
+    bool result = false;
 
-    /* JSON string to be returned */
-    char * json_string = NULL;
+    /* Payloads seen so far were compared against the SPNs of the old subscription */
+    unsubscribe(sub);
+    clear_changes(&ctx->changes);
+    clear_cache(&ctx->cache);
 
-    /* JSON object containing decoded J1939 data */
-    cJSON * json_object = cJSON_CreateObject();
-    if (json_object == NULL)
+    if (num_spns == 0)
     {
-        goto end;
+        return true;
     }
 
-    if (cJSON_AddNumberToObject(json_object, "ID", id) == NULL)
+    /* Fail and return false if database is not loaded
+     * Remember to call j1939decode_init() first! */
+    if (db == NULL)
     {
-        goto end;
+        log_msg(ctx, "J1939 database not loaded");
+        return false;
     }
 
-    if (cJSON_AddNumberToObject(json_object, "Priority", get_pri(id)) == NULL)
+    /* Subscribed SPN descriptors and the number of them in each PGN record */
+    selected = calloc(db->num_spns > 0 ? db->num_spns : 1, sizeof(bool));
+    sub->pgn_start = calloc(db->num_pgns + 1, sizeof(uint32_t));
+    if (selected == NULL || sub->pgn_start == NULL)
     {
-        goto end;
+        log_msg(ctx, "Memory allocation failure");
+        goto cleanup;
     }
 
-    if (cJSON_AddNumberToObject(json_object, "PGN", get_pgn(id)) == NULL)
+    /* Each SPN is looked up in the reverse SPN index instead of scanning the PGN records */
+    for (size_t i = 0; i < num_spns; i++)
     {
-        goto end;
-    }
+        const j1939db_spn_ref * refs;
+        size_t num_refs = j1939db_find_spn(db, spns[i], &refs);
+        if (num_refs == 0)
+        {
+            log_msg(ctx, "SPN %u not found in database", spns[i]);
+        }
 
-    if (cJSON_AddNumberToObject(json_object, "SA", get_sa(id)) == NULL)
+        for (size_t j = 0; j < num_refs; j++)
+        {
+            /* Delimited SPNs are only split out by j1939decode_to_strings(), there is nothing to decode */
+            const j1939db_pgn * record = &db->pgns[refs[j].pgn];
+            if (refs[j].spn >= record->num_spns)
+            {
+                continue;
+            }
+
+            bool * flag = &selected[record->first_spn + refs[j].spn];
+            if (!*flag)
+            {
+                *flag = true;
+                sub->pgn_start[refs[j].pgn + 1]++;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < db->num_pgns; i++)
+    {
+        sub->pgn_start[i + 1] += sub->pgn_start[i];
+    }
+
+    /* Never NULL once set up, even if no SPN was found */
+    uint32_t total = sub->pgn_start[db->num_pgns];
+    sub->spns = malloc((total > 0 ? total : 1) * sizeof(uint16_t));
+    if (sub->spns == NULL)
+    {
+        log_msg(ctx, "Memory allocation failure");
+        goto cleanup;
+    }
+
+    /* Store the subscribed SPNs of each record in record order */
+    for (size_t i = 0; i < db->num_pgns; i++)
+    {
+        const j1939db_pgn * record = &db->pgns[i];
+        uint32_t next = sub->pgn_start[i];
+
+        for (size_t j = 0; next < sub->pgn_start[i + 1]; j++)
+        {
+            if (selected[record->first_spn + j])
+            {
+                sub->spns[next++] = (uint16_t) j;
+            }
+        }
+    }
+
+    sub->all_sas = num_sas == 0;
+    for (size_t i = 0; i < num_sas; i++)
+    {
+        sub->sas[sas[i] / 8U] |= (uint8_t) (1U << (sas[i] % 8U));
+    }
+
+    sub->active = true;
+    result = true;
+
+    cleanup:
+    if (!result)
+    {
+        unsubscribe(sub);
+    }
+    free(selected);
+    return result;
+}
+
+/**************************************************************************//**
+
+  \brief Free a compiled subscription, going back to decoding every SPN
+
+  \param sub        pointer to the subscription
+
+  \return void
+
+******************************************************************************/
+void unsubscribe(subscription * sub)
+{
+    free(sub->pgn_start);
+    free(sub->spns);
+    memset(sub, 0, sizeof(subscription));
+}
+
+/**************************************************************************//**
+
+  \brief Resolve the PGN record of a message and the SPNs decoded from it
+
+  \param ctx        pointer to the decoder context
+  \param id         CAN identifier
+  \param selection  pointer to the selection to fill in, with a NULL record if the PGN is not in the database
+
+  \return bool      boolean indicating if the message passes the subscription
+
+******************************************************************************/
+bool select_spns(const j1939decode_ctx * ctx, uint32_t id, spn_selection * selection)
+{
+    const subscription * sub = &ctx->subscription;
+
+    selection->record = NULL;
+    selection->spns = NULL;
+    selection->selected = NULL;
+    selection->num_spns = 0;
+
+    if (sub->active && !sub->all_sas && (sub->sas[get_sa(id) / 8U] & (1U << (get_sa(id) % 8U))) == 0)
+    {
+        return false;
+    }
+
+    selection->record = j1939db_get_pgn(ctx->database, get_pgn(id));
+    if (selection->record == NULL)
+    {
+        return !sub->active;
+    }
+
+    selection->spns = j1939db_pgn_spns(ctx->database, selection->record);
+    selection->selected = get_subscribed_spns(ctx, selection->record, &selection->num_spns);
+
+    return selection->num_spns > 0 || !sub->active;
+}
+
+/**************************************************************************//**
+
+  \brief Get the subscribed SPNs of a PGN record
+
+  \param ctx        pointer to the decoder context
+  \param record     pointer to the PGN record
+  \param num_spns   pointer to the number of SPNs to fill in
+
+  \return const uint16_t *  indices into the SPNs of the record, or NULL if all of them are decoded
+
+******************************************************************************/
+const uint16_t * get_subscribed_spns(const j1939decode_ctx * ctx, const j1939db_pgn * record, size_t * num_spns)
+{
+    const subscription * sub = &ctx->subscription;
+    if (!sub->active)
+    {
+        *num_spns = record->num_spns;
+        return NULL;
+    }
+
+    size_t i = (size_t) (record - ctx->database->pgns);
+    *num_spns = sub->pgn_start[i + 1] - sub->pgn_start[i];
+    return &sub->spns[sub->pgn_start[i]];
+}
+
+/**************************************************************************//**
+
+  \brief Switch change detection of the default context on or off
+
+  \param enable     true to produce only what changed, false to produce every message
+  \param heartbeat  seconds of timestamp after which a message is produced in full again, zero for never
+
+  \return bool      boolean indicating if change detection was set up
+
+******************************************************************************/
+bool j1939decode_set_change_detection(bool enable, double heartbeat)
+{
+    return j1939decode_ctx_set_change_detection(&default_ctx, enable, heartbeat);
+}
+
+/**************************************************************************//**
+
+  \brief Switch change detection of a context on or off
+
+  The last DLC and payload of every (SA, PGN) pair are kept in a hash table.
+  The raw value of an SPN changed if any of its bits differ from the last payload,
+  which is found without decoding anything; unchanged messages are dropped.
+
+  \param ctx        pointer to the context
+  \param enable     true to produce only what changed, false to produce every message
+  \param heartbeat  seconds of timestamp after which a message is produced in full again, zero for never
+
+  \return bool      boolean indicating if change detection was set up
+
+******************************************************************************/
+bool j1939decode_ctx_set_change_detection(j1939decode_ctx * ctx, bool enable, double heartbeat)
+{
+    change_detection * changes = &ctx->changes;
+    const j1939db * db = ctx->database;
+
+    free_changes(changes);
+
+    if (!enable)
+    {
+        return true;
+    }
+
+    /* Fail and return false if database is not loaded
+     * Remember to call j1939decode_init() first! */
+    if (db == NULL)
+    {
+        log_msg(ctx, "J1939 database not loaded");
+        return false;
+    }
+
+    /* Room for the changed SPNs of the largest PGN record */
+    size_t max_spns = 1;
+    for (size_t i = 0; i < db->num_pgns; i++)
+    {
+        if (db->pgns[i].num_spns > max_spns)
+        {
+            max_spns = db->pgns[i].num_spns;
+        }
+    }
+
+    changes->spns = malloc(max_spns * sizeof(uint16_t));
+    changes->entries = calloc(CHANGE_TABLE_SIZE, sizeof(change_entry));
+    if (changes->spns == NULL || changes->entries == NULL)
+    {
+        log_msg(ctx, "Memory allocation failure");
+        free_changes(changes);
+        return false;
+    }
+
+    changes->size = CHANGE_TABLE_SIZE;
+    changes->heartbeat = heartbeat;
+    changes->enabled = true;
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Narrow the SPNs decoded from a message down to those that changed
+
+  The message is remembered as pending until commit_changes() is called,
+  so that output that could not be produced is not mistaken for sent.
+
+  \param ctx        pointer to the decoder context
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+  \param selection  pointer to the selection of the message, narrowed down in place
+
+  \return bool      boolean indicating if anything changed and the message is to be produced
+
+******************************************************************************/
+bool detect_changes(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                    spn_selection * selection)
+{
+    change_detection * changes = &ctx->changes;
+
+    if (!changes->enabled)
+    {
+        return true;
+    }
+
+    const change_entry * entry = find_change_entry(changes, id);
+
+    changes->pending = true;
+    changes->pending_full = true;
+    changes->pending_id = id;
+    changes->pending_dlc = dlc;
+    changes->pending_data = *data;
+
+    /* First message of the pair, a new DLC or a heartbeat produces everything */
+    if (entry->key == 0 || entry->dlc != dlc ||
+        (changes->heartbeat > 0 && ctx->has_timestamp && ctx->timestamp - entry->full_timestamp >= changes->heartbeat))
+    {
+        return true;
+    }
+
+    /* Bytes past the DLC are not part of the message, whatever they hold */
+    uint64_t diff = j1939db_payload(entry->data ^ *data, dlc);
+
+    /* Nothing to narrow down without SPNs, the whole payload is compared */
+    if (selection->num_spns == 0)
+    {
+        changes->pending = diff != 0;
+        return changes->pending;
+    }
+
+    size_t num_changed = 0;
+    for (size_t i = 0; i < selection->num_spns; i++)
+    {
+        uint16_t index = selection->selected != NULL ? selection->selected[i] : (uint16_t) i;
+        const j1939db_spn * plan = &selection->spns[index];
+
+        if (j1939db_extract(plan, diff) != 0)
+        {
+            changes->spns[num_changed++] = index;
+        }
+    }
+
+    if (num_changed == 0)
+    {
+        changes->pending = false;
+        return false;
+    }
+
+    changes->pending_full = num_changed == selection->num_spns;
+    selection->selected = changes->spns;
+    selection->num_spns = num_changed;
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Store the pending message once its output has been produced
+
+  \param ctx        pointer to the decoder context
+
+  \return void
+
+******************************************************************************/
+void commit_changes(j1939decode_ctx * ctx)
+{
+    change_detection * changes = &ctx->changes;
+
+    if (!changes->pending)
+    {
+        return;
+    }
+    changes->pending = false;
+
+    change_entry * entry = find_change_entry(changes, changes->pending_id);
+    if (entry->key == 0)
+    {
+        /* Kept at most half full so that probing stays short */
+        if (2U * (changes->count + 1U) > changes->size)
+        {
+            if (!grow_changes(changes))
+            {
+                log_msg(ctx, "Memory allocation failure");
+                return;
+            }
+            entry = find_change_entry(changes, changes->pending_id);
+        }
+
+        entry->key = (changes->pending_id & 0x03FFFFFFU) + 1U;
+        entry->full_timestamp = 0;
+        changes->count++;
+    }
+
+    entry->dlc = changes->pending_dlc;
+    entry->data = changes->pending_data;
+    if (changes->pending_full && ctx->has_timestamp)
+    {
+        entry->full_timestamp = ctx->timestamp;
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Find the change detection entry of a message with linear probing
+
+  \param changes    pointer to the change detection state
+  \param id         CAN identifier, the priority is ignored
+
+  \return change_entry *    pointer to the entry of the pair, or to the empty slot it goes into
+
+******************************************************************************/
+change_entry * find_change_entry(const change_detection * changes, uint32_t id)
+{
+    uint32_t key = (id & 0x03FFFFFFU) + 1U;
+    size_t slot = (size_t) ((key * UINT64_C(0x9E3779B97F4A7C15)) >> 32U) & (changes->size - 1);
+
+    while (changes->entries[slot].key != 0 && changes->entries[slot].key != key)
+    {
+        slot = (slot + 1) & (changes->size - 1);
+    }
+
+    return &changes->entries[slot];
+}
+
+/**************************************************************************//**
+
+  \brief Double the size of the change detection table
+
+  \param changes    pointer to the change detection state
+
+  \return bool      boolean indicating if the table was grown, it is left untouched otherwise
+
+******************************************************************************/
+bool grow_changes(change_detection * changes)
+{
+    change_detection grown = *changes;
+
+    grown.size = 2U * changes->size;
+    grown.entries = calloc(grown.size, sizeof(change_entry));
+    if (grown.entries == NULL)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < changes->size; i++)
+    {
+        if (changes->entries[i].key != 0)
+        {
+            *find_change_entry(&grown, changes->entries[i].key - 1U) = changes->entries[i];
+        }
+    }
+
+    free(changes->entries);
+    changes->entries = grown.entries;
+    changes->size = grown.size;
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Forget every message seen by change detection
+
+  \param changes    pointer to the change detection state
+
+  \return void
+
+******************************************************************************/
+void clear_changes(change_detection * changes)
+{
+    if (changes->entries != NULL)
+    {
+        memset(changes->entries, 0, changes->size * sizeof(change_entry));
+    }
+    changes->count = 0;
+    changes->pending = false;
+}
+
+/**************************************************************************//**
+
+  \brief Free change detection state, going back to producing every message
+
+  \param changes    pointer to the change detection state
+
+  \return void
+
+******************************************************************************/
+void free_changes(change_detection * changes)
+{
+    free(changes->entries);
+    free(changes->spns);
+    memset(changes, 0, sizeof(change_detection));
+}
+
+/**************************************************************************//**
+
+  \brief Set up the output cache of the default context
+
+  \param entries    number of messages whose output is cached, zero to remove the cache
+
+  \return bool      boolean indicating if the cache was set up
+
+******************************************************************************/
+bool j1939decode_set_cache(size_t entries)
+{
+    return j1939decode_ctx_set_cache(&default_ctx, entries);
+}
+
+/**************************************************************************//**
+
+  \brief Set up the output cache of a context
+
+  \param ctx        pointer to the context
+  \param entries    number of messages whose output is cached, zero to remove the cache
+
+  \return bool      boolean indicating if the cache was set up
+
+******************************************************************************/
+bool j1939decode_ctx_set_cache(j1939decode_ctx * ctx, size_t entries)
+{
+    output_cache * cache = &ctx->cache;
+
+    free_cache(cache);
+
+    if (entries == 0)
+    {
+        return true;
+    }
+
+    /* Entry numbers plus one have to fit in the index */
+    if (entries >= UINT32_MAX)
+    {
+        log_msg(ctx, "Output cache of %zu entries is too large", entries);
+        return false;
+    }
+
+    size_t num_slots = 1;
+    while (num_slots < CACHE_SLOTS_PER_ENTRY * entries)
+    {
+        num_slots *= 2U;
+    }
+
+    cache->entries = calloc(entries, sizeof(cache_entry));
+    cache->slots = calloc(num_slots, sizeof(uint32_t));
+    if (cache->entries == NULL || cache->slots == NULL)
+    {
+        log_msg(ctx, "Memory allocation failure");
+        free_cache(cache);
+        return false;
+    }
+
+    cache->size = entries;
+    cache->num_slots = num_slots;
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Get output cache statistics of the default context
+
+  \param stats      pointer to the statistics to fill in
+
+  \return void
+
+******************************************************************************/
+void j1939decode_get_cache_stats(j1939decode_cache_stats * stats)
+{
+    j1939decode_ctx_get_cache_stats(&default_ctx, stats);
+}
+
+/**************************************************************************//**
+
+  \brief Get output cache statistics of a context
+
+  \param ctx        pointer to the context
+  \param stats      pointer to the statistics to fill in
+
+  \return void
+
+******************************************************************************/
+void j1939decode_ctx_get_cache_stats(const j1939decode_ctx * ctx, j1939decode_cache_stats * stats)
+{
+    stats->hits = ctx->cache.hits;
+    stats->misses = ctx->cache.misses;
+    stats->entries = ctx->cache.count;
+}
+
+/**************************************************************************//**
+
+  \brief Write unformatted JSON for j1939 decoded data, through the output cache if possible
+
+  \param ctx        pointer to the decoder context
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+  \param selection  pointer to the PGN record and SPNs to decode
+  \param buffer     pointer to the output buffer, may be NULL if size is zero
+  \param size       size of the output buffer in bytes
+
+  \return size_t    length of the complete JSON string
+
+******************************************************************************/
+size_t render_json(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                   const spn_selection * selection, char * buffer, size_t size)
+{
+    output_cache * cache = &ctx->cache;
+
+    if (!use_cache(ctx))
+    {
+        return write_json(ctx, id, dlc, data, selection, buffer, size);
+    }
+
+    size_t hash = hash_message(id, dlc, data);
+    for (size_t slot = hash & (cache->num_slots - 1); cache->slots[slot] != 0; slot = (slot + 1) & (cache->num_slots - 1))
+    {
+        cache_entry * entry = &cache->entries[cache->slots[slot] - 1];
+        if (entry->hash != hash || entry->id != id || entry->dlc != dlc || entry->data != *data)
+        {
+            continue;
+        }
+
+        /* Same truncation as the JSON writer */
+        if (size > 0)
+        {
+            size_t length = entry->length < size ? entry->length : size - 1;
+            memcpy(buffer, entry->text, length);
+            buffer[length] = '\0';
+        }
+
+        entry->referenced = true;
+        cache->hits++;
+        return entry->length;
+    }
+
+    cache->misses++;
+
+    /* Output that did not fit is stored once it is written again into a larger buffer */
+    size_t length = write_json(ctx, id, dlc, data, selection, buffer, size);
+    if (length < size)
+    {
+        store_output(ctx, id, dlc, data, buffer, length);
+    }
+
+    return length;
+}
+
+/**************************************************************************//**
+
+  \brief Check if the output of a context only depends on the message
+
+  \param ctx        pointer to the decoder context
+
+  \return bool      boolean indicating if the output cache is set up and can be used
+
+******************************************************************************/
+bool use_cache(const j1939decode_ctx * ctx)
+{
+    return ctx->cache.size > 0 && !ctx->changes.enabled &&
+           !(ctx->profile == J1939DECODE_PROFILE_VALUES && ctx->has_timestamp);
+}
+
+/**************************************************************************//**
+
+  \brief Hash the CAN identifier, DLC and payload of a message
+
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+
+  \return size_t    hash value
+
+******************************************************************************/
+size_t hash_message(uint32_t id, uint8_t dlc, const uint64_t * data)
+{
+    uint64_t hash = (*data ^ (((uint64_t) dlc << 32U) | id)) * UINT64_C(0x9E3779B97F4A7C15);
+    hash ^= hash >> 32U;
+    hash *= UINT64_C(0xBF58476D1CE4E5B9);
+    hash ^= hash >> 29U;
+
+    return (size_t) hash;
+}
+
+/**************************************************************************//**
+
+  \brief Store the output of a message in the output cache
+
+  Until the cache is full every message gets a new entry. After that the clock
+  hand sweeps the entries, giving each entry hit since it was last passed a
+  second chance, and the first entry not hit is replaced.
+
+  \param ctx        pointer to the decoder context
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+  \param text       pointer to the unformatted JSON output
+  \param length     length of the output
+
+  \return void
+
+******************************************************************************/
+void store_output(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                  const char * text, size_t length)
+{
+    output_cache * cache = &ctx->cache;
+    size_t victim;
+
+    if (cache->count < cache->size)
+    {
+        victim = cache->count;
+    }
+    else
+    {
+        while (cache->entries[cache->hand].referenced)
+        {
+            cache->entries[cache->hand].referenced = false;
+            cache->hand = (cache->hand + 1) % cache->size;
+        }
+        victim = cache->hand;
+        cache->hand = (cache->hand + 1) % cache->size;
+    }
+
+    cache_entry * entry = &cache->entries[victim];
+
+    /* The entry keeps its old output if its buffer cannot grow */
+    if (entry->capacity < length)
+    {
+        char * text_buffer = realloc(entry->text, length);
+        if (text_buffer == NULL)
+        {
+            log_msg(ctx, "Memory allocation failure");
+            return;
+        }
+        entry->text = text_buffer;
+        entry->capacity = length;
+    }
+
+    if (victim < cache->count)
+    {
+        remove_cache_slot(cache, victim);
+    }
+    else
+    {
+        cache->count++;
+    }
+
+    entry->id = id;
+    entry->dlc = dlc;
+    entry->data = *data;
+    entry->hash = hash_message(id, dlc, data);
+    entry->referenced = false;
+    entry->length = length;
+    memcpy(entry->text, text, length);
+
+    size_t slot = entry->hash & (cache->num_slots - 1);
+    while (cache->slots[slot] != 0)
+    {
+        slot = (slot + 1) & (cache->num_slots - 1);
+    }
+    cache->slots[slot] = (uint32_t) (victim + 1);
+}
+
+/**************************************************************************//**
+
+  \brief Remove an entry from the output cache index
+
+  Entries further along the probe sequence are shifted back into the gap,
+  so lookups never need tombstones.
+
+  \param cache      pointer to the output cache
+  \param entry      number of the entry to remove
+
+  \return void
+
+******************************************************************************/
+void remove_cache_slot(output_cache * cache, size_t entry)
+{
+    const size_t mask = cache->num_slots - 1;
+
+    size_t gap = cache->entries[entry].hash & mask;
+    while (cache->slots[gap] != entry + 1)
+    {
+        gap = (gap + 1) & mask;
+    }
+
+    for (size_t slot = (gap + 1) & mask; cache->slots[slot] != 0; slot = (slot + 1) & mask)
+    {
+        /* An entry can move back into the gap if its home slot is not between the gap and where it is */
+        size_t home = cache->entries[cache->slots[slot] - 1].hash & mask;
+        if (((slot - home) & mask) >= ((slot - gap) & mask))
+        {
+            cache->slots[gap] = cache->slots[slot];
+            gap = slot;
+        }
+    }
+
+    cache->slots[gap] = 0;
+}
+
+/**************************************************************************//**
+
+  \brief Empty the output cache, keeping the entry buffers for reuse
+
+  \param cache      pointer to the output cache
+
+  \return void
+
+******************************************************************************/
+void clear_cache(output_cache * cache)
+{
+    if (cache->slots != NULL)
+    {
+        memset(cache->slots, 0, cache->num_slots * sizeof(uint32_t));
+    }
+    cache->count = 0;
+    cache->hand = 0;
+}
+
+/**************************************************************************//**
+
+  \brief Free the output cache, going back to rendering every message
+
+  \param cache      pointer to the output cache
+
+  \return void
+
+******************************************************************************/
+void free_cache(output_cache * cache)
+{
+    for (size_t i = 0; i < cache->size; i++)
+    {
+        free(cache->entries[i].text);
+    }
+    free(cache->entries);
+    free(cache->slots);
+    memset(cache, 0, sizeof(output_cache));
+}
+
+/**************************************************************************//**
+
+  \brief Switch a context to the thread-safe JSON mode with its own output arena
+
+  The cJSON allocator hooks, installed once by the first context to set up
+  an arena, route allocations made by j1939decode_ctx_to_json() to the arena
+  of the calling thread's context. Processes that never use an arena keep
+  the cJSON hooks they had.
+  The arena grows to fit the largest message seen, after which no heap
+  allocations are made at all. Any other thread keeps using the heap.
+
+  \param ctx    pointer to the context
+  \param size   initial arena size in bytes, or zero to free the arena and leave the mode
+
+  \return bool  boolean indicating if the arena was set up
+
+******************************************************************************/
+bool j1939decode_ctx_set_arena(j1939decode_ctx * ctx, size_t size)
+{
+    arena_release(&ctx->arena);
+    if (size == 0)
+    {
+        return true;
+    }
+
+    size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+    ctx->arena.base = malloc(size);
+    if (ctx->arena.base == NULL)
+    {
+        log_msg(ctx, "Memory allocation failure");
+        return false;
+    }
+    ctx->arena.size = size;
+
+    install_hooks();
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Install the cJSON allocator hooks, exactly once however many threads call it
+
+  The hooks use the heap in every thread without an arena, so contexts
+  that never set up an arena are unaffected once they are installed.
+
+  \return void
+
+******************************************************************************/
+void install_hooks(void)
+{
+#if defined(_WIN32)
+    InitOnceExecuteOnce(&hooks_once, init_hooks, NULL, NULL);
+#else
+    pthread_once(&hooks_once, init_hooks);
+#endif
+}
+
+/**************************************************************************//**
+
+  \brief Run once by install_hooks() to route cJSON allocations through the arena hooks
+
+  \return void
+
+******************************************************************************/
+#if defined(_WIN32)
+BOOL CALLBACK init_hooks(PINIT_ONCE once, PVOID parameter, PVOID * context)
+{
+    (void) once;
+    (void) parameter;
+    (void) context;
+
+    cJSON_Hooks hooks = {arena_malloc_hook, arena_free_hook};
+    cJSON_InitHooks(&hooks);
+    return TRUE;
+}
+#else
+void init_hooks(void)
+{
+    cJSON_Hooks hooks = {arena_malloc_hook, arena_free_hook};
+    cJSON_InitHooks(&hooks);
+}
+#endif
+
+/**************************************************************************//**
+
+  \brief Allocate memory from an arena, falling back to the heap once it is full
+
+  \param a      pointer to the arena
+  \param size   number of bytes to allocate
+
+  \return void * pointer to the allocated memory, or NULL on failure
+
+******************************************************************************/
+void * arena_alloc(arena * a, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+    a->requested += size;
+
+    if (size <= a->size - a->used)
+    {
+        void * ptr = a->base + a->used;
+        a->used += size;
+        return ptr;
+    }
+
+    /* Keep overflow blocks until the next reset, the arena is grown then */
+    arena_block * block = malloc(ARENA_ALIGN + size);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    block->next = a->overflow;
+    a->overflow = block;
+
+    return (char *) block + ARENA_ALIGN;
+}
+
+/**************************************************************************//**
+
+  \brief Release everything allocated from an arena since the last reset
+
+  \param a      pointer to the arena
+
+  \return void
+
+******************************************************************************/
+void arena_reset(arena * a)
+{
+    if (a->overflow != NULL)
+    {
+        while (a->overflow != NULL)
+        {
+            arena_block * next = a->overflow->next;
+            free(a->overflow);
+            a->overflow = next;
+        }
+
+        /* Grow to fit everything requested last time, keeping the old arena if that fails */
+        char * base = realloc(a->base, a->requested);
+        if (base != NULL)
+        {
+            a->base = base;
+            a->size = a->requested;
+        }
+    }
+
+    a->used = 0;
+    a->requested = 0;
+}
+
+/**************************************************************************//**
+
+  \brief Free an arena and all of its memory
+
+  \param a      pointer to the arena
+
+  \return void
+
+******************************************************************************/
+void arena_release(arena * a)
+{
+    arena_reset(a);
+    free(a->base);
+    memset(a, 0, sizeof(arena));
+}
+
+/**************************************************************************//**
+
+  \brief cJSON allocation hook
+
+  \param size   number of bytes to allocate
+
+  \return void * pointer to memory from the calling thread's arena, or the heap
+
+******************************************************************************/
+void * CJSON_CDECL arena_malloc_hook(size_t size)
+{
+    return current_arena ? arena_alloc(current_arena, size) : malloc(size);
+}
+
+/**************************************************************************//**
+
+  \brief cJSON free hook
+
+  \param ptr    pointer to the memory to free
+
+  \return void
+
+******************************************************************************/
+void CJSON_CDECL arena_free_hook(void * ptr)
+{
+    /* Arena memory is only released all at once by arena_reset() */
+    if (current_arena == NULL)
+    {
+        free(ptr);
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Split 64 bit number into JSON array object of bytes
+
+  \param data     pointer to data (8 bytes total)
+
+  \return cJSON * pointer to the JSON array object
+
+******************************************************************************/
+cJSON * create_byte_array(const uint64_t * data)
+{
+    cJSON * array = cJSON_CreateArray();
+    if (array == NULL)
+    {
+        goto cleanup;
+    }
+
+    for (uint32_t i = 0; i < sizeof(data); i++)
+    {
+        /* Cast to uint8 pointer and then index */
+        cJSON * num = cJSON_CreateNumber(((uint8_t *) data)[i]);
+        if (num == NULL)
+        {
+            goto cleanup;
+        }
+        cJSON_AddItemToArray(array, num);
+    }
+
+    return array;
+
+    cleanup:
+    cJSON_Delete(array);
+    return NULL;
+}
+
+/**************************************************************************//**
+
+  \brief Decode SPN value using its compiled descriptor
+
+  Bytes beyond the DLC read as zero, and an SPN that does not fit in the DLC is never valid and has no state.
+
+  \param db         pointer to the database holding the descriptor
+  \param infos      SPN metadata of the database from j1939db_spn_infos(), NULL to leave the value without
+  \param plan       pointer to the compiled SPN decode descriptor
+  \param data       pointer to data (8 bytes total)
+  \param dlc        data length code, at most 8
+  \param value      pointer to the decoded SPN value to fill in
+
+  \return void
+
+******************************************************************************/
+void decode_spn(const j1939db * db, const j1939decode_spn_info * infos, const j1939db_spn * plan,
+                const uint64_t * data, uint8_t dlc, j1939decode_spn_value * value)
+{
+    value->spn = plan->spn;
+    value->value_raw = j1939db_extract(plan, j1939db_payload(*data, dlc));
+    value->value_decoded = value->value_raw * plan->resolution + plan->offset;
+
+    /* Check that decoded value is within operational range and was actually sent */
+    bool sent = plan->num_bytes <= dlc;
+    value->valid = value->value_decoded >= plan->operational_low &&
+                   value->value_decoded <= plan->operational_high && sent;
+
+    /* The zeros read for an SPN that was not sent are no state either */
+    value->state = sent ? j1939db_state(db, plan, value->value_raw) : NULL;
+    value->info = infos != NULL ? &infos[plan - db->spns] : NULL;
+}
+
+/**************************************************************************//**
+
+  \brief Decode SPN value from the bytes it spans in a payload of any length
+
+  Bytes beyond the payload read as zero, and an SPN that does not fit in the payload is never valid
+  and has no state.
+
+  \param db         pointer to the database holding the descriptor
+  \param infos      SPN metadata of the database from j1939db_spn_infos()
+  \param plan       pointer to the compiled SPN decode descriptor
+  \param payload    pointer to the payload
+  \param length     length of the payload in bytes
+  \param value      pointer to the decoded SPN value to fill in
+
+  \return void
+
+******************************************************************************/
+void decode_spn_bytes(const j1939db * db, const j1939decode_spn_info * infos, const j1939db_spn * plan,
+                      const uint8_t * payload, size_t length, j1939decode_spn_value * value)
+{
+    value->spn = plan->spn;
+    value->value_raw = j1939db_extract_bytes(plan, payload, length);
+    value->value_decoded = value->value_raw * plan->resolution + plan->offset;
+
+    /* num_bytes saturates, so work out the bytes spanned from the metadata */
+    bool sent = ((uint64_t) plan->start_bit + plan->length + 7U) / 8U <= length;
+    value->valid = value->value_decoded >= plan->operational_low &&
+                   value->value_decoded <= plan->operational_high && sent;
+
+    value->state = sent ? j1939db_state(db, plan, value->value_raw) : NULL;
+    value->info = &infos[plan - db->spns];
+}
+
+/**************************************************************************//**
+
+  \brief Build suspect parameter number JSON object from decoded SPN value
+
+  \param db         pointer to the database holding the descriptor
+  \param plan       pointer to the compiled SPN decode descriptor
+  \param value      pointer to the decoded SPN value
+  \param fields     mask of J1939DECODE_FIELD_* bits selecting the SPN fields
+
+  \return cJSON *   pointer to the SPN data JSON object
+
+******************************************************************************/
+cJSON * extract_spn_data(const j1939db * db, const j1939db_spn * plan, const j1939decode_spn_value * value,
+                         uint32_t fields)
+{
+    /* JSON object for specific SPN data
+     * Database fields come first, in the alphabetical order used by the J1939 database file */
+    const char * data_range = j1939db_string(db, plan->data_range);
+    const char * name = j1939db_string(db, plan->name);
+    const char * operational_range = j1939db_string(db, plan->operational_range);
+    const char * units = j1939db_string(db, plan->units);
+    cJSON * spn_data = cJSON_CreateObject();
+    if (spn_data == NULL)
+    {
+        goto cleanup;
+    }
+
+    /* TODO: Use PascalCase or snake_case for JSON key names?
+     * Existing J1939 lookup table uses PascalCase but snake_case may be more appropriate */
+
+    if ((fields & J1939DECODE_FIELD_SPN_DATA_RANGE) && data_range != NULL &&
+        cJSON_AddStringToObject(spn_data, "DataRange", data_range) == NULL)
+    {
+        goto cleanup;
+    }
+
+    if ((fields & J1939DECODE_FIELD_SPN_NAME) && name != NULL &&
+        cJSON_AddStringToObject(spn_data, "Name", name) == NULL)
+    {
+        goto cleanup;
+    }
+
+    if ((fields & J1939DECODE_FIELD_SPN_OFFSET) && cJSON_AddNumberToObject(spn_data, "Offset", plan->offset) == NULL)
+    {
+        goto cleanup;
+    }
+
+    if ((fields & J1939DECODE_FIELD_SPN_OPERATIONAL_HIGH) &&
+        cJSON_AddNumberToObject(spn_data, "OperationalHigh", plan->operational_high) == NULL)
+    {
+        goto cleanup;
+    }
+
+    if ((fields & J1939DECODE_FIELD_SPN_OPERATIONAL_LOW) &&
+        cJSON_AddNumberToObject(spn_data, "OperationalLow", plan->operational_low) == NULL)
+    {
+        goto cleanup;
+    }
+
+    if ((fields & J1939DECODE_FIELD_SPN_OPERATIONAL_RANGE) && operational_range != NULL &&
+        cJSON_AddStringToObject(spn_data, "OperationalRange", operational_range) == NULL)
+    {
+        goto cleanup;
+    }
+
+    if ((fields & J1939DECODE_FIELD_SPN_RESOLUTION) &&
+        cJSON_AddNumberToObject(spn_data, "Resolution", plan->resolution) == NULL)
+    {
+        goto cleanup;
+    }
+
+    if ((fields & J1939DECODE_FIELD_SPN_LENGTH) && cJSON_AddNumberToObject(spn_data, "SPNLength", plan->length) == NULL)
+    {
+        goto cleanup;
+    }
+
+    if ((fields & J1939DECODE_FIELD_SPN_UNITS) && units != NULL &&
+        cJSON_AddStringToObject(spn_data, "Units", units) == NULL)
+    {
+        goto cleanup;
+    }
+
+    if ((fields & J1939DECODE_FIELD_SPN_START_BIT) &&
+        cJSON_AddNumberToObject(spn_data, "StartBit", plan->start_bit) == NULL)
+    {
+        goto cleanup;
+    }
+
+    if ((fields & J1939DECODE_FIELD_SPN_VALUE_RAW) &&
+        cJSON_AddNumberToObject(spn_data, "ValueRaw", value->value_raw) == NULL)
+    {
+        goto cleanup;
+    }
+
+    if (fields & J1939DECODE_FIELD_SPN_VALUE_DECODED)
+    {
+        /* Decoded value is invalid or not available if outside of operation range
+         * Use the "Valid" boolean key when checking if decoded data is valid or not */
+        cJSON * decoded = value->valid ? cJSON_AddNumberToObject(spn_data, "ValueDecoded", value->value_decoded)
+                                       : cJSON_AddStringToObject(spn_data, "ValueDecoded", "Not available");
+        if (decoded == NULL)
+        {
+            goto cleanup;
+        }
+    }
+
+    if ((fields & J1939DECODE_FIELD_SPN_VALUE_STATE) && value->state != NULL &&
+        cJSON_AddStringToObject(spn_data, "ValueState", value->state) == NULL)
+    {
+        goto cleanup;
+    }
+
+    if ((fields & J1939DECODE_FIELD_SPN_VALID) && cJSON_AddBoolToObject(spn_data, "Valid", value->valid) == NULL)
+    {
+        goto cleanup;
+    }
+
+    return spn_data;
+
+    cleanup:
+    cJSON_Delete(spn_data);
+    /* Do not return the freed cJSON pointer to avoid use-after-free flaw
+     * cJSON_Delete() does not set the freed pointer to NULL */
+    return NULL;
+}
+
+/**************************************************************************//**
+
+  \brief Get source address name
+
+  \param ctx     pointer to the decoder context
+  \param sa      source address number
+
+  \return char * pointer to the source address name string
+
+******************************************************************************/
+char * get_sa_name(const j1939decode_ctx * ctx, uint8_t sa)
+{
+    char * sa_name = (char *) j1939db_sa_name(ctx->database, sa);
+    if (sa_name == NULL)
+    {
+        sa_name = "Unknown";
+        log_msg(ctx, "No source address name found in database for source address %d", sa);
+    }
+
+    return sa_name;
+}
+
+/**************************************************************************//**
+
+  \brief Get parameter group number name
+
+  \param ctx     pointer to the decoder context
+  \param pgn     parameter group number
+
+  \return char * pointer to the PGN name string
+
+******************************************************************************/
+char * get_pgn_name(const j1939decode_ctx * ctx, uint32_t pgn)
+{
+    const j1939db_pgn * record = j1939db_get_pgn(ctx->database, pgn);
+    char * pgn_name = record ? (char *) j1939db_string(ctx->database, record->name) : NULL;
+    if (pgn_name == NULL)
+    {
+        pgn_name = "Unknown";
+        log_msg(ctx, "No PGN name found in database for PGN %d", pgn);
+    }
+
+    return pgn_name;
+}
+
+/**************************************************************************//**
+
+  \brief Build JSON string for j1939 decoded data using the default context
+
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+  \param pretty     pretty print returned JSON string
+
+  \return char *    pointer to the JSON string
+
+******************************************************************************/
+char * j1939decode_to_json(uint32_t id, uint8_t dlc, const uint64_t * data, bool pretty)
+{
+    return j1939decode_ctx_to_json(&default_ctx, id, dlc, data, pretty);
+}
+
+/**************************************************************************//**
+
+  \brief Build JSON string for j1939 decoded data
+
+  \param ctx        pointer to the decoder context
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+  \param pretty     pretty print returned JSON string
+
+  \return char *    pointer to the JSON string
+
+******************************************************************************/
+char * j1939decode_ctx_to_json(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data, bool pretty)
+{
+    /* Fail and return NULL if database is not loaded
+     * Remember to call j1939decode_init() first! */
+    if (ctx->database == NULL)
+    {
+        log_msg(ctx, "J1939 database not loaded");
+        return NULL;
+    }
+
+    if (dlc > 8)
+    {
+        log_msg(ctx, "DLC cannot be greater than 8 bytes");
+        return NULL;
+    }
+
+    /* Messages filtered out by the subscription or left unchanged are dropped without building anything */
+    spn_selection selection;
+    if (!select_spns(ctx, id, &selection) || !detect_changes(ctx, id, dlc, data, &selection))
+    {
+        return NULL;
+    }
+
+    /* JSON string to be returned */
+    char * json_string = NULL;
+
+    /* Unformatted output skips the cJSON tree altogether, the values profile is never pretty printed */
+    if (!pretty || ctx->profile != J1939DECODE_PROFILE_FULL)
+    {
+        json_string = print_json(ctx, id, dlc, data, &selection);
+        if (json_string != NULL)
+        {
+            commit_changes(ctx);
+        }
+        return json_string;
+    }
+
+    /* In the thread-safe mode the tree and string are built in the context's arena,
+     * which still holds the string returned by the previous call until now */
+    if (ctx->arena.base != NULL)
+    {
+        arena_reset(&ctx->arena);
+        current_arena = &ctx->arena;
+    }
+
+    /* JSON object containing decoded J1939 data */
+    cJSON * json_object = cJSON_CreateObject();
+    if (json_object == NULL)
+    {
+        goto end;
+    }
+
+    const uint32_t fields = ctx->fields.mask;
+
+    if ((fields & J1939DECODE_FIELD_ID) && cJSON_AddNumberToObject(json_object, "ID", id) == NULL)
+    {
+        goto end;
+    }
+
+    if ((fields & J1939DECODE_FIELD_PRIORITY) && cJSON_AddNumberToObject(json_object, "Priority", get_pri(id)) == NULL)
+    {
+        goto end;
+    }
+
+    if ((fields & J1939DECODE_FIELD_PGN) && cJSON_AddNumberToObject(json_object, "PGN", get_pgn(id)) == NULL)
+    {
+        goto end;
+    }
+
+    if ((fields & J1939DECODE_FIELD_DA) && cJSON_AddNumberToObject(json_object, "DA", get_da(id)) == NULL)
+    {
+        goto end;
+    }
+
+    if ((fields & J1939DECODE_FIELD_SA) && cJSON_AddNumberToObject(json_object, "SA", get_sa(id)) == NULL)
+    {
+        goto end;
+    }
+
+    if ((fields & J1939DECODE_FIELD_SA_NAME) &&
+        cJSON_AddStringToObject(json_object, "SAName", get_sa_name(ctx, get_sa(id))) == NULL)
+    {
+        goto end;
+    }
+
+    if ((fields & J1939DECODE_FIELD_DLC) && cJSON_AddNumberToObject(json_object, "DLC", dlc) == NULL)
+    {
+        goto end;
+    }
+
+    /* Add raw data bytes to JSON object */
+    if (fields & J1939DECODE_FIELD_DATA_RAW)
+    {
+        cJSON_AddItemToObject(json_object, "DataRaw", create_byte_array(data));
+    }
+
+    /* Pre-resolved record for specific PGN data */
+    const j1939db_pgn * record = selection.record;
+
+    /* Decoded flag default to false until set otherwise */
+    cJSON_bool decoded_flag = false;
+
+    if (record != NULL)
+    {
+        /* PGN number found in lookup table */
+
+        if ((fields & J1939DECODE_FIELD_PGN_NAME) &&
+            cJSON_AddStringToObject(json_object, "PGNName", get_pgn_name(ctx, get_pgn(id))) == NULL)
+        {
+            goto end;
+        }
+
+        /* At least one SPN found in database and actually decoded
+         *
+         * TODO: What criteria should be used to determine if the message should be flagged as "decoded" or not?
+         * 1. If PGN data found in database?
+         * 2. If at least one SPN found in database for PGN?
+         * 3. If at least one SPN, with start bits, found in database for PGN?
+         * 4. If at least one SPN actually decoded?
+         * Using #4 criteria for now, every SPN in a compiled plan is decoded */
+        decoded_flag = selection.num_spns > 0;
+
+        if (fields & J1939DECODE_FIELD_SPNS)
+        {
+            /* JSON object containing list of decoded SPN data */
+            cJSON * spn_object = cJSON_CreateObject();
+            if (spn_object == NULL)
+            {
+                goto end;
+            }
+
+            /* Decode every selected SPN in the compiled plan for this PGN */
+            for (size_t i = 0; i < selection.num_spns; i++)
+            {
+                const j1939db_spn * plan = get_spn(&selection, i);
+                j1939decode_spn_value value;
+
+                decode_spn(ctx->database, NULL, plan, data, dlc, &value);
+
+                /* Add SPN data object to SPN list object using SPN number as a key */
+                cJSON_AddItemToObject(spn_object, plan->key, extract_spn_data(ctx->database, plan, &value, fields));
+            }
+
+            /* Add SPN list object to the main JSON object */
+            cJSON_AddItemToObject(json_object, "SPNs", spn_object);
+        }
+    }
+    else
+    {
+        /* TODO: This print may happen too often when trying to decode non-J1939 data */
+        /* log_msg(ctx, "PGN %d not found in database", get_pgn(id)); */
+    }
+
+    if ((fields & J1939DECODE_FIELD_DECODED) && cJSON_AddBoolToObject(json_object, "Decoded", decoded_flag) == NULL)
+    {
+        goto end;
+    }
+
+    /* Print the JSON string
+     * Memory will be allocated so remember to free it when you are done with it! */
+    json_string = cJSON_Print(json_object);
+    if (json_string == NULL)
+    {
+        log_msg(ctx, "Failed to print JSON string");
+    }
+    else
+    {
+        commit_changes(ctx);
+    }
+
+    end:
+    if (current_arena == NULL)
+    {
+        cJSON_Delete(json_object);
+    }
+    /* Arena memory is reclaimed by the next call instead of walking the tree to free it */
+    current_arena = NULL;
+    return json_string;
+}
+
+/**************************************************************************//**
+
+  \brief Write unformatted JSON string for j1939 decoded data into a buffer using the default context
+
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+  \param buffer     pointer to the output buffer, may be NULL if size is zero
+  \param size       size of the output buffer in bytes
+
+  \return size_t    length of the complete JSON string, or zero on failure
+
+******************************************************************************/
+size_t j1939decode_to_json_buffer(uint32_t id, uint8_t dlc, const uint64_t * data, char * buffer, size_t size)
+{
+    return j1939decode_ctx_to_json_buffer(&default_ctx, id, dlc, data, buffer, size);
+}
+
+/**************************************************************************//**
+
+  \brief Write unformatted JSON string for j1939 decoded data into a buffer
+
+  The output is identical to the unformatted j1939decode_ctx_to_json() string.
+  Like snprintf(), at most size - 1 characters are written followed by a terminator,
+  and the length of the complete string is returned even if it did not fit.
+
+  \param ctx        pointer to the decoder context
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+  \param buffer     pointer to the output buffer, may be NULL if size is zero
+  \param size       size of the output buffer in bytes
+
+  \return size_t    length of the complete JSON string, or zero on failure
+
+******************************************************************************/
+size_t j1939decode_ctx_to_json_buffer(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                                      char * buffer, size_t size)
+{
+    /* Fail and return zero if database is not loaded
+     * Remember to call j1939decode_init() first! */
+    if (ctx->database == NULL)
+    {
+        log_msg(ctx, "J1939 database not loaded");
+        return 0;
+    }
+
+    if (dlc > 8)
+    {
+        log_msg(ctx, "DLC cannot be greater than 8 bytes");
+        return 0;
+    }
+
+    spn_selection selection;
+    if (!select_spns(ctx, id, &selection) || !detect_changes(ctx, id, dlc, data, &selection))
+    {
+        return 0;
+    }
+
+    /* Output that did not fit is produced again by the next call */
+    size_t length = render_json(ctx, id, dlc, data, &selection, buffer, size);
+    if (length > 0 && length < size)
+    {
+        commit_changes(ctx);
+    }
+
+    return length;
+}
+
+/**************************************************************************//**
+
+  \brief Print unformatted JSON string through the context's scratch buffer
+
+  \param ctx        pointer to the decoder context
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+  \param selection  pointer to the PGN record and SPNs to decode
+
+  \return char *    pointer to the JSON string
+
+******************************************************************************/
+char * print_json(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                  const spn_selection * selection)
+{
+    uint64_t misses = ctx->cache.misses;
+    size_t length = render_json(ctx, id, dlc, data, selection, ctx->json, ctx->json_size);
+    if (length >= ctx->json_size)
+    {
+        /* Grow the scratch buffer to fit and write again, this only happens a few times per context */
+        size_t size = length + 1 > JSON_BUFFER_SIZE ? length + 1 : JSON_BUFFER_SIZE;
+        char * json = realloc(ctx->json, size);
+        if (json == NULL)
+        {
+            log_msg(ctx, "Memory allocation failure");
+            return NULL;
+        }
+        ctx->json = json;
+        ctx->json_size = size;
+
+        write_json(ctx, id, dlc, data, selection, ctx->json, ctx->json_size);
+        /* Output missing from the cache did not fit to be stored the first time round */
+        if (use_cache(ctx) && ctx->cache.misses != misses)
+        {
+            store_output(ctx, id, dlc, data, ctx->json, length);
+        }
+    }
+
+    /* In the thread-safe mode the scratch buffer itself is handed out, valid until the next call */
+    if (ctx->arena.base != NULL)
+    {
+        return ctx->json;
+    }
+
+    /* Memory will be allocated so remember to free it when you are done with it! */
+    char * json_string = malloc(length + 1);
+    if (json_string == NULL)
+    {
+        log_msg(ctx, "Failed to print JSON string");
+        return NULL;
+    }
+    memcpy(json_string, ctx->json, length + 1);
+
+    return json_string;
+}
+
+/**************************************************************************//**
+
+  \brief Write unformatted JSON for j1939 decoded data in one pass
+
+  Writes exactly what cJSON_PrintUnformatted() prints for the tree built
+  by j1939decode_ctx_to_json(), without building the tree.
+
+  \param ctx        pointer to the decoder context
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+  \param selection  pointer to the PGN record and SPNs to decode
+  \param buffer     pointer to the output buffer, may be NULL if size is zero
+  \param size       size of the output buffer in bytes
+
+  \return size_t    length of the complete JSON string
+
+******************************************************************************/
+size_t write_json(const j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                  const spn_selection * selection, char * buffer, size_t size)
+{
+    if (ctx->profile == J1939DECODE_PROFILE_VALUES)
+    {
+        return write_values_json(ctx, id, dlc, data, selection, buffer, size);
+    }
+
+    const uint32_t fields = ctx->fields.mask;
+    bool first = true;
+
+    j1939json_writer writer;
+    j1939json_init(&writer, buffer, size);
+
+    J1939JSON_WRITE_LITERAL(&writer, "{");
+    if (fields & J1939DECODE_FIELD_ID)
+    {
+        WRITE_KEY(&writer, &first, "\"ID\":");
+        j1939json_write_number(&writer, id);
+    }
+    if (fields & J1939DECODE_FIELD_PRIORITY)
+    {
+        WRITE_KEY(&writer, &first, "\"Priority\":");
+        j1939json_write_number(&writer, get_pri(id));
+    }
+    if (fields & J1939DECODE_FIELD_PGN)
+    {
+        WRITE_KEY(&writer, &first, "\"PGN\":");
+        j1939json_write_number(&writer, get_pgn(id));
+    }
+    if (fields & J1939DECODE_FIELD_DA)
+    {
+        WRITE_KEY(&writer, &first, "\"DA\":");
+        j1939json_write_number(&writer, get_da(id));
+    }
+    if (fields & J1939DECODE_FIELD_SA)
+    {
+        WRITE_KEY(&writer, &first, "\"SA\":");
+        j1939json_write_number(&writer, get_sa(id));
+    }
+    if (fields & J1939DECODE_FIELD_SA_NAME)
+    {
+        WRITE_KEY(&writer, &first, "\"SAName\":");
+        write_sa_name(ctx, &writer, get_sa(id));
+    }
+    if (fields & J1939DECODE_FIELD_DLC)
+    {
+        WRITE_KEY(&writer, &first, "\"DLC\":");
+        j1939json_write_number(&writer, dlc);
+    }
+
+    /* Raw data bytes */
+    if (fields & J1939DECODE_FIELD_DATA_RAW)
+    {
+        WRITE_KEY(&writer, &first, "\"DataRaw\":");
+        J1939JSON_WRITE_LITERAL(&writer, "[");
+        for (uint32_t i = 0; i < sizeof(*data); i++)
+        {
+            if (i > 0)
+            {
+                J1939JSON_WRITE_LITERAL(&writer, ",");
+            }
+            j1939json_write_number(&writer, ((const uint8_t *) data)[i]);
+        }
+        J1939JSON_WRITE_LITERAL(&writer, "]");
+    }
+
+    /* Pre-resolved record for specific PGN data */
+    const j1939db_pgn * record = selection->record;
+
+    if (record != NULL && (fields & J1939DECODE_FIELD_PGN_NAME))
+    {
+        WRITE_KEY(&writer, &first, "\"PGNName\":");
+        write_pgn_name(ctx, &writer, record);
+    }
+
+    if (record != NULL && (fields & J1939DECODE_FIELD_SPNS))
+    {
+        WRITE_KEY(&writer, &first, "\"SPNs\":");
+        J1939JSON_WRITE_LITERAL(&writer, "{");
+        for (size_t i = 0; i < selection->num_spns; i++)
+        {
+            const j1939db_spn * plan = get_spn(selection, i);
+            j1939decode_spn_value value;
+            bool first_field = true;
+
+            /* Decoding is a few instructions, formatting the values is what the mask saves */
+            decode_spn(ctx->database, NULL, plan, data, dlc, &value);
+            const char * spn_json = j1939db_fragment_text(ctx->database, &plan->json);
+
+            if (i > 0)
+            {
+                J1939JSON_WRITE_LITERAL(&writer, ",");
+            }
+
+            /* Key and static fields are pre-rendered, only the decoded values are formatted
+             * The selected static fields are copied a run of adjacent fields at a time */
+            j1939json_write_raw(&writer, spn_json, plan->json_fields[0]);
+            for (size_t r = 0; r < ctx->fields.num_spn_runs; r++)
+            {
+                size_t last = ctx->fields.spn_runs[r][1];
+                size_t run_start = plan->json_fields[ctx->fields.spn_runs[r][0]];
+                size_t run_end = last < J1939DB_SPN_NUM_FIELDS ? plan->json_fields[last + 1] : plan->json.length;
+
+                /* Missing optional fields are empty, a run of only those writes nothing */
+                if (run_start == run_end)
+                {
+                    continue;
+                }
+
+                if (!first_field)
+                {
+                    J1939JSON_WRITE_LITERAL(&writer, ",");
+                }
+                first_field = false;
+
+                if (last < J1939DB_SPN_NUM_FIELDS)
+                {
+                    /* Leave out the trailing comma of the last field in the run */
+                    j1939json_write_raw(&writer, spn_json + run_start, run_end - run_start - 1U);
+                }
+                else
+                {
+                    /* Run ends with the "ValueRaw" key */
+                    j1939json_write_raw(&writer, spn_json + run_start, run_end - run_start);
+                    j1939json_write_number(&writer, (double) value.value_raw);
+                }
+            }
+
+            if (fields & J1939DECODE_FIELD_SPN_VALUE_DECODED)
+            {
+                WRITE_KEY(&writer, &first_field, "\"ValueDecoded\":");
+                if (value.valid)
+                {
+                    j1939json_write_number(&writer, value.value_decoded);
+                }
+                else
+                {
+                    /* Decoded value is invalid or not available if outside of operation range */
+                    J1939JSON_WRITE_LITERAL(&writer, "\"Not available\"");
+                }
+            }
+
+            /* State strings are pre-rendered like the static fields */
+            if ((fields & J1939DECODE_FIELD_SPN_VALUE_STATE) && value.state != NULL)
+            {
+                const j1939db_fragment * state = j1939db_state_json(ctx->database, plan, value.value_raw);
+                WRITE_KEY(&writer, &first_field, "\"ValueState\":");
+                j1939json_write_raw(&writer, j1939db_fragment_text(ctx->database, state), state->length);
+            }
+
+            if (fields & J1939DECODE_FIELD_SPN_VALID)
+            {
+                WRITE_KEY(&writer, &first_field, "\"Valid\":");
+                j1939json_write_bool(&writer, value.valid);
+            }
+            J1939JSON_WRITE_LITERAL(&writer, "}");
+        }
+        J1939JSON_WRITE_LITERAL(&writer, "}");
+    }
+
+    /* Same criteria as j1939decode_to_json(): at least one SPN decoded */
+    if (fields & J1939DECODE_FIELD_DECODED)
+    {
+        WRITE_KEY(&writer, &first, "\"Decoded\":");
+        j1939json_write_bool(&writer, selection->num_spns > 0);
+    }
+    J1939JSON_WRITE_LITERAL(&writer, "}");
+
+    return j1939json_finish(&writer);
+}
+
+/**************************************************************************//**
+
+  \brief Write values profile JSON for j1939 decoded data in one pass
+
+  Only the CAN identifier fields, the timestamp and the decoded value, state and
+  valid flag of each SPN are written, for example:
+  {"ID":419348235,"PGN":65215,"SA":11,"Timestamp":12.5,"SPNs":{"904":{"ValueDecoded":15.6640625,"Valid":true},...}}
+  Invalid decoded values are written as null.
+
+  \param ctx        pointer to the decoder context
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+  \param selection  pointer to the PGN record and SPNs to decode
+  \param buffer     pointer to the output buffer, may be NULL if size is zero
+  \param size       size of the output buffer in bytes
+
+  \return size_t    length of the complete JSON string
+
+******************************************************************************/
+size_t write_values_json(const j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                         const spn_selection * selection, char * buffer, size_t size)
+{
+    j1939json_writer writer;
+    j1939json_init(&writer, buffer, size);
+
+    J1939JSON_WRITE_LITERAL(&writer, "{\"ID\":");
+    j1939json_write_number(&writer, id);
+    J1939JSON_WRITE_LITERAL(&writer, ",\"PGN\":");
+    j1939json_write_number(&writer, get_pgn(id));
+    J1939JSON_WRITE_LITERAL(&writer, ",\"DA\":");
+    j1939json_write_number(&writer, get_da(id));
+    J1939JSON_WRITE_LITERAL(&writer, ",\"SA\":");
+    j1939json_write_number(&writer, get_sa(id));
+
+    if (ctx->has_timestamp)
+    {
+        J1939JSON_WRITE_LITERAL(&writer, ",\"Timestamp\":");
+        j1939json_write_number(&writer, ctx->timestamp);
+    }
+
+    if (selection->record != NULL)
+    {
+        J1939JSON_WRITE_LITERAL(&writer, ",\"SPNs\":{");
+        for (size_t i = 0; i < selection->num_spns; i++)
+        {
+            const j1939db_spn * plan = get_spn(selection, i);
+            j1939decode_spn_value value;
+
+            decode_spn(ctx->database, NULL, plan, data, dlc, &value);
+            const char * spn_json = j1939db_fragment_text(ctx->database, &plan->json);
+
+            if (i > 0)
+            {
+                J1939JSON_WRITE_LITERAL(&writer, ",");
+            }
+
+            /* Pre-rendered key, up to the opening brace */
+            j1939json_write_raw(&writer, spn_json, plan->json_fields[0]);
+
+            J1939JSON_WRITE_LITERAL(&writer, "\"ValueDecoded\":");
+            if (value.valid)
+            {
+                j1939json_write_number(&writer, value.value_decoded);
+            }
+            else
+            {
+                J1939JSON_WRITE_LITERAL(&writer, "null");
+            }
+
+            if (value.state != NULL)
+            {
+                const j1939db_fragment * state = j1939db_state_json(ctx->database, plan, value.value_raw);
+                J1939JSON_WRITE_LITERAL(&writer, ",\"ValueState\":");
+                j1939json_write_raw(&writer, j1939db_fragment_text(ctx->database, state), state->length);
+            }
+
+            J1939JSON_WRITE_LITERAL(&writer, ",\"Valid\":");
+            j1939json_write_bool(&writer, value.valid);
+            J1939JSON_WRITE_LITERAL(&writer, "}");
+        }
+        J1939JSON_WRITE_LITERAL(&writer, "}");
+    }
+
+    J1939JSON_WRITE_LITERAL(&writer, "}");
+
+    return j1939json_finish(&writer);
+}
+
+/**************************************************************************//**
+
+  \brief Write database metadata of a PGN as JSON using the default context
+
+  \param pgn        parameter group number
+  \param buffer     pointer to the output buffer, may be NULL if size is zero
+  \param size       size of the output buffer in bytes
+
+  \return size_t    length of the complete JSON string, or zero on failure
+
+******************************************************************************/
+size_t j1939decode_pgn_metadata_json(uint32_t pgn, char * buffer, size_t size)
+{
+    return j1939decode_ctx_pgn_metadata_json(&default_ctx, pgn, buffer, size);
+}
+
+/**************************************************************************//**
+
+  \brief Write database metadata of a PGN as JSON
+
+  The metadata left out by the values profile: the PGN name and the static
+  fields of every SPN, copied from the pre-rendered fragments.
+
+  \param ctx        pointer to the decoder context
+  \param pgn        parameter group number
+  \param buffer     pointer to the output buffer, may be NULL if size is zero
+  \param size       size of the output buffer in bytes
+
+  \return size_t    length of the complete JSON string, or zero on failure
+
+******************************************************************************/
+size_t j1939decode_ctx_pgn_metadata_json(j1939decode_ctx * ctx, uint32_t pgn, char * buffer, size_t size)
+{
+    /* Fail and return zero if database is not loaded
+     * Remember to call j1939decode_init() first! */
+    if (ctx->database == NULL)
+    {
+        log_msg(ctx, "J1939 database not loaded");
+        return 0;
+    }
+
+    const j1939db_pgn * record = j1939db_get_pgn(ctx->database, pgn);
+    if (record == NULL)
+    {
+        return 0;
+    }
+
+    j1939json_writer writer;
+    j1939json_init(&writer, buffer, size);
+
+    J1939JSON_WRITE_LITERAL(&writer, "{\"PGN\":");
+    j1939json_write_number(&writer, record->pgn);
+    J1939JSON_WRITE_LITERAL(&writer, ",\"PGNName\":");
+    write_pgn_name(ctx, &writer, record);
+
+    J1939JSON_WRITE_LITERAL(&writer, ",\"SPNs\":{");
+    for (size_t i = 0; i < record->num_spns; i++)
+    {
+        const j1939db_spn * plan = &j1939db_pgn_spns(ctx->database, record)[i];
+
+        if (i > 0)
+        {
+            J1939JSON_WRITE_LITERAL(&writer, ",");
+        }
+
+        /* Key and static fields, leaving out the comma that precedes "ValueRaw" */
+        j1939json_write_raw(&writer, j1939db_fragment_text(ctx->database, &plan->json), plan->json_fields[J1939DB_SPN_NUM_FIELDS] - 1U);
+        J1939JSON_WRITE_LITERAL(&writer, "}");
+    }
+    J1939JSON_WRITE_LITERAL(&writer, "}}");
+
+    return j1939json_finish(&writer);
+}
+
+/**************************************************************************//**
+
+  \brief Write object key
+
+  \param writer     pointer to the JSON writer
+  \param first      pointer to the flag telling if no key was written to the object yet, cleared here
+  \param key        quoted key followed by a colon
+  \param length     length of the key
+
+  \return void
+
+******************************************************************************/
+void write_key(j1939json_writer * writer, bool * first, const char * key, size_t length)
+{
+    if (!*first)
     {
-        goto end;
+        J1939JSON_WRITE_LITERAL(writer, ",");
     }
+    *first = false;
+
+    j1939json_write_raw(writer, key, length);
+}
+
+/**************************************************************************//**
+
+  \brief Write pre-rendered source address name
+
+  Falls back to "Unknown" in the same way as get_sa_name().
+
+  \param ctx        pointer to the decoder context
+  \param writer     pointer to the JSON writer
+  \param sa         source address number
 
-    if (cJSON_AddStringToObject(json_object, "SAName", get_sa_name(get_sa(id))) == NULL)
+  \return void
+
+******************************************************************************/
+void write_sa_name(const j1939decode_ctx * ctx, j1939json_writer * writer, uint8_t sa)
+{
+    const j1939db_fragment * name = &ctx->database->sa_names_json[sa];
+    if (name->length == 0)
     {
-        goto end;
+        j1939json_write_string(writer, get_sa_name(ctx, sa));
+    }
+    else
+    {
+        j1939json_write_raw(writer, j1939db_fragment_text(ctx->database, name), name->length);
     }
+}
+
+/**************************************************************************//**
+
+  \brief Write pre-rendered PGN name
 
-    if (cJSON_AddNumberToObject(json_object, "DLC", dlc) == NULL)
+  Falls back to "Unknown" in the same way as get_pgn_name().
+
+  \param ctx        pointer to the decoder context
+  \param writer     pointer to the JSON writer
+  \param record     pointer to the PGN record
+
+  \return void
+
+******************************************************************************/
+void write_pgn_name(const j1939decode_ctx * ctx, j1939json_writer * writer, const j1939db_pgn * record)
+{
+    if (record->name_json.length == 0)
     {
-        goto end;
+        j1939json_write_string(writer, get_pgn_name(ctx, record->pgn));
+    }
+    else
+    {
+        j1939json_write_raw(writer, j1939db_fragment_text(ctx->database, &record->name_json), record->name_json.length);
     }
+}
 
-    /* Add raw data bytes to JSON object */
-    cJSON_AddItemToObject(json_object, "DataRaw", create_byte_array(data));
+/**************************************************************************//**
 
-    /* JSON object for specific PGN data */
-    const cJSON * pgn_data = get_pgn_data(get_pgn(id));
+  \brief Decode j1939 data into a caller supplied struct using the default context
 
-    /* Decoded flag default to false until set otherwise */
-    cJSON_bool decoded_flag = false;
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+  \param msg        pointer to the decoded message struct to fill in
+
+  \return bool      boolean indicating if the struct was filled in
+
+******************************************************************************/
+bool j1939decode_to_struct(uint32_t id, uint8_t dlc, const uint64_t * data, j1939decode_msg * msg)
+{
+    return j1939decode_ctx_to_struct(&default_ctx, id, dlc, data, msg);
+}
+
+/**************************************************************************//**
+
+  \brief Decode j1939 data into a caller supplied struct
+
+  Uses the same decode plans as j1939decode_to_json() but never allocates memory.
+  At most J1939DECODE_MAX_SPNS SPNs are stored in the struct.
+
+  \param ctx        pointer to the decoder context
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+  \param msg        pointer to the decoded message struct to fill in
+
+  \return bool      boolean indicating if the struct was filled in
 
-    if (cJSON_IsObject(pgn_data))
+******************************************************************************/
+bool j1939decode_ctx_to_struct(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                               j1939decode_msg * msg)
+{
+    /* Fail and return false if database is not loaded
+     * Remember to call j1939decode_init() first! */
+    if (ctx->database == NULL)
     {
-        /* PGN number found in lookup table */
+        log_msg(ctx, "J1939 database not loaded");
+        return false;
+    }
+
+    if (dlc > 8)
+    {
+        log_msg(ctx, "DLC cannot be greater than 8 bytes");
+        return false;
+    }
+
+    /* SPN metadata the decoded values point at, resolved on first use */
+    const j1939decode_spn_info * infos = j1939db_spn_infos(ctx->database);
+    if (infos == NULL)
+    {
+        return false;
+    }
+
+    /* Messages filtered out by the subscription or left unchanged are dropped before anything is filled in */
+    spn_selection selection;
+    if (!select_spns(ctx, id, &selection) || !detect_changes(ctx, id, dlc, data, &selection))
+    {
+        return false;
+    }
+
+    msg->id = id;
+    msg->priority = get_pri(id);
+    msg->pgn = get_pgn(id);
+    msg->da = get_da(id);
+    msg->sa = get_sa(id);
+    msg->dlc = dlc;
+    msg->data = *data;
+    msg->sa_name = (ctx->fields.mask & J1939DECODE_FIELD_SA_NAME) ? get_sa_name(ctx, msg->sa) : NULL;
+    msg->pgn_name = NULL;
+    msg->num_spns = 0;
+
+    /* Pre-resolved record for specific PGN data */
+    const j1939db_pgn * record = selection.record;
+    if (record != NULL && (ctx->fields.mask & J1939DECODE_FIELD_PGN_NAME))
+    {
+        msg->pgn_name = get_pgn_name(ctx, msg->pgn);
+    }
+
+    if (record != NULL && (ctx->fields.mask & J1939DECODE_FIELD_SPNS))
+    {
+        /* SPNs past the end of the struct are left out, as documented, without logging on every message */
+        size_t num_spns = selection.num_spns < J1939DECODE_MAX_SPNS ? selection.num_spns : J1939DECODE_MAX_SPNS;
 
-        if (cJSON_AddStringToObject(json_object, "PGNName", get_pgn_name(get_pgn(id))) == NULL)
+        for (size_t i = 0; i < num_spns; i++)
         {
-            goto end;
+            decode_spn(ctx->database, infos, get_spn(&selection, i), data, dlc, &msg->spns[i]);
         }
+        msg->num_spns = (uint32_t) num_spns;
+    }
+
+    /* Same criteria as j1939decode_to_json(): at least one SPN decoded */
+    msg->decoded = selection.num_spns > 0;
+
+    commit_changes(ctx);
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Decode a group of messages that share the same PGN record
+
+  Decoding is done one SPN at a time across the whole group so that
+  each SPN descriptor is loaded once for all messages.
+
+  \param ctx        pointer to the decoder context
+  \param infos      SPN metadata of the database from j1939db_spn_infos()
+  \param record     pointer to the PGN record shared by all messages
+  \param order      indices of the messages in the group
+  \param count      number of messages in the group
+  \param data       pointer to array of message data
+  \param msgs       pointer to array of decoded message structs
+
+  \return void
+
+******************************************************************************/
+void decode_msg_group(const j1939decode_ctx * ctx, const j1939decode_spn_info * infos, const j1939db_pgn * record,
+                      const uint16_t * order, size_t count, const uint64_t * data, j1939decode_msg * msgs)
+{
+    const uint32_t fields = ctx->fields.mask;
 
-        /* JSON object containing list of decoded SPN data */
-        cJSON * spn_object = cJSON_CreateObject();
-        if (spn_object == NULL)
+    spn_selection selection = {record, j1939db_pgn_spns(ctx->database, record), NULL, 0};
+    selection.selected = get_subscribed_spns(ctx, record, &selection.num_spns);
+
+    size_t num_spns = (fields & J1939DECODE_FIELD_SPNS) ? selection.num_spns : 0;
+    num_spns = num_spns < J1939DECODE_MAX_SPNS ? num_spns : J1939DECODE_MAX_SPNS;
+
+    const char * pgn_name = (fields & J1939DECODE_FIELD_PGN_NAME) ? get_pgn_name(ctx, record->pgn) : NULL;
+
+    for (size_t i = 0; i < num_spns; i++)
+    {
+        const j1939db_spn * plan = get_spn(&selection, i);
+        for (size_t j = 0; j < count; j++)
         {
-            goto end;
+            decode_spn(ctx->database, infos, plan, &data[order[j]], msgs[order[j]].dlc, &msgs[order[j]].spns[i]);
         }
+    }
+
+    for (size_t j = 0; j < count; j++)
+    {
+        j1939decode_msg * msg = &msgs[order[j]];
+        msg->pgn_name = pgn_name;
+        msg->num_spns = (uint32_t) num_spns;
+        msg->decoded = selection.num_spns > 0;
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Decode an array of j1939 messages into an array of caller supplied structs using the default context
+
+  \param ids        pointer to array of CAN identifiers
+  \param dlcs       pointer to array of data length codes
+  \param data       pointer to array of data (8 bytes each)
+  \param count      number of messages in the arrays
+  \param msgs       pointer to array of decoded message structs to fill in
+
+  \return size_t    number of structs filled in
+
+******************************************************************************/
+size_t j1939decode_to_struct_batch(const uint32_t * ids, const uint8_t * dlcs, const uint64_t * data,
+                                   size_t count, j1939decode_msg * msgs)
+{
+    return j1939decode_ctx_to_struct_batch(&default_ctx, ids, dlcs, data, count, msgs);
+}
+
+/**************************************************************************//**
+
+  \brief Decode an array of j1939 messages into an array of caller supplied structs
+
+  Each struct is filled in the same way as j1939decode_to_struct() would.
+  Messages are processed in chunks; within a chunk, messages are grouped by
+  PGN so that each decode plan is walked once per group rather than once per message.
+  Messages with a DLC greater than 8, filtered out by a subscription or
+  left unchanged under change detection are filled in with the decoded flag cleared.
+  Change detection decodes the messages one at a time instead of grouping them.
+
+  \param ctx        pointer to the decoder context
+  \param ids        pointer to array of CAN identifiers
+  \param dlcs       pointer to array of data length codes
+  \param data       pointer to array of data (8 bytes each)
+  \param count      number of messages in the arrays
+  \param msgs       pointer to array of decoded message structs to fill in
+
+  \return size_t    number of structs filled in
+
+******************************************************************************/
+size_t j1939decode_ctx_to_struct_batch(j1939decode_ctx * ctx, const uint32_t * ids, const uint8_t * dlcs,
+                                       const uint64_t * data, size_t count, j1939decode_msg * msgs)
+{
+    /* Fail and return zero if database is not loaded
+     * Remember to call j1939decode_init() first! */
+    if (ctx->database == NULL)
+    {
+        log_msg(ctx, "J1939 database not loaded");
+        return 0;
+    }
+
+    /* SPN metadata the decoded values point at, resolved on first use */
+    const j1939decode_spn_info * infos = j1939db_spn_infos(ctx->database);
+    if (infos == NULL)
+    {
+        return 0;
+    }
+
+    /* Grouping scratch space lives in the context to keep it off the stack */
+    const j1939db_pgn ** records = ctx->batch.records;
+    uint16_t * msg_group = ctx->batch.msg_group;
+    const j1939db_pgn ** group_record = ctx->batch.group_record;
+    uint16_t * group_size = ctx->batch.group_size;
+    uint16_t * group_slots = ctx->batch.group_slots;
+    uint16_t * order = ctx->batch.order;
+    uint16_t * next = ctx->batch.next;
+
+    for (size_t base = 0; base < count; base += BATCH_CHUNK_SIZE)
+    {
+        size_t chunk_size = count - base < BATCH_CHUNK_SIZE ? count - base : BATCH_CHUNK_SIZE;
+        j1939decode_msg * chunk_msgs = &msgs[base];
+        size_t num_groups = 0;
+
+        memset(group_slots, 0, sizeof(ctx->batch.group_slots));
 
-        /* JSON object for SPN list in PGN */
-        const cJSON * spn_list_array = cJSON_GetObjectItemCaseSensitive(pgn_data, "SPNs");
-        if (cJSON_IsArray(spn_list_array))
+        /* Fill in the header fields, resolve the PGN records and group the chunk by record */
+        for (size_t i = 0; i < chunk_size; i++)
         {
-            uint32_t num_spns = cJSON_GetArraySize(spn_list_array);
-            if (num_spns > 0)
+            j1939decode_msg * msg = &chunk_msgs[i];
+            uint32_t id = ids[base + i];
+
+            msg->id = id;
+            msg->priority = get_pri(id);
+            msg->pgn = get_pgn(id);
+            msg->da = get_da(id);
+            msg->sa = get_sa(id);
+            msg->dlc = dlcs[base + i];
+            msg->data = data[base + i];
+            msg->sa_name = (ctx->fields.mask & J1939DECODE_FIELD_SA_NAME) ? get_sa_name(ctx, msg->sa) : NULL;
+            msg->pgn_name = NULL;
+            msg->num_spns = 0;
+            msg->decoded = false;
+
+            records[i] = NULL;
+            if (msg->dlc > 8)
             {
-                /* One or more SPNs exist for PGN */
-
-                for (uint32_t i = 0; i < num_spns; i++)
+                log_msg(ctx, "DLC cannot be greater than 8 bytes");
+            }
+            else if (ctx->changes.enabled)
+            {
+                /* Change detection has to see every message in arrival order, so each one is decoded on its own */
+                j1939decode_ctx_to_struct(ctx, id, msg->dlc, &data[base + i], msg);
+            }
+            else
+            {
+                /* Messages filtered out by the subscription are left with the decoded flag cleared */
+                spn_selection selection;
+                records[i] = select_spns(ctx, id, &selection) ? selection.record : NULL;
+                if (records[i] != NULL)
                 {
-                    /* Getting SPN number from SPN list in PGN since the SPN number is used as a key only and not included in the SPN data object itself */
-                    uint32_t spn_number = (uint32_t) cJSON_GetArrayItem(spn_list_array, i)->valueint;
-
-                    /* Array of all possible proprietary SPNs */
-                    const uint32_t proprietary_spns[] = {2550, 2551, 3328};
-
-                    /* Check for proprietary SPNs */
-                    if (in_array(spn_number, proprietary_spns, sizeof(proprietary_spns) / sizeof(proprietary_spns[0])))
-                    {
-                        /* TODO: Disabling print to silently ignore proprietary SPNs */
-                        /* log_msg("Skipping decode for proprietary SPN %d", spn_number); */
-                    }
-                    else
-                    {
-                        /* Need to pass SPN starting bit position since it is found in the PGN data object */
-                        uint32_t start_bit;
-                        const cJSON * start_bit_json = cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(pgn_data, "SPNStartBits"), i);
-                        if (cJSON_IsNumber(start_bit_json))
-                        {
-                            if (start_bit_json->valueint < 0)
-                            {
-                                log_msg("Start bit cannot be negative for SPN %d, skipping decode", spn_number);
-                                continue;
-                            }
-
-                            /* Now cast to unsigned */
-                            start_bit = (uint32_t) start_bit_json->valueint;
-                        }
-                        else
-                        {
-                            log_msg("No start bit found in database for SPN %d, skipping decode", spn_number);
-                            continue;
-                        }
-
-                        /* Add SPN data object to SPN list object using SPN number as a key */
-                        char spn_string[7];
-                        snprintf(spn_string, sizeof(spn_string), "%d", spn_number);
-
-                        cJSON * spn_data = extract_spn_data(spn_number, data, start_bit);
-                        if (spn_data != NULL)
-                        {
-                            /* At least one SPN found in database and actually decoded */
-
-                            /* TODO: What criteria should be used to determine if the message should be flagged as "decoded" or not?
-                             * 1. If PGN data found in database?
-                             * 2. If at least one SPN found in database for PGN?
-                             * 3. If at least one SPN, with start bits, found in database for PGN?
-                             * 4. If at least one SPN actually decoded? (i.e. extract_spn_data() did not return NULL)
-                             * Using #4 criteria for now */
-
-                            decoded_flag = true;
-                        }
-                        cJSON_AddItemToObject(spn_object, spn_string, spn_data);
-                    }
+                    PREFETCH(j1939db_pgn_spns(ctx->database, records[i]));
                 }
             }
-            else
+
+            /* Find the group for this record with linear probing, keyed on the record address */
+            size_t slot = ((uintptr_t) records[i] / sizeof(j1939db_pgn)) & (BATCH_GROUP_SLOTS - 1);
+            while (group_slots[slot] != 0 && group_record[group_slots[slot] - 1] != records[i])
+            {
+                slot = (slot + 1) & (BATCH_GROUP_SLOTS - 1);
+            }
+            if (group_slots[slot] == 0)
             {
-                log_msg("Empty SPN list found in database for PGN %d", get_pgn(id));
+                group_record[num_groups] = records[i];
+                group_size[num_groups] = 0;
+                group_slots[slot] = (uint16_t) ++num_groups;
             }
+            msg_group[i] = (uint16_t) (group_slots[slot] - 1);
+            group_size[msg_group[i]]++;
         }
-        else
+
+        /* Counting sort the chunk by group, keeping messages in arrival order within a group */
+        uint16_t position = 0;
+        for (size_t g = 0; g < num_groups; g++)
+        {
+            uint16_t size = group_size[g];
+            group_size[g] = position;
+            position += size;
+        }
+        group_size[num_groups] = position;
+
+        memcpy(next, group_size, num_groups * sizeof(uint16_t));
+        for (size_t i = 0; i < chunk_size; i++)
         {
-            log_msg("No SPNs found in database for PGN %d", get_pgn(id));
+            order[next[msg_group[i]]++] = (uint16_t) i;
         }
 
-        /* Add SPN list object to the main JSON object */
-        cJSON_AddItemToObject(json_object, "SPNs", spn_object);
+        /* Decode each group of messages sharing the same PGN record */
+        for (size_t g = 0; g < num_groups; g++)
+        {
+            if (group_record[g] != NULL)
+            {
+                decode_msg_group(ctx, infos, group_record[g], &order[group_size[g]],
+                                 group_size[g + 1] - group_size[g], &data[base], chunk_msgs);
+            }
+        }
     }
-    else
+
+    return count;
+}
+
+/**************************************************************************//**
+
+  \brief Decode frames of the same PGN into one column per SPN using the default context
+
+  \param pgn            parameter group number shared by all frames
+  \param dlcs           pointer to array of data length codes
+  \param data           pointer to array of data (8 bytes each)
+  \param count          number of frames in the arrays
+  \param columns        pointer to array of columns, with the value arrays supplied
+  \param max_columns    number of columns the array holds
+
+  \return size_t        number of SPNs decoded for the PGN
+
+******************************************************************************/
+size_t j1939decode_to_columns(uint32_t pgn, const uint8_t * dlcs, const uint64_t * data, size_t count,
+                              j1939decode_spn_column * columns, size_t max_columns)
+{
+    return j1939decode_ctx_to_columns(&default_ctx, pgn, dlcs, data, count, columns, max_columns);
+}
+
+/**************************************************************************//**
+
+  \brief Decode frames of the same PGN into one column per SPN
+
+  Each SPN is extracted, scaled and range checked across every frame before
+  moving on to the next SPN, so the whole column is processed by one SIMD kernel.
+
+  \param ctx            pointer to the decoder context
+  \param pgn            parameter group number shared by all frames
+  \param dlcs           pointer to array of data length codes
+  \param data           pointer to array of data (8 bytes each)
+  \param count          number of frames in the arrays
+  \param columns        pointer to array of columns, with the value arrays supplied
+  \param max_columns    number of columns the array holds
+
+  \return size_t        number of SPNs decoded for the PGN
+
+******************************************************************************/
+size_t j1939decode_ctx_to_columns(j1939decode_ctx * ctx, uint32_t pgn, const uint8_t * dlcs, const uint64_t * data,
+                                  size_t count, j1939decode_spn_column * columns, size_t max_columns)
+{
+    /* Fail and return zero if database is not loaded
+     * Remember to call j1939decode_init() first! */
+    if (ctx->database == NULL)
     {
-        /* TODO: This print may happen too often when trying to decode non-J1939 data */
-        /* log_msg("PGN %d not found in database", get_pgn(id)); */
+        log_msg(ctx, "J1939 database not loaded");
+        return 0;
     }
 
-    if (cJSON_AddBoolToObject(json_object, "Decoded", decoded_flag) == NULL)
+    /* SPN metadata the decoded values point at, resolved on first use */
+    const j1939decode_spn_info * infos = j1939db_spn_infos(ctx->database);
+    spn_selection selection = {j1939db_get_pgn(ctx->database, pgn), NULL, NULL, 0};
+    if (infos == NULL || selection.record == NULL)
     {
-        goto end;
+        return 0;
     }
+    selection.spns = j1939db_pgn_spns(ctx->database, selection.record);
+    selection.selected = get_subscribed_spns(ctx, selection.record, &selection.num_spns);
 
-    /* Print the JSON string
-     * Memory will be allocated so remember to free it when you are done with it! */
-    json_string = pretty ? cJSON_Print(json_object) : cJSON_PrintUnformatted(json_object);
-    if (json_string == NULL)
+    for (size_t i = 0; i < selection.num_spns && i < max_columns; i++)
     {
-        log_msg("Failed to print JSON string");
+        const j1939db_spn * plan = get_spn(&selection, i);
+
+        columns[i].info = &infos[plan - ctx->database->spns];
+        j1939db_decode_column(plan, data, dlcs, count, columns[i].value_raw, columns[i].value_decoded, columns[i].valid);
     }
 
-    end:
-    cJSON_Delete(json_object);
-    return json_string;
+    return selection.num_spns;
+}
+
+/**************************************************************************//**
+
+  \brief Split the ASCII SPNs of a PGN out of a payload using the default context
+
+  \param pgn            parameter group number of the payload
+  \param payload        pointer to the payload
+  \param length         length of the payload in bytes
+  \param strings        pointer to array of strings to fill in
+  \param max_strings    number of strings the array holds
+
+  \return size_t        number of ASCII SPNs of the PGN
+
+******************************************************************************/
+size_t j1939decode_to_strings(uint32_t pgn, const uint8_t * payload, size_t length,
+                              j1939decode_spn_string * strings, size_t max_strings)
+{
+    return j1939decode_ctx_to_strings(&default_ctx, pgn, payload, length, strings, max_strings);
+}
+
+/**************************************************************************//**
+
+  \brief Split the ASCII SPNs of a PGN out of a payload
+
+  Fixed position ASCII SPNs are cut out of their bytes. The variable-length
+  fields are found by a single walk over the rest of the payload, from
+  one '*' delimiter to the next.
+
+  \param ctx            pointer to the decoder context
+  \param pgn            parameter group number of the payload
+  \param payload        pointer to the payload
+  \param length         length of the payload in bytes
+  \param strings        pointer to array of strings to fill in
+  \param max_strings    number of strings the array holds
+
+  \return size_t        number of ASCII SPNs of the PGN
+
+******************************************************************************/
+size_t j1939decode_ctx_to_strings(j1939decode_ctx * ctx, uint32_t pgn, const uint8_t * payload, size_t length,
+                                  j1939decode_spn_string * strings, size_t max_strings)
+{
+    /* Fail and return zero if database is not loaded
+     * Remember to call j1939decode_init() first! */
+    if (ctx->database == NULL)
+    {
+        log_msg(ctx, "J1939 database not loaded");
+        return 0;
+    }
+
+    const j1939decode_spn_info * infos = j1939db_spn_infos(ctx->database);
+    const j1939db_pgn * record = j1939db_get_pgn(ctx->database, pgn);
+    if (infos == NULL || record == NULL)
+    {
+        return 0;
+    }
+
+    /* Delimited SPNs are stored right after the fixed position ones */
+    const j1939decode_spn_info * record_infos = &infos[record->first_spn];
+    size_t count = 0;
+    for (size_t i = 0; i < record->num_spns; i++)
+    {
+        const j1939decode_spn_info * info = &record_infos[i];
+        if (info->units == NULL || strcmp(info->units, "ASCII") != 0 || info->start_bit % 8U != 0)
+        {
+            continue;
+        }
+
+        if (count < max_strings)
+        {
+            /* Cut short where the payload ends */
+            size_t start = info->start_bit / 8U;
+            size_t end = start + info->length / 8U;
+            size_t start_in = start < length ? start : length;
+            size_t end_in = end < length ? end : length;
+
+            strings[count].info = info;
+            strings[count].text = (const char *) payload + start_in;
+            strings[count].length = end_in - start_in;
+            strings[count].complete = end <= length;
+        }
+        count++;
+    }
+
+    /* Delimited fields follow each other, each up to the next delimiter */
+    const char * text = (const char *) payload;
+    const char * end = text + length;
+    for (size_t i = 0; i < record->num_delimited; i++, count++)
+    {
+        const char * delimiter = text < end ? memchr(text, '*', (size_t) (end - text)) : NULL;
+
+        if (count < max_strings)
+        {
+            strings[count].info = &record_infos[record->num_spns + i];
+            strings[count].text = text;
+            strings[count].length = (size_t) ((delimiter != NULL ? delimiter : end) - text);
+            strings[count].complete = delimiter != NULL;
+        }
+
+        text = delimiter != NULL ? delimiter + 1 : end;
+    }
+
+    return count;
+}
+
+/**************************************************************************//**
+
+  \brief Decode the fixed position SPNs of a PGN out of a payload using the default context
+
+  \param pgn            parameter group number of the payload
+  \param payload        pointer to the payload
+  \param length         length of the payload in bytes
+  \param values         pointer to array of values to fill in
+  \param max_values     number of values the array holds
+
+  \return size_t        number of SPNs decoded for the PGN
+
+******************************************************************************/
+size_t j1939decode_to_values(uint32_t pgn, const uint8_t * payload, size_t length,
+                             j1939decode_spn_value * values, size_t max_values)
+{
+    return j1939decode_ctx_to_values(&default_ctx, pgn, payload, length, values, max_values);
+}
+
+/**************************************************************************//**
+
+  \brief Decode the fixed position SPNs of a PGN out of a payload
+
+  Unlike the frame decoders, which hold the payload in one 64-bit word,
+  every SPN is read from the bytes it spans, so SPNs beyond the first
+  8 bytes of a multi-packet message decode like the others.
+
+  \param ctx            pointer to the decoder context
+  \param pgn            parameter group number of the payload
+  \param payload        pointer to the payload
+  \param length         length of the payload in bytes
+  \param values         pointer to array of values to fill in
+  \param max_values     number of values the array holds
+
+  \return size_t        number of SPNs decoded for the PGN
+
+******************************************************************************/
+size_t j1939decode_ctx_to_values(j1939decode_ctx * ctx, uint32_t pgn, const uint8_t * payload, size_t length,
+                                 j1939decode_spn_value * values, size_t max_values)
+{
+    /* Fail and return zero if database is not loaded
+     * Remember to call j1939decode_init() first! */
+    if (ctx->database == NULL)
+    {
+        log_msg(ctx, "J1939 database not loaded");
+        return 0;
+    }
+
+    /* SPN metadata the decoded values point at, resolved on first use */
+    const j1939decode_spn_info * infos = j1939db_spn_infos(ctx->database);
+    spn_selection selection = {j1939db_get_pgn(ctx->database, pgn), NULL, NULL, 0};
+    if (infos == NULL || selection.record == NULL)
+    {
+        return 0;
+    }
+    selection.spns = j1939db_pgn_spns(ctx->database, selection.record);
+    selection.selected = get_subscribed_spns(ctx, selection.record, &selection.num_spns);
+
+    for (size_t i = 0; i < selection.num_spns && i < max_values; i++)
+    {
+        decode_spn_bytes(ctx->database, infos, get_spn(&selection, i), payload, length, &values[i]);
+    }
+
+    return selection.num_spns;
 }
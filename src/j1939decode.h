@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -13,12 +14,262 @@ extern "C" {
 #define J1939DECODE_VERSION_MINOR 1
 #define J1939DECODE_VERSION_PATCH 1
 
-/* J1939 digital annex JSON filename */
+/* J1939 digital annex JSON filename
+ * May also name a binary database image built with j1939dbconv */
 #define J1939DECODE_DB "J1939db.json"
 
+/* Maximum number of SPNs held in a decoded message struct
+ * SPNs of a PGN past this many are silently left out of the struct */
+#define J1939DECODE_MAX_SPNS 64
+
+/* SPN metadata from the J1939 database */
+typedef struct
+{
+    uint32_t spn;
+    uint32_t start_bit;
+    uint32_t length;
+    double resolution;
+    double offset;
+    double operational_high;
+    double operational_low;
+    const char * name;
+    const char * units;
+    const char * data_range;
+    const char * operational_range;
+} j1939decode_spn_info;
+
+/* Start bit of variable-length SPNs, which have no fixed position and are found by their '*' delimiter instead */
+#define J1939DECODE_NO_START_BIT UINT32_MAX
+
+/* Decoded SPN value */
+typedef struct
+{
+    uint32_t spn;
+    uint64_t value_raw;
+    double value_decoded;
+    bool valid;
+    /* Enumerated state of the raw value from the database bit decodings, NULL if the SPN has none for it
+     * Points into the J1939 lookup table like info */
+    const char * state;
+    /* Points into the J1939 lookup table, valid until j1939decode_deinit() or j1939decode_db_free() */
+    const j1939decode_spn_info * info;
+} j1939decode_spn_value;
+
+/* Decoded J1939 message */
+typedef struct
+{
+    uint32_t id;
+    uint8_t priority;
+    /* PDU1 PGNs have their destination address cleared, it is in da instead */
+    uint32_t pgn;
+    /* Destination address of PDU1 PGNs, 255 (global) for PDU2 PGNs */
+    uint8_t da;
+    uint8_t sa;
+    uint8_t dlc;
+    uint64_t data;
+    /* Point into the J1939 lookup table, valid until j1939decode_deinit() or j1939decode_db_free() */
+    const char * pgn_name;
+    const char * sa_name;
+    bool decoded;
+    uint32_t num_spns;
+    j1939decode_spn_value spns[J1939DECODE_MAX_SPNS];
+} j1939decode_msg;
+
+/* Place where an SPN is carried */
+typedef struct
+{
+    uint32_t pgn;
+    uint32_t start_bit;
+    /* Points into the J1939 lookup table, valid until j1939decode_deinit() or j1939decode_db_free() */
+    const j1939decode_spn_info * info;
+} j1939decode_spn_location;
+
+/* SocketCAN filter, same layout as struct can_filter from <linux/can.h>
+ * Pass an array of these to setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, ...) */
+typedef struct
+{
+    uint32_t can_id;
+    uint32_t can_mask;
+} j1939decode_can_filter;
+
+/* Extended frame format flag of SocketCAN identifiers, CAN_EFF_FLAG in <linux/can.h> */
+#define J1939DECODE_CAN_EFF_FLAG 0x80000000U
+
+/* One SPN decoded across a batch of frames of the same PGN by j1939decode_to_columns() */
+typedef struct
+{
+    /* Filled in: metadata of the SPN, points into the J1939 lookup table like j1939decode_spn_value.info */
+    const j1939decode_spn_info * info;
+    /* Caller supplied arrays of one entry per frame */
+    uint64_t * value_raw;
+    double * value_decoded;
+    bool * valid;
+} j1939decode_spn_column;
+
+/* Text of an ASCII SPN split out of a payload by j1939decode_to_strings() */
+typedef struct
+{
+    /* Metadata of the SPN, points into the J1939 lookup table like j1939decode_spn_value.info */
+    const j1939decode_spn_info * info;
+    /* Points into the payload passed in and is not terminated, valid as long as the payload is */
+    const char * text;
+    size_t length;
+    /* False if the payload ended before the field did */
+    bool complete;
+} j1939decode_spn_string;
+
+/* Largest payload carried by the transport protocol, 255 packets of 7 bytes */
+#define J1939DECODE_TP_MAX_SIZE 1785U
+
+/* Largest payload carried by the extended transport protocol, 2^24 - 1 packets of 7 bytes */
+#define J1939DECODE_ETP_MAX_SIZE 117440505UL
+
+/* Message reassembled from a transport protocol session by j1939decode_tp_feed() */
+typedef struct
+{
+    uint32_t pgn;
+    uint8_t sa;
+    /* Destination address, 255 for broadcast (BAM) messages */
+    uint8_t da;
+    /* Points into the reassembler, valid until the next call to j1939decode_tp_feed() */
+    const uint8_t * data;
+    size_t length;
+} j1939decode_tp_msg;
+
+/* Transport protocol statistics */
+typedef struct
+{
+    /* Messages reassembled */
+    uint64_t completed;
+    /* Sessions closed by a connection abort, a lost broadcast packet or a new announcement between the same addresses */
+    uint64_t aborted;
+    /* Sessions not heard from within the J1939-21 timeouts */
+    uint64_t timed_out;
+    /* Announcements ignored because every session was in use */
+    uint64_t dropped;
+    /* Sessions in progress */
+    size_t open;
+    /* Bytes held by extended transport protocol buffers, in use or pooled */
+    size_t buffer_size;
+} j1939decode_tp_stats;
+
+/* Most trouble codes in one DM1 or DM2 message, the largest transport protocol payload after the lamp status */
+#define J1939DECODE_MAX_DTCS 445U
+
+/* Lamps of a diagnostic message, in the order they are sent */
+enum
+{
+    J1939DECODE_LAMP_MIL,
+    J1939DECODE_LAMP_RED_STOP,
+    J1939DECODE_LAMP_AMBER_WARNING,
+    J1939DECODE_LAMP_PROTECT,
+    J1939DECODE_NUM_LAMPS
+};
+
+/* Diagnostic trouble code */
+typedef struct
+{
+    uint32_t spn;
+    /* Failure mode identifier */
+    uint8_t fmi;
+    /* Occurrence count, 127 if not available */
+    uint8_t oc;
+} j1939decode_dtc;
+
+/* DM1 or DM2 message decoded by j1939decode_dm_decode() */
+typedef struct
+{
+    uint32_t pgn;
+    uint8_t sa;
+    /* Lamp status and flash status indexed by J1939DECODE_LAMP_*, two bits each as sent */
+    uint8_t lamps[J1939DECODE_NUM_LAMPS];
+    uint8_t flash[J1939DECODE_NUM_LAMPS];
+    size_t num_dtcs;
+    j1939decode_dtc dtcs[J1939DECODE_MAX_DTCS];
+} j1939decode_dm_msg;
+
+/* Active fault set or cleared, reported by j1939decode_dm_table_update() */
+typedef struct
+{
+    uint8_t sa;
+    /* True if the fault became active, false if it cleared */
+    bool active;
+    /* Occurrence count of the last message the fault was in */
+    j1939decode_dtc dtc;
+} j1939decode_dm_event;
+
+/* Output cache statistics */
+typedef struct
+{
+    /* Messages whose output was found in the cache, and messages rendered because it was not */
+    uint64_t hits;
+    uint64_t misses;
+    /* Outputs held, at most the number of entries the cache was set up with */
+    size_t entries;
+} j1939decode_cache_stats;
+
+/* JSON output profiles */
+typedef enum
+{
+    /* Every field, including the SPN metadata from the database (default) */
+    J1939DECODE_PROFILE_FULL,
+    /* Only ID, PGN, SA, timestamp and the decoded value and valid flag of each SPN
+     * Use j1939decode_pgn_metadata_json() to get the metadata left out */
+    J1939DECODE_PROFILE_VALUES
+} j1939decode_profile;
+
+/* Output field mask bits, one per key of the full profile
+ * Keys left out of the mask are neither computed nor written, and the matching struct fields are left empty */
+#define J1939DECODE_FIELD_ID                    (UINT32_C(1) << 0)
+#define J1939DECODE_FIELD_PRIORITY              (UINT32_C(1) << 1)
+#define J1939DECODE_FIELD_PGN                   (UINT32_C(1) << 2)
+#define J1939DECODE_FIELD_SA                    (UINT32_C(1) << 3)
+#define J1939DECODE_FIELD_SA_NAME               (UINT32_C(1) << 4)
+#define J1939DECODE_FIELD_DLC                   (UINT32_C(1) << 5)
+#define J1939DECODE_FIELD_DATA_RAW              (UINT32_C(1) << 6)
+#define J1939DECODE_FIELD_PGN_NAME              (UINT32_C(1) << 7)
+#define J1939DECODE_FIELD_SPNS                  (UINT32_C(1) << 8)
+#define J1939DECODE_FIELD_DECODED               (UINT32_C(1) << 9)
+/* Per SPN fields, only written if J1939DECODE_FIELD_SPNS is set */
+#define J1939DECODE_FIELD_SPN_DATA_RANGE        (UINT32_C(1) << 10)
+#define J1939DECODE_FIELD_SPN_NAME              (UINT32_C(1) << 11)
+#define J1939DECODE_FIELD_SPN_OFFSET            (UINT32_C(1) << 12)
+#define J1939DECODE_FIELD_SPN_OPERATIONAL_HIGH  (UINT32_C(1) << 13)
+#define J1939DECODE_FIELD_SPN_OPERATIONAL_LOW   (UINT32_C(1) << 14)
+#define J1939DECODE_FIELD_SPN_OPERATIONAL_RANGE (UINT32_C(1) << 15)
+#define J1939DECODE_FIELD_SPN_RESOLUTION        (UINT32_C(1) << 16)
+#define J1939DECODE_FIELD_SPN_LENGTH            (UINT32_C(1) << 17)
+#define J1939DECODE_FIELD_SPN_UNITS             (UINT32_C(1) << 18)
+#define J1939DECODE_FIELD_SPN_START_BIT         (UINT32_C(1) << 19)
+#define J1939DECODE_FIELD_SPN_VALUE_RAW         (UINT32_C(1) << 20)
+#define J1939DECODE_FIELD_SPN_VALUE_DECODED     (UINT32_C(1) << 21)
+#define J1939DECODE_FIELD_SPN_VALID             (UINT32_C(1) << 22)
+/* Only written for raw values with a state in the database bit decodings */
+#define J1939DECODE_FIELD_SPN_VALUE_STATE       (UINT32_C(1) << 23)
+/* Destination address, written right after the PGN */
+#define J1939DECODE_FIELD_DA                    (UINT32_C(1) << 24)
+/* Every field (default) */
+#define J1939DECODE_FIELDS_ALL                  ((UINT32_C(1) << 25) - 1)
+
 /* Log function pointer type */
 typedef void (*log_fn_ptr)(const char *);
 
+/* Opaque J1939 database handle
+ * Read-only once loaded, may be shared by any number of decoder contexts */
+typedef struct j1939decode_db j1939decode_db;
+
+/* Opaque transport protocol reassembler
+ * Tracks the multi-packet sessions seen on one bus, use one reassembler per bus and thread */
+typedef struct j1939decode_tp j1939decode_tp;
+
+/* Opaque active fault table
+ * Holds the DM1 faults of every source address on one bus, use one table per bus and thread */
+typedef struct j1939decode_dm_table j1939decode_dm_table;
+
+/* Opaque decoder context
+ * Holds the log handler and all per-call scratch state, use one context per thread */
+typedef struct j1939decode_ctx j1939decode_ctx;
+
 /* Set log function handler */
 void j1939decode_set_log_fn(log_fn_ptr fn);
 
@@ -38,6 +289,7 @@ void j1939decode_deinit(void);
 	"ID":	419348235,
 	"Priority":	6,
 	"PGN":	65215,
+	"DA":	255,
 	"SA":	11,
 	"SAName":	"Brakes - System Controller",
 	"DLC":	8,
@@ -66,6 +318,217 @@ void j1939decode_deinit(void);
  */
 char * j1939decode_to_json(uint32_t id, uint8_t dlc, const uint64_t * data, bool pretty);
 
+/* Write unformatted JSON string for j1939 decoded data into a caller supplied buffer
+ * Output is identical to j1939decode_to_json(..., false) but no memory is allocated.
+ * Like snprintf(), at most size - 1 characters are written followed by a terminator, and the
+ * length of the complete string is returned even if it did not fit; call with size 0 to get the length.
+ * Returns zero on failure */
+size_t j1939decode_to_json_buffer(uint32_t id, uint8_t dlc, const uint64_t * data, char * buffer, size_t size);
+
+/* Select JSON output profile, J1939DECODE_PROFILE_FULL by default
+ * Pretty printing only applies to the full profile */
+void j1939decode_set_profile(j1939decode_profile profile);
+
+/* Set timestamp of the messages decoded next, in seconds
+ * Only written by the values profile, which leaves it out until a timestamp is set */
+void j1939decode_set_timestamp(double timestamp);
+
+/* Select the fields produced by the full profile and the struct decoders, J1939DECODE_FIELDS_ALL by default
+ * The struct decoders always fill in the identifier fields and only look at the SA name, PGN name
+ * and SPNs bits. Decoded is still set if SPNs are left out. The values profile ignores the mask. */
+void j1939decode_set_fields(uint32_t fields);
+
+/* Decode only the given SPNs, and only from the given source addresses if num_sas is not zero
+ * Messages with no subscribed SPN are dropped: the JSON functions return NULL or zero and
+ * j1939decode_to_struct() returns false, all without logging. SPNs not in the database are logged.
+ * Variable-length SPNs have nothing to decode, so they select no SPN; use j1939decode_to_strings() for them.
+ * The subscription is compiled against the loaded database; num_spns zero removes it.
+ * Returns false on failure, in which case every SPN is decoded */
+bool j1939decode_subscribe(const uint32_t * spns, size_t num_spns, const uint8_t * sas, size_t num_sas);
+
+/* Decode only what changed since the last message of the same PGN from the same source address
+ * Messages whose SPNs all kept their raw value are dropped like unsubscribed ones, and only the SPNs
+ * whose raw value changed are produced otherwise. The first message of each (SA, PGN) pair, any message
+ * with a new DLC and, if heartbeat is positive, the first message at least heartbeat seconds of timestamp
+ * after the last complete one are produced in full. Messages of PGNs not in the database are produced
+ * in full whenever their payload changes. Disabling, or changing the subscription, forgets every payload.
+ * Returns false on failure, in which case every message is produced */
+bool j1939decode_set_change_detection(bool enable, double heartbeat);
+
+/* Cache the unformatted JSON output of up to the given number of distinct messages, zero removes the cache
+ * A message with the same CAN identifier, DLC and payload as a cached one is copied from the cache
+ * instead of being decoded and written again; once full, entries not hit recently are replaced.
+ * The cache is emptied when the profile, field mask or subscription changes, and is bypassed
+ * while change detection is on or the values profile writes timestamps. Hit and miss counts
+ * start over when the cache is set up. Returns false on failure, in which case nothing is cached */
+bool j1939decode_set_cache(size_t entries);
+
+/* Get output cache statistics */
+void j1939decode_get_cache_stats(j1939decode_cache_stats * stats);
+
+/* Write the database metadata of a PGN and its SPNs as unformatted JSON into a caller supplied buffer
+ * Contains the PGN, PGNName and, per SPN, the same metadata fields as the full profile:
+ * {"PGN":65215,"PGNName":"Wheel Speed Information","SPNs":{"904":{"DataRange":"0 to 250.996 km/h",...,"StartBit":0},...}}
+ * Returns the length like j1939decode_to_json_buffer(), or zero if the PGN is not in the database */
+size_t j1939decode_pgn_metadata_json(uint32_t pgn, char * buffer, size_t size);
+
+/* Find every PGN carrying an SPN, in constant time through an index built when the database is loaded
+ * Variable-length SPNs are found too, with J1939DECODE_NO_START_BIT as their start bit
+ * Fills in at most max locations and returns the total number found, zero if the SPN is not in the database */
+size_t j1939decode_spn_locations(uint32_t spn, j1939decode_spn_location * locations, size_t max);
+
+/* Generate SocketCAN filters letting through only the given PGNs, every PGN carrying one of the given SPNs,
+ * and only from the given source addresses if num_sas is not zero. PDU1 PGNs match any destination address.
+ * Filters are merged where this lets nothing else through; if more than max_filters are still needed,
+ * nearby PGNs are merged further so that a few unwanted PGNs get through instead.
+ * Returns the number of filters filled in, zero if there is nothing to let through */
+size_t j1939decode_can_filters(const uint32_t * pgns, size_t num_pgns, const uint32_t * spns, size_t num_spns,
+                               const uint8_t * sas, size_t num_sas,
+                               j1939decode_can_filter * filters, size_t max_filters);
+
+/* Decode j1939 data into a caller supplied struct
+ * No memory is allocated; returns false if the message could not be decoded at all */
+bool j1939decode_to_struct(uint32_t id, uint8_t dlc, const uint64_t * data, j1939decode_msg * msg);
+
+/* Decode an array of j1939 messages into an array of caller supplied structs
+ * ids, dlcs and data are parallel arrays holding count messages, msgs must hold count structs
+ * No memory is allocated; returns the number of structs filled in */
+size_t j1939decode_to_struct_batch(const uint32_t * ids, const uint8_t * dlcs, const uint64_t * data,
+                                   size_t count, j1939decode_msg * msgs);
+
+/* Decode count frames of the same PGN into one column per SPN, for frames already grouped by PGN
+ * data and dlcs are parallel arrays of count entries, DLCs above 8 are taken as 8; the source address is not
+ * looked at, so only the SPN part of a subscription applies. Values are the same as j1939decode_to_struct()
+ * gives, computed one SPN at a time across all frames with SIMD instructions where the CPU has them.
+ * Fills in at most max_columns columns in PGN order and returns the total number of SPNs decoded for the PGN,
+ * zero if the PGN is not in the database */
+size_t j1939decode_to_columns(uint32_t pgn, const uint8_t * dlcs, const uint64_t * data, size_t count,
+                              j1939decode_spn_column * columns, size_t max_columns);
+
+/* Split the ASCII SPNs of a PGN out of a payload of any length, such as a reassembled multi-packet message
+ * Fixed position SPNs with "ASCII" units come first, then the variable-length fields in the order they are sent,
+ * each ended by a '*' delimiter. The payload is walked once and nothing is copied: every string points into it.
+ * Fields missing from the end of the payload are filled in empty and incomplete. The subscription does not apply.
+ * Fills in at most max_strings strings and returns the total number of ASCII SPNs of the PGN,
+ * zero if the PGN is not in the database */
+size_t j1939decode_to_strings(uint32_t pgn, const uint8_t * payload, size_t length,
+                              j1939decode_spn_string * strings, size_t max_strings);
+
+/* Decode the fixed position SPNs of a PGN out of a payload of any length, such as a reassembled multi-packet message
+ * Each SPN is extracted from the bytes it spans, wherever it starts in the payload. Bytes beyond the end read as
+ * zero and an SPN that does not fit in the payload is never valid; values are otherwise the same as
+ * j1939decode_to_struct() gives. The source address is not looked at, so only the SPN part of a subscription applies.
+ * Fills in at most max_values values in PGN order and returns the total number of SPNs decoded for the PGN,
+ * zero if the PGN is not in the database */
+size_t j1939decode_to_values(uint32_t pgn, const uint8_t * payload, size_t length,
+                             j1939decode_spn_value * values, size_t max_values);
+
+/* Create transport protocol reassembler able to track max_sessions sessions at the same time, at most 65536
+ * Everything TP needs is allocated here. ETP buffers grow as packets arrive and are pooled for reuse,
+ * so feeding frames only allocates while the largest ETP messages seen so far grow.
+ * Returns NULL on failure; fn may be NULL to log to stderr */
+j1939decode_tp * j1939decode_tp_create(size_t max_sessions, log_fn_ptr fn);
+
+/* Destroy transport protocol reassembler */
+void j1939decode_tp_destroy(j1939decode_tp * tp);
+
+/* Feed every received frame to the transport protocol reassembler, with its receive time in seconds
+ * Follows broadcast (BAM) and connection mode (RTS/CTS) sessions, and extended transport protocol sessions
+ * of up to J1939DECODE_ETP_MAX_SIZE bytes, any number of them interleaved, keyed by source and destination address.
+ * Returns true and fills in msg when the frame completes a message, which can then be decoded like any other
+ * payload with j1939decode_to_values() and j1939decode_to_strings(). Other frames are ignored. */
+bool j1939decode_tp_feed(j1939decode_tp * tp, uint32_t id, uint8_t dlc, const uint64_t * data, double timestamp,
+                         j1939decode_tp_msg * msg);
+
+/* Get transport protocol statistics */
+void j1939decode_tp_get_stats(const j1939decode_tp * tp, j1939decode_tp_stats * stats);
+
+/* Decode the lamp status and trouble codes of a DM1 or DM2 payload, from a single frame or reassembled by
+ * j1939decode_tp_feed(). Needs no database and allocates nothing. Records with no fault are skipped.
+ * Returns false if the PGN is neither DM1 nor DM2 or the payload is too short for the lamp status */
+bool j1939decode_dm_decode(uint32_t pgn, uint8_t sa, const uint8_t * payload, size_t length, j1939decode_dm_msg * msg);
+
+/* Create active fault table, empty for every source address. Returns NULL on failure; fn may be NULL to log to stderr */
+j1939decode_dm_table * j1939decode_dm_table_create(log_fn_ptr fn);
+
+/* Destroy active fault table */
+void j1939decode_dm_table_destroy(j1939decode_dm_table * table);
+
+/* Replace the active faults of the source address of a decoded DM1 with the ones it carries
+ * Reports only what changed: faults not active before are set, faults no longer sent are cleared,
+ * in SPN and FMI order. DM2 messages change nothing. Fills in at most max_events events and returns
+ * the total number of faults set or cleared; the table is updated even if they did not all fit */
+size_t j1939decode_dm_table_update(j1939decode_dm_table * table, const j1939decode_dm_msg * msg,
+                                   j1939decode_dm_event * events, size_t max_events);
+
+/* Get the active faults of a source address in SPN and FMI order
+ * Fills in at most max_dtcs trouble codes and returns the total number of active faults */
+size_t j1939decode_dm_table_get(const j1939decode_dm_table * table, uint8_t sa, j1939decode_dtc * dtcs,
+                                size_t max_dtcs);
+
+/* Reentrant API
+ * The functions above all use a single default context and database set up by j1939decode_init().
+ * The functions below take an explicit context instead, so several decoders can run
+ * concurrently without locks as long as each thread uses its own context. */
+
+/* Load J1939 database from a JSON file or binary image
+ * NULL filename loads the default database (J1939DECODE_DB, or the embedded database if built in)
+ * Returns NULL on failure; log_fn may be NULL to log to stderr */
+j1939decode_db * j1939decode_db_load(const char * filename, log_fn_ptr fn);
+
+/* Free J1939 database
+ * Every context using the database must be destroyed first */
+void j1939decode_db_free(j1939decode_db * db);
+
+/* Database variants of j1939decode_spn_locations() and j1939decode_can_filters() */
+size_t j1939decode_db_spn_locations(const j1939decode_db * db, uint32_t spn,
+                                    j1939decode_spn_location * locations, size_t max);
+size_t j1939decode_db_can_filters(const j1939decode_db * db, const uint32_t * pgns, size_t num_pgns,
+                                  const uint32_t * spns, size_t num_spns, const uint8_t * sas, size_t num_sas,
+                                  j1939decode_can_filter * filters, size_t max_filters);
+
+/* Create decoder context using a loaded database
+ * The context logs to the handler the database was loaded with until changed
+ * Returns NULL on failure */
+j1939decode_ctx * j1939decode_ctx_create(const j1939decode_db * db);
+
+/* Destroy decoder context, the database is left untouched */
+void j1939decode_ctx_destroy(j1939decode_ctx * ctx);
+
+/* Set log function handler of a context, NULL logs to stderr */
+void j1939decode_ctx_set_log_fn(j1939decode_ctx * ctx, log_fn_ptr fn);
+
+/* Switch a context to the thread-safe JSON mode, with its own output arena of the given initial size
+ * j1939decode_ctx_to_json() then builds the JSON tree and string in the arena instead of the heap.
+ * The returned string belongs to the context: do NOT free it, it stays valid until the next call.
+ * The first arena set up replaces the global cJSON allocator hooks with ones that fall back to malloc/free.
+ * Zero frees the arena and leaves the mode */
+bool j1939decode_ctx_set_arena(j1939decode_ctx * ctx, size_t size);
+
+/* Context variants of the functions above, with identical output */
+void j1939decode_ctx_set_profile(j1939decode_ctx * ctx, j1939decode_profile profile);
+void j1939decode_ctx_set_timestamp(j1939decode_ctx * ctx, double timestamp);
+void j1939decode_ctx_set_fields(j1939decode_ctx * ctx, uint32_t fields);
+bool j1939decode_ctx_subscribe(j1939decode_ctx * ctx, const uint32_t * spns, size_t num_spns,
+                               const uint8_t * sas, size_t num_sas);
+bool j1939decode_ctx_set_change_detection(j1939decode_ctx * ctx, bool enable, double heartbeat);
+bool j1939decode_ctx_set_cache(j1939decode_ctx * ctx, size_t entries);
+void j1939decode_ctx_get_cache_stats(const j1939decode_ctx * ctx, j1939decode_cache_stats * stats);
+size_t j1939decode_ctx_pgn_metadata_json(j1939decode_ctx * ctx, uint32_t pgn, char * buffer, size_t size);
+char * j1939decode_ctx_to_json(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data, bool pretty);
+size_t j1939decode_ctx_to_json_buffer(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                                      char * buffer, size_t size);
+bool j1939decode_ctx_to_struct(j1939decode_ctx * ctx, uint32_t id, uint8_t dlc, const uint64_t * data,
+                               j1939decode_msg * msg);
+size_t j1939decode_ctx_to_struct_batch(j1939decode_ctx * ctx, const uint32_t * ids, const uint8_t * dlcs,
+                                       const uint64_t * data, size_t count, j1939decode_msg * msgs);
+size_t j1939decode_ctx_to_columns(j1939decode_ctx * ctx, uint32_t pgn, const uint8_t * dlcs, const uint64_t * data,
+                                  size_t count, j1939decode_spn_column * columns, size_t max_columns);
+size_t j1939decode_ctx_to_strings(j1939decode_ctx * ctx, uint32_t pgn, const uint8_t * payload, size_t length,
+                                  j1939decode_spn_string * strings, size_t max_strings);
+size_t j1939decode_ctx_to_values(j1939decode_ctx * ctx, uint32_t pgn, const uint8_t * payload, size_t length,
+                                 j1939decode_spn_value * values, size_t max_values);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "j1939decode.h"
+#include "j1939db.h"
+
+/* Diagnostic message decoding
+ * DM1 (active) and DM2 (previously active) carry the lamp status in their first two bytes,
+ * followed by one four-byte record per diagnostic trouble code. Both are parsed straight into
+ * fixed structs without going through the database. The active fault table keeps the DM1
+ * faults of every source address sorted by SPN and FMI, so each new DM1 is compared with the
+ * last one from the same address in a single merge, and only the differences are reported. */
+
+/* Diagnostic message PGNs */
+#define DM1_PGN 65226U
+#define DM2_PGN 65227U
+
+/* Bytes of lamp status before the first trouble code, and bytes per trouble code */
+#define DM_LAMP_SIZE 2U
+#define DM_DTC_SIZE 4U
+
+/* SPN of the all-zero record sent when there is no fault, and of the all-ones padding */
+#define DM_SPN_NONE 0U
+#define DM_SPN_NOT_AVAILABLE 0x7FFFFU
+
+/* Fault lists start at this capacity and double from there */
+#define DM_MIN_FAULTS 8U
+
+/* Active fault, ordered by SPN then FMI */
+typedef struct
+{
+    /* SPN in the upper bits, FMI in the lower 5 bits */
+    uint32_t key;
+    uint8_t oc;
+} dm_fault;
+
+/* Active faults of one source address, sorted by key */
+typedef struct
+{
+    dm_fault * faults;
+    size_t num_faults;
+    size_t capacity;
+} dm_faults;
+
+/* Backs the opaque j1939decode_dm_table handle of the public API */
+struct j1939decode_dm_table
+{
+    dm_faults sas[256];
+    /* Faults of the message being compared, sorted by key */
+    dm_fault scratch[J1939DECODE_MAX_DTCS];
+    log_fn_ptr log_fn;
+};
+
+static void log_msg(log_fn_ptr fn, const char * fmt, ...);
+static size_t sort_faults(const j1939decode_dm_msg * msg, dm_fault * faults);
+static void add_event(j1939decode_dm_event * events, size_t max_events, size_t * num_events, uint8_t sa,
+                      const dm_fault * fault, bool active);
+
+/* Fault key of an SPN and FMI, in the order faults are kept */
+static inline uint32_t get_key(uint32_t spn, uint8_t fmi)
+{
+    return (spn << 5U) | fmi;
+}
+
+/**************************************************************************//**
+
+  \brief Log formatted message
+
+  \param fn     log handler, or NULL to log to stderr
+  \param fmt    format string
+
+  \return void
+
+******************************************************************************/
+void log_msg(log_fn_ptr fn, const char * fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    j1939decode_vlog(fn, fmt, args);
+    va_end(args);
+}
+
+/**************************************************************************//**
+
+  \brief Decode a DM1 or DM2 payload into lamp status and trouble codes
+
+  Trouble codes are read as the SPN conversion method of J1939-73 version 4.
+  The all-zero record sent when there is no fault and the all-ones padding
+  of single frame messages are skipped.
+
+  \param pgn        parameter group number of the payload
+  \param sa         source address the payload came from
+  \param payload    pointer to the payload
+  \param length     length of the payload in bytes
+  \param msg        pointer to the diagnostic message to fill in
+
+  \return bool      boolean indicating if the payload is a DM1 or DM2 message
+
+******************************************************************************/
+bool j1939decode_dm_decode(uint32_t pgn, uint8_t sa, const uint8_t * payload, size_t length, j1939decode_dm_msg * msg)
+{
+    if ((pgn != DM1_PGN && pgn != DM2_PGN) || length < DM_LAMP_SIZE)
+    {
+        return false;
+    }
+
+    msg->pgn = pgn;
+    msg->sa = sa;
+
+    /* Two bits per lamp, from the most significant bits down */
+    for (size_t i = 0; i < J1939DECODE_NUM_LAMPS; i++)
+    {
+        msg->lamps[i] = (uint8_t) ((payload[0] >> (6U - 2U * i)) & 0x03U);
+        msg->flash[i] = (uint8_t) ((payload[1] >> (6U - 2U * i)) & 0x03U);
+    }
+
+    msg->num_dtcs = 0;
+    for (size_t offset = DM_LAMP_SIZE; offset + DM_DTC_SIZE <= length &&
+                                       msg->num_dtcs < J1939DECODE_MAX_DTCS; offset += DM_DTC_SIZE)
+    {
+        const uint8_t * record = &payload[offset];
+        uint32_t spn = record[0] | ((uint32_t) record[1] << 8U) | ((uint32_t) (record[2] & 0xE0U) << 11U);
+        if (spn == DM_SPN_NONE || spn == DM_SPN_NOT_AVAILABLE)
+        {
+            continue;
+        }
+
+        j1939decode_dtc * dtc = &msg->dtcs[msg->num_dtcs++];
+        dtc->spn = spn;
+        dtc->fmi = record[2] & 0x1FU;
+        dtc->oc = record[3] & 0x7FU;
+    }
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Create active fault table
+
+  \param fn     log handler, or NULL to log to stderr
+
+  \return j1939decode_dm_table *  pointer to the table, or NULL on failure
+
+******************************************************************************/
+j1939decode_dm_table * j1939decode_dm_table_create(log_fn_ptr fn)
+{
+    j1939decode_dm_table * table = calloc(1, sizeof(j1939decode_dm_table));
+    if (table == NULL)
+    {
+        log_msg(fn, "Memory allocation failure");
+        return NULL;
+    }
+
+    table->log_fn = fn;
+
+    return table;
+}
+
+/**************************************************************************//**
+
+  \brief Destroy active fault table
+
+  \param table  pointer to the table
+
+  \return void
+
+******************************************************************************/
+void j1939decode_dm_table_destroy(j1939decode_dm_table * table)
+{
+    if (table == NULL)
+    {
+        return;
+    }
+
+    for (size_t sa = 0; sa < 256; sa++)
+    {
+        free(table->sas[sa].faults);
+    }
+    free(table);
+}
+
+/**************************************************************************//**
+
+  \brief Update the active faults of a source address from its latest DM1
+
+  The faults of the message are sorted and merged against the ones held for
+  its source address, reporting faults that appeared as set and faults that
+  are gone as cleared. Occurrence counts are kept up to date without events.
+  DM2 messages report previously active faults and leave the table alone.
+
+  \param table      pointer to the table
+  \param msg        pointer to the decoded diagnostic message
+  \param events     pointer to array of events to fill in
+  \param max_events number of events the array holds
+
+  \return size_t    number of faults set or cleared by the message
+
+******************************************************************************/
+size_t j1939decode_dm_table_update(j1939decode_dm_table * table, const j1939decode_dm_msg * msg,
+                                   j1939decode_dm_event * events, size_t max_events)
+{
+    if (msg->pgn != DM1_PGN)
+    {
+        return 0;
+    }
+
+    dm_faults * held = &table->sas[msg->sa];
+    dm_fault * incoming = table->scratch;
+    size_t num_incoming = sort_faults(msg, incoming);
+
+    if (num_incoming > held->capacity)
+    {
+        size_t capacity = held->capacity > 0 ? held->capacity : DM_MIN_FAULTS;
+        while (capacity < num_incoming)
+        {
+            capacity *= 2U;
+        }
+
+        dm_fault * faults = realloc(held->faults, capacity * sizeof(dm_fault));
+        if (faults == NULL)
+        {
+            /* Faults held so far stay as they were, and are compared again with the next message */
+            log_msg(table->log_fn, "Memory allocation failure");
+            return 0;
+        }
+        held->faults = faults;
+        held->capacity = capacity;
+    }
+
+    size_t num_events = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < held->num_faults || j < num_incoming)
+    {
+        if (j == num_incoming || (i < held->num_faults && held->faults[i].key < incoming[j].key))
+        {
+            add_event(events, max_events, &num_events, msg->sa, &held->faults[i++], false);
+        }
+        else if (i == held->num_faults || incoming[j].key < held->faults[i].key)
+        {
+            add_event(events, max_events, &num_events, msg->sa, &incoming[j++], true);
+        }
+        else
+        {
+            i++;
+            j++;
+        }
+    }
+
+    memcpy(held->faults, incoming, num_incoming * sizeof(dm_fault));
+    held->num_faults = num_incoming;
+
+    return num_events;
+}
+
+/**************************************************************************//**
+
+  \brief Get the active faults of a source address
+
+  \param table      pointer to the table
+  \param sa         source address
+  \param dtcs       pointer to array of trouble codes to fill in, in SPN and FMI order
+  \param max_dtcs   number of trouble codes the array holds
+
+  \return size_t    number of active faults of the source address
+
+******************************************************************************/
+size_t j1939decode_dm_table_get(const j1939decode_dm_table * table, uint8_t sa, j1939decode_dtc * dtcs,
+                                size_t max_dtcs)
+{
+    const dm_faults * held = &table->sas[sa];
+
+    for (size_t i = 0; i < held->num_faults && i < max_dtcs; i++)
+    {
+        dtcs[i].spn = held->faults[i].key >> 5U;
+        dtcs[i].fmi = (uint8_t) (held->faults[i].key & 0x1FU);
+        dtcs[i].oc = held->faults[i].oc;
+    }
+
+    return held->num_faults;
+}
+
+/**************************************************************************//**
+
+  \brief Sort the trouble codes of a message by SPN and FMI
+
+  Messages carry a handful of faults at most, so insertion sort is the quickest.
+  A fault sent more than once is kept once, with its last occurrence count.
+
+  \param msg        pointer to the decoded diagnostic message
+  \param faults     pointer to array of faults to fill in
+
+  \return size_t    number of distinct faults
+
+******************************************************************************/
+size_t sort_faults(const j1939decode_dm_msg * msg, dm_fault * faults)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < msg->num_dtcs; i++)
+    {
+        dm_fault fault = {get_key(msg->dtcs[i].spn, msg->dtcs[i].fmi), msg->dtcs[i].oc};
+
+        size_t j = count;
+        while (j > 0 && faults[j - 1].key > fault.key)
+        {
+            j--;
+        }
+
+        if (j > 0 && faults[j - 1].key == fault.key)
+        {
+            faults[j - 1].oc = fault.oc;
+            continue;
+        }
+
+        memmove(&faults[j + 1], &faults[j], (count - j) * sizeof(dm_fault));
+        faults[j] = fault;
+        count++;
+    }
+
+    return count;
+}
+
+/**************************************************************************//**
+
+  \brief Report a fault set or cleared
+
+  \param events     pointer to array of events to fill in
+  \param max_events number of events the array holds
+  \param num_events pointer to the number of events so far, counting those that did not fit
+  \param sa         source address of the fault
+  \param fault      pointer to the fault
+  \param active     true if the fault was set, false if it was cleared
+
+  \return void
+
+******************************************************************************/
+void add_event(j1939decode_dm_event * events, size_t max_events, size_t * num_events, uint8_t sa,
+               const dm_fault * fault, bool active)
+{
+    if (*num_events < max_events)
+    {
+        j1939decode_dm_event * event = &events[*num_events];
+        event->sa = sa;
+        event->active = active;
+        event->dtc.spn = fault->key >> 5U;
+        event->dtc.fmi = (uint8_t) (fault->key & 0x1FU);
+        event->dtc.oc = fault->oc;
+    }
+    (*num_events)++;
+}
@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "j1939decode.h"
+#include "j1939db.h"
+
+/* SocketCAN filter generation
+ * A set of PGNs and source addresses is turned into value and care mask terms,
+ * one per field, that are merged into as few terms as possible and then
+ * multiplied out into CAN identifier and mask pairs. */
+
+/* Bits of the PGN and source address fields */
+#define PGN_BITS 18U
+#define SA_BITS 8U
+
+/* Care mask of a PDU2 PGN, and of a PDU1 PGN whose PS field is the destination address */
+#define PGN_CARE_PDU2 ((1UL << PGN_BITS) - 1)
+#define PGN_CARE_PDU1 (PGN_CARE_PDU2 & ~0xFFUL)
+#define SA_CARE ((1UL << SA_BITS) - 1)
+
+/* Set of field values matched by value, only comparing the bits set in care */
+typedef struct
+{
+    uint32_t value;
+    uint32_t care;
+} filter_term;
+
+static void log_msg(log_fn_ptr fn, const char * fmt, ...);
+static unsigned int count_bits(uint32_t x);
+static bool term_covers(const filter_term * a, const filter_term * b);
+static size_t merge_terms(filter_term * terms, size_t count);
+static size_t reduce_terms(filter_term * terms, size_t count, size_t max, unsigned int bits);
+static filter_term pgn_term(uint32_t pgn);
+
+/**************************************************************************//**
+
+  \brief Log formatted message
+
+  \param fn     log handler, or NULL to log to stderr
+  \param fmt    format string
+
+  \return void
+
+******************************************************************************/
+void log_msg(log_fn_ptr fn, const char * fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    j1939decode_vlog(fn, fmt, args);
+    va_end(args);
+}
+
+/**************************************************************************//**
+
+  \brief Count set bits
+
+  \param x      value
+
+  \return unsigned int  number of bits set in x
+
+******************************************************************************/
+unsigned int count_bits(uint32_t x)
+{
+    unsigned int count = 0;
+    for (; x != 0; x &= x - 1)
+    {
+        count++;
+    }
+    return count;
+}
+
+/**************************************************************************//**
+
+  \brief Check if a term matches every value another term matches
+
+  \param a      pointer to the covering term
+  \param b      pointer to the covered term
+
+  \return bool  boolean indicating if a covers b
+
+******************************************************************************/
+bool term_covers(const filter_term * a, const filter_term * b)
+{
+    return (a->care & ~b->care) == 0 && (b->value & a->care) == a->value;
+}
+
+/**************************************************************************//**
+
+  \brief Merge terms without matching any value not matched before
+
+  Two terms with the same care mask whose values differ in a single bit are
+  replaced by one term not caring about that bit, and terms covered by
+  another term are dropped, until nothing changes.
+
+  \param terms  pointer to array of terms, merged in place
+  \param count  number of terms
+
+  \return size_t    number of terms left
+
+******************************************************************************/
+size_t merge_terms(filter_term * terms, size_t count)
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t j = 0;
+            while (j < count)
+            {
+                uint32_t diff = (terms[i].value ^ terms[j].value) & terms[i].care;
+
+                if (j != i && terms[i].care == terms[j].care && count_bits(diff) == 1)
+                {
+                    terms[i].care &= ~diff;
+                    terms[i].value &= terms[i].care;
+                }
+                else if (j == i || !term_covers(&terms[i], &terms[j]))
+                {
+                    j++;
+                    continue;
+                }
+
+                /* Term j is covered by term i, replace it with the last term and look at that next */
+                terms[j] = terms[--count];
+                if (i == count)
+                {
+                    i = j;
+                }
+                changed = true;
+            }
+        }
+    }
+
+    return count;
+}
+
+/**************************************************************************//**
+
+  \brief Merge terms, matching more values than asked for, until at most max are left
+
+  The pair of terms merged next is the one that adds the fewest values
+  to the set matched, so nearby PGNs are merged first.
+
+  \param terms  pointer to array of terms, merged in place
+  \param count  number of terms
+  \param max    largest number of terms wanted, at least one
+  \param bits   number of bits in the field
+
+  \return size_t    number of terms left
+
+******************************************************************************/
+size_t reduce_terms(filter_term * terms, size_t count, size_t max, unsigned int bits)
+{
+    while (count > max)
+    {
+        size_t best_i = 0;
+        size_t best_j = 1;
+        int64_t best_cost = INT64_MAX;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            for (size_t j = i + 1; j < count; j++)
+            {
+                uint32_t care = terms[i].care & terms[j].care & ~(terms[i].value ^ terms[j].value);
+                /* Number of values matched by the merged term and not by either term, ignoring overlaps */
+                int64_t cost = (INT64_C(1) << (bits - count_bits(care))) -
+                               (INT64_C(1) << (bits - count_bits(terms[i].care))) -
+                               (INT64_C(1) << (bits - count_bits(terms[j].care)));
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+        }
+
+        terms[best_i].care &= terms[best_j].care & ~(terms[best_i].value ^ terms[best_j].value);
+        terms[best_i].value &= terms[best_i].care;
+        terms[best_j] = terms[--count];
+
+        count = merge_terms(terms, count);
+    }
+
+    return count;
+}
+
+/**************************************************************************//**
+
+  \brief Get the term matching every CAN identifier PGN field of a PGN
+
+  \param pgn    parameter group number
+
+  \return filter_term   term matching the PGN, with any destination address for PDU1 PGNs
+
+******************************************************************************/
+filter_term pgn_term(uint32_t pgn)
+{
+    filter_term term;
+
+    /* PDU1 format (PF below 240) carries the destination address in the PS field */
+    term.care = ((pgn >> 8U) & 0xFFU) < 240U ? PGN_CARE_PDU1 : PGN_CARE_PDU2;
+    term.value = pgn & term.care;
+
+    return term;
+}
+
+/**************************************************************************//**
+
+  \brief Generate SocketCAN filters for a set of PGNs, SPNs and source addresses
+
+  Every PGN carrying one of the SPNs is added to the PGNs given. The PGNs and
+  source addresses are merged into as few terms as possible without letting
+  anything else through; if that still takes more than max_filters filters,
+  the closest PGNs are merged further at the cost of letting some other PGNs through.
+
+  \param db             pointer to a loaded database
+  \param pgns           pointer to array of PGNs, may be NULL if num_pgns is zero
+  \param num_pgns       number of PGNs
+  \param spns           pointer to array of SPNs, may be NULL if num_spns is zero
+  \param num_spns       number of SPNs
+  \param sas            pointer to array of source addresses, may be NULL if num_sas is zero
+  \param num_sas        number of source addresses, or zero for any source address
+  \param filters        pointer to array of filters to fill in
+  \param max_filters    number of filters the array holds
+
+  \return size_t        number of filters filled in, zero if nothing is subscribed or on failure
+
+******************************************************************************/
+size_t j1939decode_db_can_filters(const j1939decode_db * db, const uint32_t * pgns, size_t num_pgns,
+                                  const uint32_t * spns, size_t num_spns, const uint8_t * sas, size_t num_sas,
+                                  j1939decode_can_filter * filters, size_t max_filters)
+{
+    filter_term * pgn_terms = NULL;
+    filter_term * sa_terms = NULL;
+    size_t num_filters = 0;
+
+    if (max_filters == 0)
+    {
+        return 0;
+    }
+
+    /* Every place each SPN is carried, on top of the PGNs given */
+    size_t max_pgn_terms = num_pgns;
+    for (size_t i = 0; i < num_spns; i++)
+    {
+        const j1939db_spn_ref * refs;
+        max_pgn_terms += j1939db_find_spn(db, spns[i], &refs);
+    }
+
+    pgn_terms = malloc((max_pgn_terms > 0 ? max_pgn_terms : 1) * sizeof(filter_term));
+    sa_terms = malloc((num_sas > 0 ? num_sas : 1) * sizeof(filter_term));
+    if (pgn_terms == NULL || sa_terms == NULL)
+    {
+        log_msg(db->log_fn, "Memory allocation failure");
+        goto cleanup;
+    }
+
+    size_t num_pgn_terms = 0;
+    for (size_t i = 0; i < num_pgns; i++)
+    {
+        pgn_terms[num_pgn_terms++] = pgn_term(pgns[i]);
+    }
+    for (size_t i = 0; i < num_spns; i++)
+    {
+        const j1939db_spn_ref * refs;
+        size_t num_refs = j1939db_find_spn(db, spns[i], &refs);
+        if (num_refs == 0)
+        {
+            log_msg(db->log_fn, "SPN %u not found in database", spns[i]);
+        }
+
+        for (size_t j = 0; j < num_refs; j++)
+        {
+            pgn_terms[num_pgn_terms++] = pgn_term(db->pgns[refs[j].pgn].pgn);
+        }
+    }
+
+    if (num_pgn_terms == 0)
+    {
+        goto cleanup;
+    }
+
+    /* No source addresses given matches any source address */
+    size_t num_sa_terms = num_sas > 0 ? num_sas : 1;
+    for (size_t i = 0; i < num_sas; i++)
+    {
+        sa_terms[i].value = sas[i];
+        sa_terms[i].care = SA_CARE;
+    }
+    if (num_sas == 0)
+    {
+        sa_terms[0].value = 0;
+        sa_terms[0].care = 0;
+    }
+
+    num_pgn_terms = merge_terms(pgn_terms, num_pgn_terms);
+    num_sa_terms = merge_terms(sa_terms, num_sa_terms);
+
+    /* Every PGN term is paired with every source address term, trade precision for space if needed */
+    num_sa_terms = reduce_terms(sa_terms, num_sa_terms, max_filters, SA_BITS);
+    num_pgn_terms = reduce_terms(pgn_terms, num_pgn_terms, max_filters / num_sa_terms, PGN_BITS);
+
+    for (size_t i = 0; i < num_pgn_terms; i++)
+    {
+        for (size_t j = 0; j < num_sa_terms; j++)
+        {
+            j1939decode_can_filter * filter = &filters[num_filters++];
+            filter->can_id = J1939DECODE_CAN_EFF_FLAG | (pgn_terms[i].value << 8U) | sa_terms[j].value;
+            filter->can_mask = J1939DECODE_CAN_EFF_FLAG | (pgn_terms[i].care << 8U) | sa_terms[j].care;
+        }
+    }
+
+    cleanup:
+    free(sa_terms);
+    free(pgn_terms);
+    return num_filters;
+}
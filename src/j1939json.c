@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "j1939json.h"
+
+/* Largest magnitude for which "%1.15g" prints an integral value as plain digits */
+#define J1939JSON_MAX_PLAIN_INTEGER 1e15
+/* Smallest magnitude for which "%1.15g" does not switch to an exponent */
+#define J1939JSON_MIN_PLAIN_DECIMAL 1e-4
+/* Most decimal places tried before falling back to printf */
+#define J1939JSON_MAX_DECIMALS 9
+
+/* Powers of ten up to J1939JSON_MAX_DECIMALS, all exactly representable */
+static const double powers_of_ten[J1939JSON_MAX_DECIMALS + 1] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+};
+
+static size_t write_digits(char * end, unsigned long long value, size_t min_digits);
+
+/**************************************************************************//**
+
+  \brief Start writing JSON into a buffer
+
+  \param writer     pointer to the writer
+  \param buffer     pointer to the output buffer, may be NULL if size is zero
+  \param size       size of the output buffer in bytes, including the terminator
+
+  \return void
+
+******************************************************************************/
+void j1939json_init(j1939json_writer * writer, char * buffer, size_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+}
+
+/**************************************************************************//**
+
+  \brief Write characters without escaping
+
+  Characters that do not fit in the buffer are counted but dropped.
+
+  \param writer     pointer to the writer
+  \param str        pointer to the characters
+  \param length     number of characters
+
+  \return void
+
+******************************************************************************/
+void j1939json_write_raw(j1939json_writer * writer, const char * str, size_t length)
+{
+    if (writer->length < writer->size)
+    {
+        size_t space = writer->size - writer->length;
+        memcpy(writer->buffer + writer->length, str, length < space ? length : space);
+    }
+
+    writer->length += length;
+}
+
+/**************************************************************************//**
+
+  \brief Write a quoted string, escaped the same way as cJSON
+
+  \param writer     pointer to the writer
+  \param str        pointer to the string
+
+  \return void
+
+******************************************************************************/
+void j1939json_write_string(j1939json_writer * writer, const char * str)
+{
+    const unsigned char * input = (const unsigned char *) str;
+    size_t length = 0;
+    bool escape = false;
+
+    for (length = 0; input[length] != '\0'; length++)
+    {
+        if (input[length] < 32 || input[length] == '\"' || input[length] == '\\')
+        {
+            escape = true;
+        }
+    }
+
+    J1939JSON_WRITE_LITERAL(writer, "\"");
+
+    if (!escape)
+    {
+        /* Common case, nothing has to be escaped */
+        j1939json_write_raw(writer, str, length);
+    }
+    else
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            char escaped[8];
+
+            switch (input[i])
+            {
+                case '\\':
+                    J1939JSON_WRITE_LITERAL(writer, "\\\\");
+                    break;
+                case '\"':
+                    J1939JSON_WRITE_LITERAL(writer, "\\\"");
+                    break;
+                case '\b':
+                    J1939JSON_WRITE_LITERAL(writer, "\\b");
+                    break;
+                case '\f':
+                    J1939JSON_WRITE_LITERAL(writer, "\\f");
+                    break;
+                case '\n':
+                    J1939JSON_WRITE_LITERAL(writer, "\\n");
+                    break;
+                case '\r':
+                    J1939JSON_WRITE_LITERAL(writer, "\\r");
+                    break;
+                case '\t':
+                    J1939JSON_WRITE_LITERAL(writer, "\\t");
+                    break;
+                default:
+                    if (input[i] < 32)
+                    {
+                        /* Escape as unicode codepoint */
+                        j1939json_write_raw(writer, escaped, (size_t) sprintf(escaped, "\\u%04x", input[i]));
+                    }
+                    else
+                    {
+                        j1939json_write_raw(writer, &str[i], 1);
+                    }
+                    break;
+            }
+        }
+    }
+
+    J1939JSON_WRITE_LITERAL(writer, "\"");
+}
+
+/**************************************************************************//**
+
+  \brief Write a number, formatted the same way as cJSON
+
+  \param writer     pointer to the writer
+  \param number     number to write
+
+  \return void
+
+******************************************************************************/
+void j1939json_write_number(j1939json_writer * writer, double number)
+{
+    char buffer[26];
+    int length = 0;
+
+    if ((number * 0) != 0)
+    {
+        /* NaN and infinity */
+        J1939JSON_WRITE_LITERAL(writer, "null");
+        return;
+    }
+
+    double magnitude = number < 0 ? -number : number;
+    char * end = buffer + sizeof(buffer);
+
+    if (magnitude < J1939JSON_MAX_PLAIN_INTEGER && (double) (long long) number == number &&
+        !(number == 0 && signbit(number)))
+    {
+        /* Integral values, most of the output, are printed without going through printf */
+        length = (int) write_digits(end, (unsigned long long) magnitude, 1);
+        if (number < 0)
+        {
+            buffer[sizeof(buffer) - ++length] = '-';
+        }
+
+        j1939json_write_raw(writer, end - length, (size_t) length);
+        return;
+    }
+
+    if (magnitude >= J1939JSON_MIN_PLAIN_DECIMAL && magnitude < J1939JSON_MAX_PLAIN_INTEGER)
+    {
+        /* Decimals with few places, such as scaled sensor values and timestamps
+         * If the nearest double to n / 10^k is the number itself, "%1.15g" prints exactly n / 10^k,
+         * which reads back to the same number, so printf can be skipped */
+        for (int places = 1; places <= J1939JSON_MAX_DECIMALS; places++)
+        {
+            double scaled = magnitude * powers_of_ten[places];
+            if (scaled >= J1939JSON_MAX_PLAIN_INTEGER)
+            {
+                break;
+            }
+
+            unsigned long long digits = (unsigned long long) (scaled + 0.5);
+            if ((double) digits / powers_of_ten[places] == magnitude)
+            {
+                unsigned long long integer = digits / (unsigned long long) powers_of_ten[places];
+                unsigned long long fraction = digits % (unsigned long long) powers_of_ten[places];
+
+                length = (int) write_digits(end, fraction, (size_t) places);
+                buffer[sizeof(buffer) - ++length] = '.';
+                length += (int) write_digits(end - length, integer, 1);
+                if (number < 0)
+                {
+                    buffer[sizeof(buffer) - ++length] = '-';
+                }
+
+                j1939json_write_raw(writer, end - length, (size_t) length);
+                return;
+            }
+        }
+    }
+
+    /* Try 15 decimal places of precision to avoid nonsignificant nonzero digits */
+    length = snprintf(buffer, sizeof(buffer), "%1.15g", number);
+
+    /* Check whether the original double can be recovered, if not use 17 decimal places */
+    if (strtod(buffer, NULL) != number)
+    {
+        length = snprintf(buffer, sizeof(buffer), "%1.17g", number);
+    }
+
+    if (length > 0)
+    {
+        j1939json_write_raw(writer, buffer, (size_t) length);
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Write decimal digits backwards, ending just before end
+
+  \param end            pointer one past the last digit
+  \param value          value to write
+  \param min_digits     number of digits to pad to with leading zeros
+
+  \return size_t        number of digits written
+
+******************************************************************************/
+size_t write_digits(char * end, unsigned long long value, size_t min_digits)
+{
+    char * digits = end;
+
+    do
+    {
+        *--digits = (char) ('0' + value % 10U);
+        value /= 10U;
+    } while (value != 0 || (size_t) (end - digits) < min_digits);
+
+    return (size_t) (end - digits);
+}
+
+/**************************************************************************//**
+
+  \brief Write a boolean
+
+  \param writer     pointer to the writer
+  \param value      boolean to write
+
+  \return void
+
+******************************************************************************/
+void j1939json_write_bool(j1939json_writer * writer, bool value)
+{
+    if (value)
+    {
+        J1939JSON_WRITE_LITERAL(writer, "true");
+    }
+    else
+    {
+        J1939JSON_WRITE_LITERAL(writer, "false");
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Terminate the output
+
+  If the output did not fit, it is truncated to size - 1 characters.
+
+  \param writer     pointer to the writer
+
+  \return size_t    length of the complete output, excluding the terminator
+
+******************************************************************************/
+size_t j1939json_finish(j1939json_writer * writer)
+{
+    if (writer->size > 0)
+    {
+        writer->buffer[writer->length < writer->size ? writer->length : writer->size - 1] = '\0';
+    }
+
+    return writer->length;
+}
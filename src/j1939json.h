@@ -0,0 +1,48 @@
+#ifndef J1939JSON_H
+#define J1939JSON_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Streaming JSON writer
+ * Internal to the library, writes the same text cJSON_PrintUnformatted() would print
+ * for the same values, straight into a fixed size buffer */
+
+typedef struct
+{
+    char * buffer;
+    size_t size;
+    /* Length of the complete output so far, which may be more than fits in the buffer */
+    size_t length;
+} j1939json_writer;
+
+/* Write a string literal without escaping */
+#define J1939JSON_WRITE_LITERAL(writer, literal) j1939json_write_raw((writer), (literal), sizeof(literal) - 1)
+
+/* Start writing into buffer, which may be NULL if size is zero */
+void j1939json_init(j1939json_writer * writer, char * buffer, size_t size);
+
+/* Write characters without escaping */
+void j1939json_write_raw(j1939json_writer * writer, const char * str, size_t length);
+
+/* Write a quoted and escaped string */
+void j1939json_write_string(j1939json_writer * writer, const char * str);
+
+/* Write a number */
+void j1939json_write_number(j1939json_writer * writer, double number);
+
+/* Write true or false */
+void j1939json_write_bool(j1939json_writer * writer, bool value);
+
+/* Terminate the output, truncating it if needed, and return the length of the complete output */
+size_t j1939json_finish(j1939json_writer * writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //J1939JSON_H
@@ -0,0 +1,877 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "j1939decode.h"
+#include "j1939db.h"
+
+/* Transport protocol reassembly
+ * Every session lives in a table allocated up front with a full-size payload buffer, and is
+ * found through a hash table keyed by source and destination address, so reassembling
+ * any mix of interleaved sessions allocates nothing. Data transfer frames carry no PGN,
+ * and J1939-21 allows one session at a time in each direction between two addresses,
+ * so the addresses alone identify the session a frame belongs to.
+ * Sessions also sit on one list per timeout, in the order they were last
+ * heard from, so the overdue ones are always at the head of their list.
+ * Extended transport protocol (ETP) sessions are keyed apart from TP sessions between the same
+ * addresses. Their payloads are too large to hold up front, so they go into buffers that grow
+ * as packets arrive and are kept in a pool for the next ETP session once the message is done. */
+
+/* PDU format of the connection management and data transfer PGNs */
+#define TP_CM_PF 0xECU
+#define TP_DT_PF 0xEBU
+#define ETP_CM_PF 0xC8U
+#define ETP_DT_PF 0xC7U
+
+/* Connection management control bytes */
+#define TP_CM_RTS 16U
+#define TP_CM_CTS 17U
+#define TP_CM_BAM 32U
+#define TP_CM_ABORT 255U
+#define ETP_CM_RTS 20U
+#define ETP_CM_CTS 21U
+#define ETP_CM_DPO 22U
+
+/* Data bytes carried by each data transfer frame */
+#define TP_PACKET_SIZE 7U
+
+/* Receiver timeouts in seconds from J1939-21: T1 between broadcast packets,
+ * and the longest of T2 and T3 for every wait of a connection mode transfer */
+#define TP_TIMEOUT_BAM 0.75
+#define TP_TIMEOUT_CONNECTION 1.25
+
+/* Hash slots per session, keeps the hash table at most half full */
+#define TP_SLOTS_PER_SESSION 2U
+/* Sessions are keyed by two 8-bit addresses */
+#define TP_MAX_SESSIONS (1UL << 16U)
+/* Session key bit set for ETP sessions */
+#define TP_KEY_EXTENDED (1UL << 16U)
+
+/* ETP buffers start out large enough for one data packet offset of 255 packets, and double from there */
+#define ETP_MIN_BUFFER (255U * TP_PACKET_SIZE)
+
+/* Timeout lists */
+enum
+{
+    TP_LIST_BAM,
+    TP_LIST_CONNECTION,
+    TP_NUM_LISTS
+};
+
+/* Growable ETP payload buffer */
+typedef struct
+{
+    uint8_t * data;
+    size_t capacity;
+} tp_buffer;
+
+typedef struct
+{
+    /* Source address in bits 8 to 15, destination address in the lower byte, TP_KEY_EXTENDED for ETP */
+    uint32_t key;
+    bool broadcast;
+    bool extended;
+    uint32_t pgn;
+    uint32_t size;
+    uint32_t num_packets;
+    /* Number of the next packet expected, counted from the first packet of the message */
+    uint32_t next_packet;
+    /* Sequence numbers count from this packet, the last ETP data packet offset */
+    uint32_t packet_offset;
+    /* Last packet the sender may send before the receiver asks for more */
+    uint32_t last_packet;
+    /* Session times out if no frame for it is seen before then */
+    double deadline;
+    /* Neighbours on the timeout list, session indices plus one */
+    uint32_t prev;
+    uint32_t next;
+    /* Payload of ETP sessions, taken from the pool when the session opens */
+    tp_buffer buffer;
+    uint8_t data[J1939DECODE_TP_MAX_SIZE];
+} tp_session;
+
+/* Backs the opaque j1939decode_tp handle of the public API */
+struct j1939decode_tp
+{
+    tp_session * sessions;
+    size_t max_sessions;
+    /* Stack of free session indices */
+    uint32_t * free;
+    size_t num_free;
+    /* Open addressing hash table of session indices plus one, num_slots is two to the power of slot_bits */
+    uint32_t * slots;
+    size_t num_slots;
+    uint32_t slot_bits;
+    /* ETP buffers not in use by a session, at most one per session */
+    tp_buffer * pool;
+    size_t num_pooled;
+    /* Session indices plus one of the first and last session of each timeout list, zero if empty */
+    uint32_t heads[TP_NUM_LISTS];
+    uint32_t tails[TP_NUM_LISTS];
+    j1939decode_tp_stats stats;
+    log_fn_ptr log_fn;
+};
+
+static void log_msg(log_fn_ptr fn, const char * fmt, ...);
+static size_t find_slot(const j1939decode_tp * tp, uint32_t key);
+static tp_session * find_session(const j1939decode_tp * tp, uint32_t key);
+static tp_session * open_session(j1939decode_tp * tp, uint32_t key, double timestamp);
+static void close_session(j1939decode_tp * tp, tp_session * session);
+static void touch_session(j1939decode_tp * tp, tp_session * session, double timestamp);
+static void unlink_session(j1939decode_tp * tp, tp_session * session);
+static void expire_sessions(j1939decode_tp * tp, double timestamp);
+static void start_session(j1939decode_tp * tp, uint32_t key, uint32_t pgn, uint32_t size, bool broadcast,
+                          double timestamp);
+static void abort_session(j1939decode_tp * tp, uint32_t key, uint32_t reverse_key, uint32_t pgn);
+static void connection_management(j1939decode_tp * tp, uint8_t sa, uint8_t da, const uint8_t * bytes, double timestamp);
+static void extended_connection_management(j1939decode_tp * tp, uint8_t sa, uint8_t da, const uint8_t * bytes,
+                                           double timestamp);
+static bool data_transfer(j1939decode_tp * tp, uint32_t key, const uint8_t * bytes, double timestamp,
+                          j1939decode_tp_msg * msg);
+static bool grow_buffer(j1939decode_tp * tp, tp_buffer * buffer, size_t length, size_t size);
+
+/* Home slot of a session key in the hash table, Fibonacci hashing spreads the keys over the whole table */
+static inline size_t home_slot(const j1939decode_tp * tp, uint32_t key)
+{
+    return (size_t) ((uint32_t) (key * 2654435769U) >> (32U - tp->slot_bits));
+}
+
+/**************************************************************************//**
+
+  \brief Log formatted message
+
+  \param fn     log handler, or NULL to log to stderr
+  \param fmt    format string
+
+  \return void
+
+******************************************************************************/
+void log_msg(log_fn_ptr fn, const char * fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    j1939decode_vlog(fn, fmt, args);
+    va_end(args);
+}
+
+/**************************************************************************//**
+
+  \brief Create transport protocol reassembler
+
+  \param max_sessions   number of sessions that can be open at the same time
+  \param fn             log handler, or NULL to log to stderr
+
+  \return j1939decode_tp *  pointer to the reassembler, or NULL on failure
+
+******************************************************************************/
+j1939decode_tp * j1939decode_tp_create(size_t max_sessions, log_fn_ptr fn)
+{
+    j1939decode_tp * tp = calloc(1, sizeof(j1939decode_tp));
+    if (tp == NULL || max_sessions == 0 || max_sessions > TP_MAX_SESSIONS)
+    {
+        log_msg(fn, tp == NULL ? "Memory allocation failure" : "Invalid number of transport protocol sessions");
+        free(tp);
+        return NULL;
+    }
+
+    tp->num_slots = 1;
+    while (tp->num_slots < TP_SLOTS_PER_SESSION * max_sessions)
+    {
+        tp->num_slots <<= 1U;
+        tp->slot_bits++;
+    }
+
+    tp->max_sessions = max_sessions;
+    tp->log_fn = fn;
+    tp->sessions = malloc(max_sessions * sizeof(tp_session));
+    tp->free = malloc(max_sessions * sizeof(uint32_t));
+    tp->slots = calloc(tp->num_slots, sizeof(uint32_t));
+    tp->pool = malloc(max_sessions * sizeof(tp_buffer));
+    if (tp->sessions == NULL || tp->free == NULL || tp->slots == NULL || tp->pool == NULL)
+    {
+        log_msg(fn, "Memory allocation failure");
+        j1939decode_tp_destroy(tp);
+        return NULL;
+    }
+
+    /* Lowest indices are handed out first */
+    for (size_t i = 0; i < max_sessions; i++)
+    {
+        tp->free[i] = (uint32_t) (max_sessions - 1 - i);
+    }
+    tp->num_free = max_sessions;
+
+    return tp;
+}
+
+/**************************************************************************//**
+
+  \brief Destroy transport protocol reassembler
+
+  \param tp     pointer to the reassembler
+
+  \return void
+
+******************************************************************************/
+void j1939decode_tp_destroy(j1939decode_tp * tp)
+{
+    if (tp == NULL)
+    {
+        return;
+    }
+
+    /* Open ETP sessions still hold their buffers */
+    for (size_t slot = 0; tp->slots != NULL && slot < tp->num_slots; slot++)
+    {
+        if (tp->slots[slot] != 0)
+        {
+            free(tp->sessions[tp->slots[slot] - 1].buffer.data);
+        }
+    }
+    for (size_t i = 0; i < tp->num_pooled; i++)
+    {
+        free(tp->pool[i].data);
+    }
+
+    free(tp->sessions);
+    free(tp->free);
+    free(tp->slots);
+    free(tp->pool);
+    free(tp);
+}
+
+/**************************************************************************//**
+
+  \brief Get transport protocol statistics
+
+  \param tp     pointer to the reassembler
+  \param stats  pointer to the statistics to fill in
+
+  \return void
+
+******************************************************************************/
+void j1939decode_tp_get_stats(const j1939decode_tp * tp, j1939decode_tp_stats * stats)
+{
+    *stats = tp->stats;
+    stats->open = tp->max_sessions - tp->num_free;
+}
+
+/**************************************************************************//**
+
+  \brief Feed a CAN frame to the transport protocol reassembler
+
+  Frames other than TP and ETP connection management and data transfer are ignored.
+  Sessions whose deadline has passed are timed out first, which only
+  looks at the head of each timeout list.
+
+  \param tp         pointer to the reassembler
+  \param id         CAN identifier
+  \param dlc        data length code
+  \param data       pointer to data (8 bytes total)
+  \param timestamp  time the frame was received, in seconds
+  \param msg        pointer to the message to fill in when one is complete
+
+  \return bool      boolean indicating if the frame completed a message
+
+******************************************************************************/
+bool j1939decode_tp_feed(j1939decode_tp * tp, uint32_t id, uint8_t dlc, const uint64_t * data, double timestamp,
+                         j1939decode_tp_msg * msg)
+{
+    /* All four PGNs are PDU1 with the data page bits clear, the PS field is the destination address */
+    uint32_t pf = (id >> 16U) & 0x3FFU;
+    if ((pf != TP_CM_PF && pf != TP_DT_PF && pf != ETP_CM_PF && pf != ETP_DT_PF) || dlc < 8U)
+    {
+        return false;
+    }
+
+    expire_sessions(tp, timestamp);
+
+    const uint8_t * bytes = (const uint8_t *) data;
+    uint8_t sa = (uint8_t) id;
+    uint8_t da = (uint8_t) (id >> 8U);
+
+    switch (pf)
+    {
+        case TP_CM_PF:
+            connection_management(tp, sa, da, bytes, timestamp);
+            return false;
+
+        case ETP_CM_PF:
+            extended_connection_management(tp, sa, da, bytes, timestamp);
+            return false;
+
+        case TP_DT_PF:
+            return data_transfer(tp, (uint32_t) ((sa << 8U) | da), bytes, timestamp, msg);
+
+        default:
+            return data_transfer(tp, TP_KEY_EXTENDED | (uint32_t) ((sa << 8U) | da), bytes, timestamp, msg);
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Open a session for a new announcement
+
+  Any unfinished session with the same key is replaced.
+
+  \param tp         pointer to the reassembler
+  \param key        source and destination address of the session, TP_KEY_EXTENDED for ETP
+  \param pgn        parameter group number of the message
+  \param size       size of the message in bytes
+  \param broadcast  true for a BAM session
+  \param timestamp  time the announcement was received, in seconds
+
+  \return void
+
+******************************************************************************/
+void start_session(j1939decode_tp * tp, uint32_t key, uint32_t pgn, uint32_t size, bool broadcast, double timestamp)
+{
+    tp_session * session = find_session(tp, key);
+    if (session != NULL)
+    {
+        /* New announcement before the last one completed */
+        tp->stats.aborted++;
+        unlink_session(tp, session);
+    }
+    else
+    {
+        session = open_session(tp, key, timestamp);
+        if (session == NULL)
+        {
+            tp->stats.dropped++;
+            return;
+        }
+    }
+
+    session->broadcast = broadcast;
+    session->pgn = pgn;
+    session->size = size;
+    session->num_packets = (size + TP_PACKET_SIZE - 1U) / TP_PACKET_SIZE;
+    session->next_packet = 1;
+    session->packet_offset = 0;
+    /* ETP senders wait for a data packet offset, TP senders go on until a clear to send says otherwise */
+    session->last_packet = session->extended ? 0 : session->num_packets;
+    touch_session(tp, session, timestamp);
+}
+
+/**************************************************************************//**
+
+  \brief Close a connection mode session on a connection abort from either side
+
+  \param tp             pointer to the reassembler
+  \param key            session key if the sender aborted
+  \param reverse_key    session key if the receiver aborted
+  \param pgn            parameter group number the abort is for
+
+  \return void
+
+******************************************************************************/
+void abort_session(j1939decode_tp * tp, uint32_t key, uint32_t reverse_key, uint32_t pgn)
+{
+    tp_session * session = find_session(tp, key);
+    if (session == NULL || session->broadcast || session->pgn != pgn)
+    {
+        session = find_session(tp, reverse_key);
+    }
+
+    if (session != NULL && !session->broadcast && session->pgn == pgn)
+    {
+        tp->stats.aborted++;
+        close_session(tp, session);
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Handle a connection management frame
+
+  Request to send and broadcast announcements open a session, replacing
+  any unfinished one between the same addresses. Clear to send frames from
+  the receiver restart the transfer at the packet asked for, which cannot be
+  past the packets received so far, and aborts from either side close the
+  session.
+
+  \param tp         pointer to the reassembler
+  \param sa         source address of the frame
+  \param da         destination address of the frame
+  \param bytes      pointer to the 8 data bytes
+  \param timestamp  time the frame was received, in seconds
+
+  \return void
+
+******************************************************************************/
+void connection_management(j1939decode_tp * tp, uint8_t sa, uint8_t da, const uint8_t * bytes, double timestamp)
+{
+    uint32_t key = (uint32_t) ((sa << 8U) | da);
+    /* Receivers answer from the destination address of the session */
+    uint32_t reverse_key = (uint32_t) ((da << 8U) | sa);
+    uint32_t pgn = bytes[5] | ((uint32_t) bytes[6] << 8U) | ((uint32_t) (bytes[7] & 0x03U) << 16U);
+
+    switch (bytes[0])
+    {
+        case TP_CM_RTS:
+        case TP_CM_BAM:
+        {
+            uint32_t size = bytes[1] | ((uint32_t) bytes[2] << 8U);
+            uint8_t num_packets = bytes[3];
+            bool broadcast = bytes[0] == TP_CM_BAM;
+
+            /* Broadcasts go to the global address, and the packet count has to match the size */
+            if (size <= 8U || size > J1939DECODE_TP_MAX_SIZE || (broadcast && da != 0xFFU) ||
+                num_packets != (size + TP_PACKET_SIZE - 1U) / TP_PACKET_SIZE)
+            {
+                break;
+            }
+
+            start_session(tp, key, pgn, size, broadcast, timestamp);
+            break;
+        }
+
+        case TP_CM_CTS:
+        {
+            tp_session * session = find_session(tp, reverse_key);
+            if (session == NULL || session->broadcast || session->pgn != pgn)
+            {
+                break;
+            }
+
+            /* Zero packets asks the sender to hold, otherwise packets are (re)sent from the one given.
+             * Skipping ahead of the packets received would leave a hole in the message */
+            if (bytes[1] > 0 && (bytes[2] < 1U || bytes[2] > session->next_packet))
+            {
+                tp->stats.aborted++;
+                close_session(tp, session);
+                break;
+            }
+            if (bytes[1] > 0)
+            {
+                session->next_packet = bytes[2];
+            }
+            unlink_session(tp, session);
+            touch_session(tp, session, timestamp);
+            break;
+        }
+
+        case TP_CM_ABORT:
+            abort_session(tp, key, reverse_key, pgn);
+            break;
+
+        default:
+            /* End of message acknowledgments come after the last packet has completed the message */
+            break;
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Handle an extended transport protocol connection management frame
+
+  ETP only has connection mode sessions. After each clear to send, the sender
+  announces with a data packet offset which packets follow, and the sequence
+  numbers of the data transfer frames count from that offset. An offset past
+  the packets received so far aborts the session.
+
+  \param tp         pointer to the reassembler
+  \param sa         source address of the frame
+  \param da         destination address of the frame
+  \param bytes      pointer to the 8 data bytes
+  \param timestamp  time the frame was received, in seconds
+
+  \return void
+
+******************************************************************************/
+void extended_connection_management(j1939decode_tp * tp, uint8_t sa, uint8_t da, const uint8_t * bytes,
+                                    double timestamp)
+{
+    uint32_t key = TP_KEY_EXTENDED | (uint32_t) ((sa << 8U) | da);
+    uint32_t reverse_key = TP_KEY_EXTENDED | (uint32_t) ((da << 8U) | sa);
+    uint32_t pgn = bytes[5] | ((uint32_t) bytes[6] << 8U) | ((uint32_t) (bytes[7] & 0x03U) << 16U);
+
+    switch (bytes[0])
+    {
+        case ETP_CM_RTS:
+        {
+            uint32_t size = bytes[1] | ((uint32_t) bytes[2] << 8U) | ((uint32_t) bytes[3] << 16U) |
+                            ((uint32_t) bytes[4] << 24U);
+
+            /* Smaller messages go by TP, and there is no broadcast ETP */
+            if (size <= J1939DECODE_TP_MAX_SIZE || size > J1939DECODE_ETP_MAX_SIZE || da == 0xFFU)
+            {
+                break;
+            }
+
+            start_session(tp, key, pgn, size, false, timestamp);
+            break;
+        }
+
+        case ETP_CM_CTS:
+        {
+            tp_session * session = find_session(tp, reverse_key);
+            if (session != NULL && session->pgn == pgn)
+            {
+                /* The packets asked for are announced by the data packet offset that follows */
+                unlink_session(tp, session);
+                touch_session(tp, session, timestamp);
+            }
+            break;
+        }
+
+        case ETP_CM_DPO:
+        {
+            tp_session * session = find_session(tp, key);
+            uint32_t offset = bytes[2] | ((uint32_t) bytes[3] << 8U) | ((uint32_t) bytes[4] << 16U);
+            if (session == NULL || session->pgn != pgn || bytes[1] == 0)
+            {
+                break;
+            }
+
+            /* Skipping ahead of the packets received would leave uninitialised bytes in the buffer */
+            if (offset >= session->next_packet)
+            {
+                tp->stats.aborted++;
+                close_session(tp, session);
+                break;
+            }
+
+            session->packet_offset = offset;
+            session->next_packet = offset + 1U;
+            session->last_packet = session->num_packets - offset < bytes[1] ? session->num_packets : offset + bytes[1];
+            unlink_session(tp, session);
+            touch_session(tp, session, timestamp);
+            break;
+        }
+
+        case TP_CM_ABORT:
+            abort_session(tp, key, reverse_key, pgn);
+            break;
+
+        default:
+            /* End of message acknowledgments come after the last packet has completed the message */
+            break;
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Handle a data transfer frame
+
+  A packet missing from a broadcast is lost for good and aborts the session.
+  Connection mode receivers ask for missing packets again, so packets out of
+  sequence are only ignored until a clear to send restarts the transfer.
+  ETP sequence numbers count from the last data packet offset.
+
+  \param tp         pointer to the reassembler
+  \param key        source and destination address of the frame, TP_KEY_EXTENDED for ETP
+  \param bytes      pointer to the 8 data bytes
+  \param timestamp  time the frame was received, in seconds
+  \param msg        pointer to the message to fill in when one is complete
+
+  \return bool      boolean indicating if the frame completed a message
+
+******************************************************************************/
+bool data_transfer(j1939decode_tp * tp, uint32_t key, const uint8_t * bytes, double timestamp,
+                   j1939decode_tp_msg * msg)
+{
+    tp_session * session = find_session(tp, key);
+    if (session == NULL)
+    {
+        return false;
+    }
+
+    uint32_t packet = session->packet_offset + bytes[0];
+    if (packet != session->next_packet || packet > session->last_packet)
+    {
+        if (session->broadcast && packet > session->next_packet)
+        {
+            tp->stats.aborted++;
+            close_session(tp, session);
+        }
+        return false;
+    }
+
+    /* The last packet is padded past the end of the message */
+    size_t offset = (size_t) (packet - 1U) * TP_PACKET_SIZE;
+    size_t length = session->size - offset < TP_PACKET_SIZE ? session->size - offset : TP_PACKET_SIZE;
+    uint8_t * data = session->data;
+    if (session->extended)
+    {
+        if (!grow_buffer(tp, &session->buffer, offset + length, session->size))
+        {
+            tp->stats.aborted++;
+            close_session(tp, session);
+            return false;
+        }
+        data = session->buffer.data;
+    }
+    memcpy(&data[offset], &bytes[1], length);
+
+    if (session->next_packet < session->num_packets)
+    {
+        session->next_packet++;
+        unlink_session(tp, session);
+        touch_session(tp, session, timestamp);
+        return false;
+    }
+
+    /* Closing leaves the payload in place until its session or buffer is used again, on a later frame at the earliest */
+    msg->pgn = session->pgn;
+    msg->sa = (uint8_t) (key >> 8U);
+    msg->da = (uint8_t) key;
+    msg->data = data;
+    msg->length = session->size;
+
+    tp->stats.completed++;
+    close_session(tp, session);
+
+    return true;
+}
+
+/**************************************************************************//**
+
+  \brief Find the hash slot of a session, or the empty slot where it would go
+
+  \param tp     pointer to the reassembler
+  \param key    source and destination address of the session, TP_KEY_EXTENDED for ETP
+
+  \return size_t    hash slot index
+
+******************************************************************************/
+size_t find_slot(const j1939decode_tp * tp, uint32_t key)
+{
+    size_t slot = home_slot(tp, key);
+    while (tp->slots[slot] != 0 && tp->sessions[tp->slots[slot] - 1].key != key)
+    {
+        slot = (slot + 1) & (tp->num_slots - 1);
+    }
+
+    return slot;
+}
+
+/**************************************************************************//**
+
+  \brief Find an open session
+
+  \param tp     pointer to the reassembler
+  \param key    source and destination address of the session, TP_KEY_EXTENDED for ETP
+
+  \return tp_session *  pointer to the session, or NULL if there is none
+
+******************************************************************************/
+tp_session * find_session(const j1939decode_tp * tp, uint32_t key)
+{
+    uint32_t index = tp->slots[find_slot(tp, key)];
+
+    return index ? &tp->sessions[index - 1] : NULL;
+}
+
+/**************************************************************************//**
+
+  \brief Open a session from the free session table entries
+
+  \param tp         pointer to the reassembler
+  \param key        source and destination address of the session, TP_KEY_EXTENDED for ETP, must not be open yet
+  \param timestamp  time the session is opened, in seconds
+
+  \return tp_session *  pointer to the session, or NULL if the table is full
+
+******************************************************************************/
+tp_session * open_session(j1939decode_tp * tp, uint32_t key, double timestamp)
+{
+    if (tp->num_free == 0)
+    {
+        /* Make room from sessions that are already overdue */
+        expire_sessions(tp, timestamp);
+        if (tp->num_free == 0)
+        {
+            return NULL;
+        }
+    }
+
+    uint32_t index = tp->free[--tp->num_free];
+    tp_session * session = &tp->sessions[index];
+    session->key = key;
+    session->extended = (key & TP_KEY_EXTENDED) != 0;
+    tp->slots[find_slot(tp, key)] = index + 1;
+
+    /* ETP sessions take the most recently used buffer, which is the most likely to be large enough already */
+    tp_buffer empty = {NULL, 0};
+    session->buffer = session->extended && tp->num_pooled > 0 ? tp->pool[--tp->num_pooled] : empty;
+
+    /* Put on a timeout list by the caller once the session type is known */
+    return session;
+}
+
+/**************************************************************************//**
+
+  \brief Close a session and return it to the free session table entries
+
+  The hash slots after it are shifted back so lookups never need tombstones,
+  and the buffer of an ETP session goes back to the pool.
+
+  \param tp         pointer to the reassembler
+  \param session    pointer to the open session
+
+  \return void
+
+******************************************************************************/
+void close_session(j1939decode_tp * tp, tp_session * session)
+{
+    size_t mask = tp->num_slots - 1;
+    size_t hole = find_slot(tp, session->key);
+    tp->slots[hole] = 0;
+
+    for (size_t slot = (hole + 1) & mask; tp->slots[slot] != 0; slot = (slot + 1) & mask)
+    {
+        /* Move the entry into the hole unless its home slot lies cyclically in (hole, slot] */
+        size_t home = home_slot(tp, tp->sessions[tp->slots[slot] - 1].key);
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            tp->slots[hole] = tp->slots[slot];
+            tp->slots[slot] = 0;
+            hole = slot;
+        }
+    }
+
+    if (session->buffer.data != NULL)
+    {
+        tp->pool[tp->num_pooled++] = session->buffer;
+        session->buffer.data = NULL;
+        session->buffer.capacity = 0;
+    }
+
+    unlink_session(tp, session);
+    tp->free[tp->num_free++] = (uint32_t) (session - tp->sessions);
+}
+
+/**************************************************************************//**
+
+  \brief Restart the timeout of a session and put it at the tail of its timeout list
+
+  \param tp         pointer to the reassembler
+  \param session    pointer to the session, not on any timeout list
+  \param timestamp  time the session was last heard from, in seconds
+
+  \return void
+
+******************************************************************************/
+void touch_session(j1939decode_tp * tp, tp_session * session, double timestamp)
+{
+    size_t list = session->broadcast ? TP_LIST_BAM : TP_LIST_CONNECTION;
+    uint32_t index = (uint32_t) (session - tp->sessions) + 1U;
+
+    session->deadline = timestamp + (session->broadcast ? TP_TIMEOUT_BAM : TP_TIMEOUT_CONNECTION);
+    session->prev = tp->tails[list];
+    session->next = 0;
+
+    if (tp->tails[list] != 0)
+    {
+        tp->sessions[tp->tails[list] - 1].next = index;
+    }
+    else
+    {
+        tp->heads[list] = index;
+    }
+    tp->tails[list] = index;
+}
+
+/**************************************************************************//**
+
+  \brief Take a session off its timeout list
+
+  \param tp         pointer to the reassembler
+  \param session    pointer to the session
+
+  \return void
+
+******************************************************************************/
+void unlink_session(j1939decode_tp * tp, tp_session * session)
+{
+    size_t list = session->broadcast ? TP_LIST_BAM : TP_LIST_CONNECTION;
+
+    if (session->prev != 0)
+    {
+        tp->sessions[session->prev - 1].next = session->next;
+    }
+    else
+    {
+        tp->heads[list] = session->next;
+    }
+
+    if (session->next != 0)
+    {
+        tp->sessions[session->next - 1].prev = session->prev;
+    }
+    else
+    {
+        tp->tails[list] = session->prev;
+    }
+
+    session->prev = 0;
+    session->next = 0;
+}
+
+/**************************************************************************//**
+
+  \brief Time out every session whose deadline has passed
+
+  Deadlines only ever move to the tail of a list, so the walk stops at the first session not overdue.
+
+  \param tp         pointer to the reassembler
+  \param timestamp  current time, in seconds
+
+  \return void
+
+******************************************************************************/
+void expire_sessions(j1939decode_tp * tp, double timestamp)
+{
+    for (size_t list = 0; list < TP_NUM_LISTS; list++)
+    {
+        while (tp->heads[list] != 0 && tp->sessions[tp->heads[list] - 1].deadline < timestamp)
+        {
+            tp->stats.timed_out++;
+            close_session(tp, &tp->sessions[tp->heads[list] - 1]);
+        }
+    }
+}
+
+/**************************************************************************//**
+
+  \brief Make sure an ETP buffer holds at least the given number of bytes
+
+  Capacity doubles on each step, so streaming a message in costs a handful of
+  reallocations, and is never more than the message size.
+
+  \param tp         pointer to the reassembler
+  \param buffer     pointer to the buffer
+  \param length     number of bytes the buffer has to hold
+  \param size       size of the whole message in bytes
+
+  \return bool      boolean indicating if the buffer is large enough
+
+******************************************************************************/
+bool grow_buffer(j1939decode_tp * tp, tp_buffer * buffer, size_t length, size_t size)
+{
+    if (length <= buffer->capacity)
+    {
+        return true;
+    }
+
+    size_t capacity = buffer->capacity > ETP_MIN_BUFFER / 2U ? buffer->capacity * 2U : ETP_MIN_BUFFER;
+    capacity = capacity > length ? capacity : length;
+    capacity = capacity < size ? capacity : size;
+
+    uint8_t * data = realloc(buffer->data, capacity);
+    if (data == NULL)
+    {
+        log_msg(tp->log_fn, "Memory allocation failure");
+        return false;
+    }
+
+    tp->stats.buffer_size += capacity - buffer->capacity;
+    buffer->data = data;
+    buffer->capacity = capacity;
+
+    return true;
+}
@@ -0,0 +1,465 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "j1939decode.h"
+#include "j1939db.h"
+#include "cJSON.h"
+
+/* Binary image written from the JSON database during the tests */
+#define TEST_IMAGE "test_J1939db.bin"
+/* C source written from the JSON database during the tests */
+#define TEST_C_SOURCE "test_j1939db_embedded.c"
+
+static j1939db * json_db;
+
+void setUp(void)
+{
+    json_db = j1939db_load(J1939DECODE_DB, NULL);
+}
+
+void tearDown(void)
+{
+    /* Back to picking the column kernel by CPU, even if a kernel test failed part way */
+    j1939db_set_column_kernel(J1939DB_COLUMN_AUTO);
+    j1939db_free(json_db);
+    remove(TEST_IMAGE);
+    remove(TEST_C_SOURCE);
+}
+
+void test_j1939db_load_json(void)
+{
+    TEST_ASSERT_NOT_NULL(json_db);
+
+    /* PGN 61444 is Electronic Engine Controller 1 */
+    const j1939db_pgn * record = j1939db_get_pgn(json_db, 61444);
+    TEST_ASSERT_NOT_NULL(record);
+    TEST_ASSERT_EQUAL_STRING("Electronic Engine Controller 1", j1939db_string(json_db, record->name));
+
+    /* PGN 130000 does not exist in J1939 database */
+    TEST_ASSERT_NULL(j1939db_get_pgn(json_db, 130000));
+
+    /* PDU1 PGNs are found whatever their destination address, PGN 0 is Torque/Speed Control 1 */
+    record = j1939db_get_pgn(json_db, 0x21);
+    TEST_ASSERT_NOT_NULL(record);
+    TEST_ASSERT_EQUAL_STRING("Torque/Speed Control 1", j1939db_string(json_db, record->name));
+    TEST_ASSERT_EQUAL_UINT32(0xEA00, j1939db_normalize_pgn(0xEA21));
+    TEST_ASSERT_EQUAL_UINT8(0x21, j1939db_get_da(0xEA21));
+    TEST_ASSERT_EQUAL_UINT32(65215, j1939db_normalize_pgn(65215));
+    TEST_ASSERT_EQUAL_UINT8(255, j1939db_get_da(65215));
+}
+
+void test_j1939db_json_fragments(void)
+{
+    TEST_ASSERT_NOT_NULL(json_db);
+
+    /* SPN 190 is Engine Speed in PGN 61444 */
+    const j1939db_pgn * record = j1939db_get_pgn(json_db, 61444);
+    TEST_ASSERT_NOT_NULL(record);
+    TEST_ASSERT_EQUAL_size_t(strlen("\"Electronic Engine Controller 1\""), record->name_json.length);
+    TEST_ASSERT_EQUAL_MEMORY("\"Electronic Engine Controller 1\"", j1939db_fragment_text(json_db, &record->name_json),
+                             record->name_json.length);
+
+    const j1939db_spn * spns = j1939db_pgn_spns(json_db, record);
+    const j1939db_spn * spn = NULL;
+    for (size_t i = 0; i < record->num_spns; i++)
+    {
+        if (spns[i].spn == 190)
+        {
+            spn = &spns[i];
+        }
+    }
+    TEST_ASSERT_NOT_NULL(spn);
+
+    /* Fragment holds the key, every static field and the raw value key */
+    const char * text = j1939db_fragment_text(json_db, &spn->json);
+    TEST_ASSERT_EQUAL_MEMORY("\"190\":{", text, spn->json_fields[0]);
+    TEST_ASSERT_EQUAL_MEMORY("\"Name\":\"Engine Speed\",", &text[spn->json_fields[J1939DB_SPN_NAME]],
+                             spn->json_fields[J1939DB_SPN_OFFSET] - spn->json_fields[J1939DB_SPN_NAME]);
+    TEST_ASSERT_EQUAL_MEMORY("\"StartBit\":24,\"ValueRaw\":", &text[spn->json_fields[J1939DB_SPN_START_BIT]],
+                             spn->json.length - spn->json_fields[J1939DB_SPN_START_BIT]);
+}
+
+void test_j1939db_delimited(void)
+{
+    TEST_ASSERT_NOT_NULL(json_db);
+
+    /* Component identification fields have no fixed start bit and are kept in the order they are sent */
+    const j1939db_pgn * record = j1939db_get_pgn(json_db, 65259);
+    TEST_ASSERT_NOT_NULL(record);
+    TEST_ASSERT_EQUAL_size_t(0, record->num_spns);
+    TEST_ASSERT_EQUAL_size_t(4, record->num_delimited);
+
+    const uint32_t expected[] = {586, 587, 588, 233};
+    const j1939db_spn * delimited = j1939db_pgn_delimited(json_db, record);
+    for (size_t i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(expected[i], delimited[i].spn);
+        TEST_ASSERT_EQUAL_UINT32(J1939DECODE_NO_START_BIT, delimited[i].start_bit);
+        TEST_ASSERT_EQUAL_UINT64(0, delimited[i].mask);
+    }
+
+    /* Delimited fields are indexed after the fixed position SPNs of their record */
+    const j1939db_spn_ref * refs;
+    TEST_ASSERT_EQUAL_size_t(1, j1939db_find_spn(json_db, 588, &refs));
+    TEST_ASSERT_EQUAL_PTR(record, &json_db->pgns[refs[0].pgn]);
+    TEST_ASSERT_EQUAL_UINT16(record->num_spns + 2, refs[0].spn);
+    TEST_ASSERT_TRUE(j1939db_find_spn(json_db, 237, &refs) > 0);
+}
+
+void test_j1939db_states(void)
+{
+    TEST_ASSERT_NOT_NULL(json_db);
+
+    /* SPN 899 is the 4-bit engine torque mode in EEC1, with bit decodings for some of its raw values */
+    const j1939db_spn_ref * refs;
+    TEST_ASSERT_EQUAL_size_t(1, j1939db_find_spn(json_db, 899, &refs));
+    const j1939db_spn * spn = &j1939db_pgn_spns(json_db, &json_db->pgns[refs[0].pgn])[refs[0].spn];
+
+    TEST_ASSERT_EQUAL_UINT16(16, spn->num_states);
+    TEST_ASSERT_EQUAL_STRING("Cruise control", j1939db_state(json_db, spn, 2));
+    TEST_ASSERT_EQUAL_STRING("Not available", j1939db_state(json_db, spn, 15));
+    TEST_ASSERT_NULL(j1939db_state(json_db, spn, 3));
+    TEST_ASSERT_NULL(j1939db_state(json_db, spn, 16));
+    const j1939db_fragment * state = j1939db_state_json(json_db, spn, 2);
+    TEST_ASSERT_EQUAL_MEMORY("\"Cruise control\"", j1939db_fragment_text(json_db, state), state->length);
+    TEST_ASSERT_EQUAL_size_t(0, j1939db_state_json(json_db, spn, 3)->length);
+
+    /* SPN 190 has no bit decodings */
+    TEST_ASSERT_EQUAL_size_t(1, j1939db_find_spn(json_db, 190, &refs));
+    spn = &j1939db_pgn_spns(json_db, &json_db->pgns[refs[0].pgn])[refs[0].spn];
+    TEST_ASSERT_EQUAL_UINT16(0, spn->num_states);
+    TEST_ASSERT_NULL(j1939db_state(json_db, spn, 0));
+}
+
+void test_j1939db_spn_index(void)
+{
+    TEST_ASSERT_NOT_NULL(json_db);
+
+    /* Every SPN descriptor, delimited ones included, is found through the index,
+     * along with every other PGN carrying the same SPN */
+    for (size_t i = 0; i < json_db->num_pgns; i++)
+    {
+        const j1939db_pgn * record = &json_db->pgns[i];
+        for (size_t j = 0; j < record->num_spns + record->num_delimited; j++)
+        {
+            uint32_t spn = j1939db_pgn_spns(json_db, record)[j].spn;
+
+            size_t expected = 0;
+            for (size_t k = 0; k < json_db->num_spns; k++)
+            {
+                expected += json_db->spns[k].spn == spn;
+            }
+
+            const j1939db_spn_ref * refs;
+            size_t num_refs = j1939db_find_spn(json_db, spn, &refs);
+            TEST_ASSERT_EQUAL_size_t(expected, num_refs);
+
+            bool found = false;
+            for (size_t k = 0; k < num_refs; k++)
+            {
+                TEST_ASSERT_EQUAL_UINT32(spn, j1939db_pgn_spns(json_db, &json_db->pgns[refs[k].pgn])[refs[k].spn].spn);
+                found = found || (refs[k].pgn == i && refs[k].spn == j);
+            }
+            TEST_ASSERT_TRUE(found);
+        }
+    }
+
+    /* SPN 1 is not in the database, SPNs are 19 bits at most */
+    const j1939db_spn_ref * refs;
+    TEST_ASSERT_EQUAL_size_t(0, j1939db_find_spn(json_db, 1, &refs));
+    TEST_ASSERT_NULL(refs);
+    TEST_ASSERT_EQUAL_size_t(0, j1939db_find_spn(json_db, UINT32_MAX, &refs));
+}
+
+void test_j1939db_extract_exhaustive(void)
+{
+    const uint64_t payloads[] = {UINT64_MAX, UINT64_C(0x0123456789ABCDEF), UINT64_C(0x8000000000000001), 0};
+
+    for (uint32_t start_bit = 0; start_bit < 72; start_bit++)
+    {
+        for (uint32_t length = 1; length <= 64; length++)
+        {
+            j1939db_spn spn;
+            memset(&spn, 0, sizeof(spn));
+            spn.start_bit = start_bit;
+            spn.length = length;
+            j1939db_compile_extraction(&spn);
+
+            TEST_ASSERT_EQUAL_UINT((start_bit + length + 7) / 8, spn.num_bytes);
+
+            for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++)
+            {
+                for (uint8_t dlc = 0; dlc <= 8; dlc++)
+                {
+                    /* Reference: one bit at a time, bits past the DLC or the frame read as zero */
+                    uint64_t expected = 0;
+                    for (uint32_t bit = 0; bit < length; bit++)
+                    {
+                        uint32_t position = start_bit + bit;
+                        if (position < 8U * dlc && ((payloads[i] >> position) & 1U))
+                        {
+                            expected |= UINT64_C(1) << bit;
+                        }
+                    }
+
+                    TEST_ASSERT_EQUAL_HEX64(expected, j1939db_extract(&spn, j1939db_payload(payloads[i], dlc)));
+                }
+            }
+        }
+    }
+}
+
+void test_j1939db_decode_column_kernels(void)
+{
+    TEST_ASSERT_NOT_NULL(json_db);
+
+    /* Frame counts around the 2 and 4 frames each SIMD kernel decodes at a time */
+    const size_t counts[] = {0, 1, 2, 3, 4, 5, 7, 9, 31, 64};
+    enum { MAX_COUNT = 64 };
+
+    uint64_t data[MAX_COUNT];
+    uint8_t dlcs[MAX_COUNT];
+    uint64_t state = UINT64_C(0x9E3779B97F4A7C15);
+    for (size_t i = 0; i < MAX_COUNT; i++)
+    {
+        /* xorshift64 for repeatable random payloads, with DLCs from 0 to 15 */
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        data[i] = state;
+        dlcs[i] = (uint8_t) (state >> 60);
+    }
+    /* Make sure empty, full and oversized frames are all there */
+    dlcs[0] = 0;
+    dlcs[1] = 8;
+    dlcs[2] = 9;
+    dlcs[5] = 15;
+
+    /* Every SPN of the database, then made up ones covering the whole frame and running past it */
+    const uint32_t extra[][2] = {{0, 64}, {7, 33}, {32, 32}, {60, 12}};
+    size_t num_extra = sizeof(extra) / sizeof(extra[0]);
+
+    const j1939db_column_kernel kernels[] = {J1939DB_COLUMN_SSE2, J1939DB_COLUMN_AVX2};
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+    {
+        /* Kernels this build or CPU does not have are skipped */
+        if (!j1939db_set_column_kernel(kernels[k]))
+        {
+            continue;
+        }
+
+        for (size_t s = 0; s < json_db->num_spns + num_extra; s++)
+        {
+            j1939db_spn spn;
+            if (s < json_db->num_spns)
+            {
+                spn = json_db->spns[s];
+            }
+            else
+            {
+                memset(&spn, 0, sizeof(spn));
+                spn.start_bit = extra[s - json_db->num_spns][0];
+                spn.length = extra[s - json_db->num_spns][1];
+                spn.resolution = 0.001;
+                spn.offset = -1000.0;
+                spn.operational_low = -1000.0;
+                spn.operational_high = 1e12;
+                j1939db_compile_extraction(&spn);
+            }
+
+            for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+            {
+                uint64_t expected_raw[MAX_COUNT];
+                double expected_decoded[MAX_COUNT];
+                bool expected_valid[MAX_COUNT];
+                uint64_t raw[MAX_COUNT];
+                double decoded[MAX_COUNT];
+                bool valid[MAX_COUNT];
+
+                TEST_ASSERT_TRUE(j1939db_set_column_kernel(J1939DB_COLUMN_SCALAR));
+                j1939db_decode_column(&spn, data, dlcs, counts[c], expected_raw, expected_decoded, expected_valid);
+                TEST_ASSERT_TRUE(j1939db_set_column_kernel(kernels[k]));
+                j1939db_decode_column(&spn, data, dlcs, counts[c], raw, decoded, valid);
+
+                /* Bit for bit, so the decoded doubles are compared as memory too */
+                if (counts[c] > 0)
+                {
+                    TEST_ASSERT_EQUAL_MEMORY(expected_raw, raw, counts[c] * sizeof(uint64_t));
+                    TEST_ASSERT_EQUAL_MEMORY(expected_decoded, decoded, counts[c] * sizeof(double));
+                    TEST_ASSERT_EQUAL_MEMORY(expected_valid, valid, counts[c] * sizeof(bool));
+                }
+            }
+        }
+    }
+}
+
+void test_j1939db_load_missing_file(void)
+{
+    TEST_ASSERT_NULL(j1939db_load("does_not_exist.json", NULL));
+}
+
+void test_j1939db_image_round_trip(void)
+{
+    TEST_ASSERT_TRUE(j1939db_write_image(json_db, TEST_IMAGE));
+
+    j1939db * image_db = j1939db_load(TEST_IMAGE, NULL);
+    TEST_ASSERT_NOT_NULL(image_db);
+
+    /* Records are used in place in the image, and SPN metadata is only resolved when asked for */
+    const uint8_t * image = image_db->image;
+    TEST_ASSERT_TRUE((const uint8_t *) image_db->pgns > image &&
+                     (const uint8_t *) image_db->pgns < image + image_db->image_size);
+    TEST_ASSERT_TRUE((const uint8_t *) image_db->spns > image &&
+                     (const uint8_t *) image_db->spns < image + image_db->image_size);
+    TEST_ASSERT_TRUE((const uint8_t *) image_db->json > image &&
+                     (const uint8_t *) image_db->json < image + image_db->image_size);
+    TEST_ASSERT_TRUE((const uint8_t *) image_db->spn_refs > image &&
+                     (const uint8_t *) image_db->spn_refs < image + image_db->image_size);
+    TEST_ASSERT_NULL(image_db->infos);
+
+    /* Every PGN, SPN and source address name should survive the round trip */
+    TEST_ASSERT_EQUAL_size_t(json_db->num_pgns, image_db->num_pgns);
+    TEST_ASSERT_EQUAL_size_t(json_db->num_spns, image_db->num_spns);
+
+    const j1939decode_spn_info * expected_infos = j1939db_spn_infos(json_db);
+    const j1939decode_spn_info * actual_infos = j1939db_spn_infos(image_db);
+    TEST_ASSERT_NOT_NULL(expected_infos);
+    TEST_ASSERT_NOT_NULL(actual_infos);
+    TEST_ASSERT_EQUAL_PTR(actual_infos, j1939db_spn_infos(image_db));
+
+    for (size_t i = 0; i < json_db->num_pgns; i++)
+    {
+        const j1939db_pgn * expected = &json_db->pgns[i];
+        const j1939db_pgn * actual = j1939db_get_pgn(image_db, expected->pgn);
+        TEST_ASSERT_NOT_NULL(actual);
+        TEST_ASSERT_EQUAL_STRING(j1939db_string(json_db, expected->name), j1939db_string(image_db, actual->name));
+        TEST_ASSERT_EQUAL_size_t(expected->num_spns, actual->num_spns);
+        TEST_ASSERT_EQUAL_size_t(expected->num_delimited, actual->num_delimited);
+        for (size_t j = 0; j < expected->num_delimited; j++)
+        {
+            TEST_ASSERT_EQUAL_UINT32(j1939db_pgn_delimited(json_db, expected)[j].spn,
+                                     j1939db_pgn_delimited(image_db, actual)[j].spn);
+        }
+
+        for (size_t j = 0; j < expected->num_spns; j++)
+        {
+            const j1939db_spn * expected_spn = &j1939db_pgn_spns(json_db, expected)[j];
+            const j1939db_spn * actual_spn = &j1939db_pgn_spns(image_db, actual)[j];
+            const j1939decode_spn_info * expected_info = &expected_infos[expected->first_spn + j];
+            const j1939decode_spn_info * actual_info = &actual_infos[actual->first_spn + j];
+
+            TEST_ASSERT_EQUAL_UINT32(expected_spn->spn, actual_spn->spn);
+            TEST_ASSERT_EQUAL_UINT32(expected_spn->start_bit, actual_spn->start_bit);
+            TEST_ASSERT_EQUAL_UINT64(expected_spn->mask, actual_spn->mask);
+            TEST_ASSERT_EQUAL_DOUBLE(expected_spn->resolution, actual_spn->resolution);
+            TEST_ASSERT_EQUAL_UINT32(expected_info->spn, actual_info->spn);
+            TEST_ASSERT_EQUAL_STRING(expected_info->name, actual_info->name);
+            TEST_ASSERT_EQUAL_STRING(expected_info->units, actual_info->units);
+            TEST_ASSERT_EQUAL_STRING(expected_spn->key, actual_spn->key);
+            TEST_ASSERT_EQUAL_UINT32(expected_spn->json.length, actual_spn->json.length);
+            TEST_ASSERT_EQUAL_MEMORY(j1939db_fragment_text(json_db, &expected_spn->json),
+                                     j1939db_fragment_text(image_db, &actual_spn->json), expected_spn->json.length);
+
+            TEST_ASSERT_EQUAL_UINT16(expected_spn->num_states, actual_spn->num_states);
+            for (uint64_t raw = 0; raw < expected_spn->num_states; raw++)
+            {
+                const char * state = j1939db_state(json_db, expected_spn, raw);
+                if (state == NULL)
+                {
+                    TEST_ASSERT_NULL(j1939db_state(image_db, actual_spn, raw));
+                }
+                else
+                {
+                    TEST_ASSERT_EQUAL_STRING(state, j1939db_state(image_db, actual_spn, raw));
+                }
+            }
+        }
+    }
+
+    /* SPN index is stored as is, so every SPN is found in the same places */
+    TEST_ASSERT_EQUAL_size_t(json_db->num_spn_refs, image_db->num_spn_refs);
+    for (size_t i = 0; i < json_db->num_spns; i++)
+    {
+        const j1939db_spn_ref * expected_refs;
+        const j1939db_spn_ref * actual_refs;
+        size_t num_refs = j1939db_find_spn(json_db, json_db->spns[i].spn, &expected_refs);
+        TEST_ASSERT_EQUAL_size_t(num_refs, j1939db_find_spn(image_db, json_db->spns[i].spn, &actual_refs));
+        if (num_refs > 0)
+        {
+            TEST_ASSERT_EQUAL_MEMORY(expected_refs, actual_refs, num_refs * sizeof(j1939db_spn_ref));
+        }
+    }
+
+    for (size_t sa = 0; sa < 256; sa++)
+    {
+        const j1939db_fragment * expected_json = &json_db->sa_names_json[sa];
+        const j1939db_fragment * actual_json = &image_db->sa_names_json[sa];
+        TEST_ASSERT_EQUAL_UINT32(expected_json->length, actual_json->length);
+        TEST_ASSERT_EQUAL_MEMORY(j1939db_fragment_text(json_db, expected_json),
+                                 j1939db_fragment_text(image_db, actual_json), expected_json->length);
+
+        const char * name = j1939db_sa_name(json_db, (uint8_t) sa);
+        if (name == NULL)
+        {
+            TEST_ASSERT_NULL(j1939db_sa_name(image_db, (uint8_t) sa));
+        }
+        else
+        {
+            TEST_ASSERT_EQUAL_STRING(name, j1939db_sa_name(image_db, (uint8_t) sa));
+        }
+    }
+
+    j1939db_free(image_db);
+}
+
+void test_j1939db_image_truncated(void)
+{
+    TEST_ASSERT_TRUE(j1939db_write_image(json_db, TEST_IMAGE));
+
+    /* Chop off the end of the string pool */
+    FILE * fp = fopen(TEST_IMAGE, "rb");
+    TEST_ASSERT_NOT_NULL(fp);
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+    uint8_t * buf = malloc((size_t) size);
+    TEST_ASSERT_NOT_NULL(buf);
+    TEST_ASSERT_EQUAL_INT(size, fread(buf, 1, (size_t) size, fp));
+    fclose(fp);
+
+    fp = fopen(TEST_IMAGE, "wb");
+    TEST_ASSERT_NOT_NULL(fp);
+    fwrite(buf, 1, (size_t) size - 1, fp);
+    fclose(fp);
+    free(buf);
+
+    /* A truncated image should be rejected rather than read out of bounds */
+    TEST_ASSERT_NULL(j1939db_load(TEST_IMAGE, NULL));
+}
+
+void test_j1939db_c_source(void)
+{
+    TEST_ASSERT_TRUE(j1939db_write_c_source(json_db, TEST_C_SOURCE));
+
+    FILE * fp = fopen(TEST_C_SOURCE, "r");
+    TEST_ASSERT_NOT_NULL(fp);
+
+    /* Generated source should define the embedded database and the decode plan for SPN 190 */
+    bool found_db = false;
+    bool found_spn = false;
+    char line[4096];
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        found_db = found_db || strstr(line, "const j1939db j1939db_embedded =") != NULL;
+        found_spn = found_spn || strstr(line, "{.spn = 190, .start_bit = 24U, .length = 16,") != NULL;
+    }
+    fclose(fp);
+
+    TEST_ASSERT_TRUE(found_db);
+    TEST_ASSERT_TRUE(found_spn);
+}
@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "unity.h"
 
@@ -88,8 +89,8 @@ void test_j1939decode_message_decoded_true(void)
 
 void test_j1939decode_message_decoded_false(void)
 {
-    /* PGN 1 does not exist in J1939 database */
-    pgn = 1;
+    /* PGN 130000 does not exist in J1939 database */
+    pgn = 130000;
 
     char * json_string = j1939decode_to_json(get_id(pri, pgn, sa), dlc, (uint64_t *) data, false);
     cJSON * json = cJSON_Parse(json_string);
@@ -186,3 +187,942 @@ void test_j1939decode_message_sa_industry_group_specific(void)
     cJSON_Delete(json);
     free(json_string);
 }
+
+void test_j1939decode_message_pgn_name(void)
+{
+    /* PGN 61444 is Electronic Engine Controller 1 */
+    pgn = 61444;
+
+    char * json_string = j1939decode_to_json(get_id(pri, pgn, sa), dlc, (uint64_t *) data, false);
+    cJSON * json = cJSON_Parse(json_string);
+
+    /* "PGNName" key should be found using the PGN lookup table */
+    TEST_ASSERT_EQUAL_STRING("Electronic Engine Controller 1", cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json, "PGNName")));
+
+    cJSON_Delete(json);
+    free(json_string);
+}
+
+void test_j1939decode_message_spn_value_decoded(void)
+{
+    /* EEC1 message with engine speed (SPN 190) at start bit 24 */
+    pgn = 61444;
+    data[3] = 0x83;
+    data[4] = 0x17;
+
+    char * json_string = j1939decode_to_json(get_id(pri, pgn, sa), dlc, (uint64_t *) data, false);
+    cJSON * json = cJSON_Parse(json_string);
+
+    const cJSON * spn = cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(json, "SPNs"), "190");
+
+    /* Raw value 6019 scaled by 0.125 rpm/bit */
+    TEST_ASSERT_EQUAL_INT(24, cJSON_GetObjectItemCaseSensitive(spn, "StartBit")->valueint);
+    TEST_ASSERT_EQUAL_INT(6019, cJSON_GetObjectItemCaseSensitive(spn, "ValueRaw")->valueint);
+    TEST_ASSERT_EQUAL_DOUBLE(752.375, cJSON_GetObjectItemCaseSensitive(spn, "ValueDecoded")->valuedouble);
+    TEST_ASSERT_TRUE(cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(spn, "Valid")));
+
+    cJSON_Delete(json);
+    free(json_string);
+}
+
+void test_j1939decode_struct_spn_value_decoded(void)
+{
+    /* EEC1 message with engine speed (SPN 190) at start bit 24 */
+    pgn = 61444;
+    sa = 11;
+    data[3] = 0x83;
+    data[4] = 0x17;
+
+    j1939decode_msg msg;
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgn, sa), dlc, (uint64_t *) data, &msg));
+
+    TEST_ASSERT_EQUAL_UINT32(61444, msg.pgn);
+    TEST_ASSERT_EQUAL_UINT8(11, msg.sa);
+    TEST_ASSERT_EQUAL_STRING("Brakes - System Controller", msg.sa_name);
+    TEST_ASSERT_EQUAL_STRING("Electronic Engine Controller 1", msg.pgn_name);
+    TEST_ASSERT_TRUE(msg.decoded);
+
+    const j1939decode_spn_value * value = NULL;
+    for (uint32_t i = 0; i < msg.num_spns; i++)
+    {
+        if (msg.spns[i].spn == 190)
+        {
+            value = &msg.spns[i];
+        }
+    }
+
+    TEST_ASSERT_NOT_NULL(value);
+    TEST_ASSERT_EQUAL_UINT64(6019, value->value_raw);
+    TEST_ASSERT_EQUAL_DOUBLE(752.375, value->value_decoded);
+    TEST_ASSERT_TRUE(value->valid);
+    TEST_ASSERT_EQUAL_STRING("Engine Speed", value->info->name);
+    TEST_ASSERT_EQUAL_STRING("rpm", value->info->units);
+}
+
+void test_j1939decode_spn_state(void)
+{
+    /* EEC1 message with engine torque mode (SPN 899) 2 and engine starter mode (SPN 1675) 3 */
+    pgn = 61444;
+    sa = 0;
+    data[0] = 0x02;
+    data[6] = 0x03;
+
+    j1939decode_msg msg;
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgn, sa), dlc, (uint64_t *) data, &msg));
+
+    for (uint32_t i = 0; i < msg.num_spns; i++)
+    {
+        if (msg.spns[i].spn == 899)
+        {
+            TEST_ASSERT_EQUAL_STRING("Cruise control", msg.spns[i].state);
+        }
+        else
+        {
+            /* No state for raw values missing from the bit decodings, nor for SPNs without any */
+            TEST_ASSERT_NULL(msg.spns[i].state);
+        }
+    }
+
+    char * json_string = j1939decode_to_json(get_id(pri, pgn, sa), dlc, (uint64_t *) data, false);
+    TEST_ASSERT_NOT_NULL(json_string);
+    TEST_ASSERT_NOT_NULL(strstr(json_string, "\"ValueDecoded\":2,\"ValueState\":\"Cruise control\",\"Valid\":true"));
+    TEST_ASSERT_NULL(strstr(strstr(json_string, "\"1675\""), "ValueState"));
+
+    char buffer[4096];
+    TEST_ASSERT_EQUAL_size_t(strlen(json_string),
+                             j1939decode_to_json_buffer(get_id(pri, pgn, sa), dlc, (uint64_t *) data, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING(json_string, buffer);
+    free(json_string);
+
+    j1939decode_set_profile(J1939DECODE_PROFILE_VALUES);
+    j1939decode_to_json_buffer(get_id(pri, pgn, sa), dlc, (uint64_t *) data, buffer, sizeof(buffer));
+    j1939decode_set_profile(J1939DECODE_PROFILE_FULL);
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "\"899\":{\"ValueDecoded\":2,\"ValueState\":\"Cruise control\",\"Valid\":true}"));
+
+    /* SPNs cut off by the DLC read as zero, which is no state since it was not sent */
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgn, sa), 0, (uint64_t *) data, &msg));
+    TEST_ASSERT_EQUAL_UINT32(899, msg.spns[0].spn);
+    TEST_ASSERT_EQUAL_UINT64(0, msg.spns[0].value_raw);
+    TEST_ASSERT_NULL(msg.spns[0].state);
+
+    j1939decode_to_json_buffer(get_id(pri, pgn, sa), 0, (uint64_t *) data, buffer, sizeof(buffer));
+    TEST_ASSERT_NULL(strstr(buffer, "ValueState"));
+
+    j1939decode_spn_value values[8];
+    TEST_ASSERT_TRUE(j1939decode_to_values(pgn, data, 0, values, 8) > 0);
+    TEST_ASSERT_NULL(values[0].state);
+}
+
+void test_j1939decode_struct_decoded_false(void)
+{
+    /* PGN 130000 does not exist in J1939 database */
+    pgn = 130000;
+
+    j1939decode_msg msg;
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgn, sa), dlc, (uint64_t *) data, &msg));
+
+    TEST_ASSERT_FALSE(msg.decoded);
+    TEST_ASSERT_EQUAL_UINT32(0, msg.num_spns);
+    TEST_ASSERT_NULL(msg.pgn_name);
+}
+
+void test_j1939decode_pdu1_destination_address(void)
+{
+    /* TSC1 (PGN 0) is PDU1, so the destination address 0x21 is carried in the PS byte */
+    uint32_t id = get_id(pri, 0x21, sa);
+
+    j1939decode_msg msg;
+    TEST_ASSERT_TRUE(j1939decode_to_struct(id, dlc, (uint64_t *) data, &msg));
+    TEST_ASSERT_TRUE(msg.decoded);
+    TEST_ASSERT_EQUAL_UINT32(0, msg.pgn);
+    TEST_ASSERT_EQUAL_UINT8(0x21, msg.da);
+
+    char * json_string = j1939decode_to_json(id, dlc, (uint64_t *) data, false);
+    TEST_ASSERT_NOT_NULL(strstr(json_string, "\"PGN\":0,\"DA\":33,"));
+    TEST_ASSERT_NOT_NULL(strstr(json_string, "\"Decoded\":true"));
+    free(json_string);
+
+    /* PDU2 PGNs are broadcast, their PS byte is part of the PGN */
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, 65215, sa), dlc, (uint64_t *) data, &msg));
+    TEST_ASSERT_EQUAL_UINT32(65215, msg.pgn);
+    TEST_ASSERT_EQUAL_UINT8(255, msg.da);
+}
+
+void test_j1939decode_struct_spn_lengths(void)
+{
+    j1939decode_msg msg;
+
+    /* Total vehicle distance (SPN 245) is 32 bits long, starting at bit 32 */
+    pgn = 65248;
+    data[4] = 0x01;
+    data[5] = 0x02;
+    data[6] = 0x03;
+    data[7] = 0x04;
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgn, sa), dlc, (uint64_t *) data, &msg));
+    TEST_ASSERT_EQUAL_UINT32(1, msg.num_spns);
+    TEST_ASSERT_EQUAL_HEX64(0x04030201, msg.spns[0].value_raw);
+    TEST_ASSERT_TRUE(msg.spns[0].valid);
+
+    /* Bytes beyond the DLC are ignored, and an SPN they cut short is not valid */
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgn, sa), 6, (uint64_t *) data, &msg));
+    TEST_ASSERT_EQUAL_HEX64(0x0201, msg.spns[0].value_raw);
+    TEST_ASSERT_FALSE(msg.spns[0].valid);
+}
+
+void test_j1939decode_struct_batch_matches_single(void)
+{
+    /* Mix of known and unknown PGNs, including an invalid DLC */
+    const uint32_t pgns[] = {61444, 130000, 0, 61444, 65265, 0, 61444, 65280};
+    const size_t count = sizeof(pgns) / sizeof(pgns[0]);
+    uint32_t ids[sizeof(pgns) / sizeof(pgns[0])];
+    uint8_t dlcs[sizeof(pgns) / sizeof(pgns[0])];
+    uint64_t payloads[sizeof(pgns) / sizeof(pgns[0])];
+    static j1939decode_msg msgs[sizeof(pgns) / sizeof(pgns[0])];
+    static j1939decode_msg msg;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        ids[i] = get_id(pri, pgns[i], (uint8_t) i);
+        dlcs[i] = (i == 5) ? 9 : dlc;
+        payloads[i] = 0x0123456789ABCDEFULL * (i + 1);
+    }
+
+    TEST_ASSERT_EQUAL_size_t(count, j1939decode_to_struct_batch(ids, dlcs, payloads, count, msgs));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (dlcs[i] > 8)
+        {
+            /* Invalid messages are filled in but never decoded */
+            TEST_ASSERT_FALSE(msgs[i].decoded);
+            continue;
+        }
+
+        TEST_ASSERT_TRUE(j1939decode_to_struct(ids[i], dlcs[i], &payloads[i], &msg));
+
+        /* Batch decoding should give exactly the same result as decoding one message at a time */
+        TEST_ASSERT_EQUAL_UINT32(msg.pgn, msgs[i].pgn);
+        TEST_ASSERT_EQUAL_UINT8(msg.sa, msgs[i].sa);
+        TEST_ASSERT_TRUE(msg.decoded == msgs[i].decoded);
+        TEST_ASSERT_EQUAL_UINT32(msg.num_spns, msgs[i].num_spns);
+        for (uint32_t j = 0; j < msg.num_spns; j++)
+        {
+            TEST_ASSERT_EQUAL_UINT32(msg.spns[j].spn, msgs[i].spns[j].spn);
+            TEST_ASSERT_EQUAL_UINT64(msg.spns[j].value_raw, msgs[i].spns[j].value_raw);
+            TEST_ASSERT_TRUE(msg.spns[j].valid == msgs[i].spns[j].valid);
+        }
+    }
+}
+
+static size_t ctx_log_count;
+
+static void ctx_log_counter(const char * msg)
+{
+    (void) msg;
+    ctx_log_count++;
+}
+
+void test_j1939decode_to_columns_matches_struct(void)
+{
+    /* Odd count so that the SIMD kernels leave a tail for the scalar one */
+    enum { COUNT = 37, MAX_COLUMNS = 8 };
+    const uint32_t pgns[] = {61444, 65215, 65248, 65262, 65265};
+
+    static uint64_t values_raw[MAX_COLUMNS][COUNT];
+    static double values_decoded[MAX_COLUMNS][COUNT];
+    static bool valid[MAX_COLUMNS][COUNT];
+    j1939decode_spn_column columns[MAX_COLUMNS];
+    for (size_t i = 0; i < MAX_COLUMNS; i++)
+    {
+        columns[i].value_raw = values_raw[i];
+        columns[i].value_decoded = values_decoded[i];
+        columns[i].valid = valid[i];
+    }
+
+    uint64_t batch_data[COUNT];
+    uint8_t dlcs[COUNT];
+    uint64_t state = 7;
+    for (size_t i = 0; i < COUNT; i++)
+    {
+        state = state * UINT64_C(6364136223846793005) + 1442695040888963407ULL;
+        batch_data[i] = i % 5 == 0 ? UINT64_MAX : state;
+        dlcs[i] = (uint8_t) (i % 11);
+    }
+
+    for (size_t p = 0; p < sizeof(pgns) / sizeof(pgns[0]); p++)
+    {
+        size_t num_columns = j1939decode_to_columns(pgns[p], dlcs, batch_data, COUNT, columns, MAX_COLUMNS);
+        TEST_ASSERT_TRUE(num_columns > 0 && num_columns <= MAX_COLUMNS);
+
+        for (size_t i = 0; i < COUNT; i++)
+        {
+            j1939decode_msg msg;
+            uint8_t msg_dlc = dlcs[i] < 8 ? dlcs[i] : 8;
+            TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgns[p], sa), msg_dlc, &batch_data[i], &msg));
+            TEST_ASSERT_EQUAL_UINT32(num_columns, msg.num_spns);
+
+            for (size_t j = 0; j < num_columns; j++)
+            {
+                TEST_ASSERT_TRUE(msg.spns[j].info == columns[j].info);
+                TEST_ASSERT_EQUAL_HEX64(msg.spns[j].value_raw, values_raw[j][i]);
+                /* Bit for bit, not within a tolerance */
+                TEST_ASSERT_TRUE(msg.spns[j].value_decoded == values_decoded[j][i]);
+                TEST_ASSERT_EQUAL(msg.spns[j].valid, valid[j][i]);
+            }
+        }
+    }
+
+    /* Unknown PGN */
+    TEST_ASSERT_EQUAL_size_t(0, j1939decode_to_columns(130000, dlcs, batch_data, COUNT, columns, MAX_COLUMNS));
+}
+
+void test_j1939decode_to_strings(void)
+{
+    /* Component identification (PGN 65259) is make, model, serial number and unit number, each ended by '*' */
+    const char * payload = "ACME*T800*SN 123**";
+    j1939decode_spn_string strings[8];
+
+    TEST_ASSERT_EQUAL_size_t(4, j1939decode_to_strings(65259, (const uint8_t *) payload, strlen(payload), strings, 8));
+    TEST_ASSERT_EQUAL_UINT32(586, strings[0].info->spn);
+    TEST_ASSERT_EQUAL_UINT32(J1939DECODE_NO_START_BIT, strings[0].info->start_bit);
+    TEST_ASSERT_EQUAL_size_t(4, strings[0].length);
+    TEST_ASSERT_EQUAL_MEMORY("ACME", strings[0].text, 4);
+    TEST_ASSERT_EQUAL_UINT32(587, strings[1].info->spn);
+    TEST_ASSERT_EQUAL_MEMORY("T800", strings[1].text, strings[1].length);
+    TEST_ASSERT_EQUAL_UINT32(588, strings[2].info->spn);
+    TEST_ASSERT_EQUAL_MEMORY("SN 123", strings[2].text, strings[2].length);
+    TEST_ASSERT_EQUAL_UINT32(233, strings[3].info->spn);
+    TEST_ASSERT_EQUAL_size_t(0, strings[3].length);
+    for (size_t i = 0; i < 4; i++)
+    {
+        TEST_ASSERT_TRUE(strings[i].complete);
+        /* Strings point into the payload, nothing is copied */
+        TEST_ASSERT_TRUE(strings[i].text >= payload && strings[i].text <= payload + strlen(payload));
+    }
+
+    /* Payload cut short in the middle of the model */
+    TEST_ASSERT_EQUAL_size_t(4, j1939decode_to_strings(65259, (const uint8_t *) payload, 7, strings, 8));
+    TEST_ASSERT_TRUE(strings[0].complete);
+    TEST_ASSERT_FALSE(strings[1].complete);
+    TEST_ASSERT_EQUAL_MEMORY("T8", strings[1].text, strings[1].length);
+    TEST_ASSERT_FALSE(strings[2].complete);
+    TEST_ASSERT_EQUAL_size_t(0, strings[2].length);
+    TEST_ASSERT_FALSE(strings[3].complete);
+
+    /* Only max_strings are filled in, the count is still the total */
+    const char * vin = "1M8GDM9AXKP042788*";
+    strings[1].info = NULL;
+    TEST_ASSERT_EQUAL_size_t(1, j1939decode_to_strings(65260, (const uint8_t *) vin, strlen(vin), strings, 1));
+    TEST_ASSERT_EQUAL_UINT32(237, strings[0].info->spn);
+    TEST_ASSERT_EQUAL_size_t(17, strings[0].length);
+    TEST_ASSERT_EQUAL_MEMORY("1M8GDM9AXKP042788", strings[0].text, 17);
+    TEST_ASSERT_TRUE(strings[0].complete);
+    TEST_ASSERT_EQUAL_size_t(4, j1939decode_to_strings(65259, (const uint8_t *) payload, strlen(payload), strings, 1));
+    TEST_ASSERT_NULL(strings[1].info);
+
+    /* Neither PGN has any fixed position SPN, and PGNs with no ASCII SPN have no strings */
+    TEST_ASSERT_EQUAL_size_t(0, j1939decode_to_strings(61444, (const uint8_t *) payload, strlen(payload), strings, 8));
+    TEST_ASSERT_EQUAL_size_t(0, j1939decode_to_strings(1, (const uint8_t *) payload, strlen(payload), strings, 8));
+}
+
+void test_j1939decode_to_values(void)
+{
+    /* Retarder configuration (PGN 65249) is 19 bytes, with SPNs well past the first 8 */
+    uint8_t payload[19];
+    memset(payload, 0xFF, sizeof(payload));
+    payload[0] = 0xF3;                      /* Retarder type 3 */
+    payload[2] = 0x40, payload[3] = 0x1F;   /* Speed at idle 8000 * 0.125 rpm */
+    payload[8] = 0xE0, payload[9] = 0x2E;   /* Speed at point 3 12000 * 0.125 rpm */
+    payload[10] = 200;                      /* Torque at point 3 200 - 125 % */
+    payload[16] = 0xB8, payload[17] = 0x0B; /* Reference torque 3000 Nm */
+    payload[18] = 150;                      /* Torque at point 5 150 - 125 % */
+
+    j1939decode_spn_value values[8];
+    TEST_ASSERT_EQUAL_size_t(6, j1939decode_to_values(65249, payload, sizeof(payload), values, 8));
+    TEST_ASSERT_EQUAL_UINT32(901, values[0].spn);
+    TEST_ASSERT_EQUAL_UINT64(3, values[0].value_raw);
+    TEST_ASSERT_EQUAL_DOUBLE(1000.0, values[1].value_decoded);
+    TEST_ASSERT_EQUAL_UINT32(549, values[2].spn);
+    TEST_ASSERT_EQUAL_DOUBLE(1500.0, values[2].value_decoded);
+    TEST_ASSERT_EQUAL_DOUBLE(75.0, values[3].value_decoded);
+    TEST_ASSERT_EQUAL_UINT32(556, values[4].spn);
+    TEST_ASSERT_EQUAL_UINT64(3000, values[4].value_raw);
+    TEST_ASSERT_EQUAL_DOUBLE(25.0, values[5].value_decoded);
+    for (size_t i = 0; i < 6; i++)
+    {
+        TEST_ASSERT_TRUE(values[i].valid);
+        TEST_ASSERT_EQUAL_UINT32(values[i].spn, values[i].info->spn);
+    }
+
+    /* Bytes past the end of a short payload read as zero and the SPNs they cut off are not valid */
+    TEST_ASSERT_EQUAL_size_t(6, j1939decode_to_values(65249, payload, 17, values, 8));
+    TEST_ASSERT_TRUE(values[3].valid);
+    TEST_ASSERT_EQUAL_UINT64(0xB8, values[4].value_raw);
+    TEST_ASSERT_FALSE(values[4].valid);
+    TEST_ASSERT_EQUAL_UINT64(0, values[5].value_raw);
+    TEST_ASSERT_FALSE(values[5].valid);
+
+    /* Single frames decode the same as they do one 64-bit word at a time */
+    j1939decode_msg msg;
+    const uint8_t frame[8] = {0xF3, 0x91, 0x7D, 0xE0, 0x2E, 0x00, 0xF2, 0xFF};
+    memcpy(data, frame, sizeof(data));
+    for (dlc = 0; dlc <= 8; dlc++)
+    {
+        TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(3, 61444, 0), dlc, (uint64_t *) data, &msg));
+        TEST_ASSERT_EQUAL_size_t(msg.num_spns, j1939decode_to_values(61444, frame, dlc, values, 8));
+        for (size_t i = 0; i < msg.num_spns; i++)
+        {
+            TEST_ASSERT_EQUAL_UINT64(msg.spns[i].value_raw, values[i].value_raw);
+            TEST_ASSERT_EQUAL_DOUBLE(msg.spns[i].value_decoded, values[i].value_decoded);
+            TEST_ASSERT_EQUAL(msg.spns[i].valid, values[i].valid);
+            TEST_ASSERT_TRUE(msg.spns[i].state == values[i].state);
+        }
+    }
+
+    /* Only max_values are filled in, the count is still the total, and unknown PGNs have none */
+    values[1].spn = 0;
+    TEST_ASSERT_EQUAL_size_t(6, j1939decode_to_values(65249, payload, sizeof(payload), values, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, values[1].spn);
+    TEST_ASSERT_EQUAL_size_t(0, j1939decode_to_values(130000, payload, sizeof(payload), values, 8));
+}
+
+void test_j1939decode_ctx_matches_default(void)
+{
+    pgn = 65215;
+    data[0] = 0xAA;
+    data[1] = 0x0F;
+
+    j1939decode_db * db = j1939decode_db_load(NULL, NULL);
+    TEST_ASSERT_NOT_NULL(db);
+
+    /* Several contexts may share the same database */
+    j1939decode_ctx * ctx1 = j1939decode_ctx_create(db);
+    j1939decode_ctx * ctx2 = j1939decode_ctx_create(db);
+    TEST_ASSERT_NOT_NULL(ctx1);
+    TEST_ASSERT_NOT_NULL(ctx2);
+
+    char * expected = j1939decode_to_json(get_id(pri, pgn, sa), dlc, (uint64_t *) data, false);
+    char * json1 = j1939decode_ctx_to_json(ctx1, get_id(pri, pgn, sa), dlc, (uint64_t *) data, false);
+    char * json2 = j1939decode_ctx_to_json(ctx2, get_id(pri, pgn, sa), dlc, (uint64_t *) data, false);
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_EQUAL_STRING(expected, json1);
+    TEST_ASSERT_EQUAL_STRING(expected, json2);
+
+    static j1939decode_msg msg;
+    TEST_ASSERT_TRUE(j1939decode_ctx_to_struct(ctx2, get_id(pri, pgn, sa), dlc, (uint64_t *) data, &msg));
+    TEST_ASSERT_TRUE(msg.decoded);
+    TEST_ASSERT_EQUAL_UINT32(65215, msg.pgn);
+
+    free(expected);
+    free(json1);
+    free(json2);
+    j1939decode_ctx_destroy(ctx1);
+    j1939decode_ctx_destroy(ctx2);
+    j1939decode_db_free(db);
+}
+
+void test_j1939decode_ctx_log_fn(void)
+{
+    j1939decode_db * db = j1939decode_db_load(NULL, NULL);
+    TEST_ASSERT_NOT_NULL(db);
+
+    j1939decode_ctx * ctx1 = j1939decode_ctx_create(db);
+    j1939decode_ctx * ctx2 = j1939decode_ctx_create(db);
+    TEST_ASSERT_NOT_NULL(ctx1);
+    TEST_ASSERT_NOT_NULL(ctx2);
+
+    /* Log handlers are per context */
+    j1939decode_ctx_set_log_fn(ctx1, ctx_log_counter);
+    j1939decode_ctx_set_log_fn(ctx2, NULL);
+    ctx_log_count = 0;
+
+    TEST_ASSERT_NULL(j1939decode_ctx_to_json(ctx1, get_id(pri, pgn, sa), 9, (uint64_t *) data, false));
+    TEST_ASSERT_EQUAL_size_t(1, ctx_log_count);
+
+    TEST_ASSERT_NULL(j1939decode_ctx_to_json(ctx2, get_id(pri, pgn, sa), 9, (uint64_t *) data, false));
+    TEST_ASSERT_EQUAL_size_t(1, ctx_log_count);
+
+    j1939decode_ctx_destroy(ctx1);
+    j1939decode_ctx_destroy(ctx2);
+    j1939decode_db_free(db);
+}
+
+void test_j1939decode_ctx_create_without_db(void)
+{
+    TEST_ASSERT_NULL(j1939decode_db_load("does_not_exist.json", ctx_log_counter));
+    TEST_ASSERT_NULL(j1939decode_ctx_create(NULL));
+}
+
+void test_j1939decode_ctx_arena_matches_default(void)
+{
+    const uint32_t pgns[] = {65215, 61444, 0, 65265, 130000, 65215};
+
+    j1939decode_db * db = j1939decode_db_load(NULL, NULL);
+    j1939decode_ctx * ctx = j1939decode_ctx_create(db);
+    TEST_ASSERT_NOT_NULL(ctx);
+
+    /* Start with a tiny arena so that it has to grow */
+    TEST_ASSERT_TRUE(j1939decode_ctx_set_arena(ctx, 64));
+
+    for (size_t i = 0; i < sizeof(pgns) / sizeof(pgns[0]); i++)
+    {
+        data[0] = (uint8_t) i;
+
+        char * expected = j1939decode_to_json(get_id(pri, pgns[i], sa), dlc, (uint64_t *) data, false);
+        char * json = j1939decode_ctx_to_json(ctx, get_id(pri, pgns[i], sa), dlc, (uint64_t *) data, false);
+
+        /* Arena strings belong to the context and are not freed */
+        TEST_ASSERT_NOT_NULL(expected);
+        TEST_ASSERT_EQUAL_STRING(expected, json);
+        free(expected);
+    }
+
+    /* Leaving the arena mode goes back to heap allocated strings */
+    TEST_ASSERT_TRUE(j1939decode_ctx_set_arena(ctx, 0));
+    free(j1939decode_ctx_to_json(ctx, get_id(pri, pgns[0], sa), dlc, (uint64_t *) data, true));
+
+    j1939decode_ctx_destroy(ctx);
+    j1939decode_db_free(db);
+}
+
+void test_j1939decode_json_buffer_matches_to_json(void)
+{
+    const uint32_t pgns[] = {65215, 61444, 0, 65265, 1};
+    char buffer[4096];
+
+    for (size_t i = 0; i < sizeof(pgns) / sizeof(pgns[0]); i++)
+    {
+        data[i] = 0x12;
+
+        char * expected = j1939decode_to_json(get_id(pri, pgns[i], sa), dlc, (uint64_t *) data, false);
+        TEST_ASSERT_NOT_NULL(expected);
+
+        size_t length = j1939decode_to_json_buffer(get_id(pri, pgns[i], sa), dlc, (uint64_t *) data, buffer, sizeof(buffer));
+        TEST_ASSERT_EQUAL_size_t(strlen(expected), length);
+        TEST_ASSERT_EQUAL_STRING(expected, buffer);
+
+        /* Output must be exactly what cJSON prints for the same values */
+        cJSON * json = cJSON_Parse(buffer);
+        TEST_ASSERT_NOT_NULL(json);
+        char * reprinted = cJSON_PrintUnformatted(json);
+        TEST_ASSERT_EQUAL_STRING(reprinted, buffer);
+
+        free(reprinted);
+        cJSON_Delete(json);
+        free(expected);
+    }
+}
+
+void test_j1939decode_json_buffer_truncated(void)
+{
+    pgn = 65215;
+    char buffer[16];
+
+    /* Length only, nothing written */
+    size_t length = j1939decode_to_json_buffer(get_id(pri, pgn, sa), dlc, (uint64_t *) data, NULL, 0);
+    TEST_ASSERT_GREATER_THAN(sizeof(buffer), length);
+
+    /* Truncated like snprintf(), still returning the full length */
+    TEST_ASSERT_EQUAL_size_t(length, j1939decode_to_json_buffer(get_id(pri, pgn, sa), dlc, (uint64_t *) data,
+                                                                 buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING("{\"ID\":16695040,", buffer);
+
+    /* Invalid messages return zero */
+    TEST_ASSERT_EQUAL_size_t(0, j1939decode_to_json_buffer(get_id(pri, pgn, sa), 9, (uint64_t *) data,
+                                                           buffer, sizeof(buffer)));
+}
+
+void test_j1939decode_values_profile(void)
+{
+    pgn = 65215;
+    data[0] = 0xAA;
+    data[1] = 0x0F;
+
+    j1939decode_set_profile(J1939DECODE_PROFILE_VALUES);
+    j1939decode_set_timestamp(12.5);
+    char * json_string = j1939decode_to_json(get_id(pri, pgn, sa), dlc, (uint64_t *) data, false);
+    j1939decode_set_profile(J1939DECODE_PROFILE_FULL);
+
+    cJSON * json = cJSON_Parse(json_string);
+    TEST_ASSERT_NOT_NULL(json);
+
+    TEST_ASSERT_EQUAL_DOUBLE(pgn, cJSON_GetObjectItemCaseSensitive(json, "PGN")->valuedouble);
+    TEST_ASSERT_EQUAL_DOUBLE(12.5, cJSON_GetObjectItemCaseSensitive(json, "Timestamp")->valuedouble);
+
+    /* Only the decoded values are written, no metadata */
+    TEST_ASSERT_NULL(cJSON_GetObjectItemCaseSensitive(json, "PGNName"));
+    TEST_ASSERT_NULL(cJSON_GetObjectItemCaseSensitive(json, "DataRaw"));
+
+    cJSON * spn = cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(json, "SPNs"), "904");
+    TEST_ASSERT_NOT_NULL(spn);
+    TEST_ASSERT_EQUAL_DOUBLE(15.6640625, cJSON_GetObjectItemCaseSensitive(spn, "ValueDecoded")->valuedouble);
+    TEST_ASSERT_TRUE(cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(spn, "Valid")));
+    TEST_ASSERT_NULL(cJSON_GetObjectItemCaseSensitive(spn, "Name"));
+
+    cJSON_Delete(json);
+    free(json_string);
+}
+
+void test_j1939decode_pgn_metadata_json(void)
+{
+    char buffer[8192];
+
+    size_t length = j1939decode_pgn_metadata_json(65215, buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(0, length);
+    TEST_ASSERT_LESS_THAN(sizeof(buffer), length);
+
+    cJSON * json = cJSON_Parse(buffer);
+    TEST_ASSERT_NOT_NULL(json);
+    TEST_ASSERT_EQUAL_STRING("Wheel Speed Information", cJSON_GetObjectItemCaseSensitive(json, "PGNName")->valuestring);
+
+    cJSON * spn = cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(json, "SPNs"), "904");
+    TEST_ASSERT_NOT_NULL(spn);
+    TEST_ASSERT_EQUAL_STRING("Front Axle Speed", cJSON_GetObjectItemCaseSensitive(spn, "Name")->valuestring);
+    TEST_ASSERT_EQUAL_DOUBLE(0, cJSON_GetObjectItemCaseSensitive(spn, "StartBit")->valuedouble);
+    TEST_ASSERT_NULL(cJSON_GetObjectItemCaseSensitive(spn, "ValueRaw"));
+
+    cJSON_Delete(json);
+
+    /* PGN 130000 does not exist in J1939 database */
+    TEST_ASSERT_EQUAL_size_t(0, j1939decode_pgn_metadata_json(130000, buffer, sizeof(buffer)));
+}
+
+void test_j1939decode_field_mask_json(void)
+{
+    pgn = 65215;
+    data[0] = 0xAA;
+    data[1] = 0x0F;
+
+    /* Non-adjacent SPN fields, both ends of the pre-rendered fragment left out */
+    j1939decode_set_fields(J1939DECODE_FIELD_PGN | J1939DECODE_FIELD_SPNS | J1939DECODE_FIELD_SPN_NAME |
+                           J1939DECODE_FIELD_SPN_UNITS | J1939DECODE_FIELD_SPN_VALUE_RAW |
+                           J1939DECODE_FIELD_SPN_VALID);
+    char * json_string = j1939decode_to_json(get_id(pri, pgn, sa), dlc, (uint64_t *) data, false);
+    char * pretty_string = j1939decode_to_json(get_id(pri, pgn, sa), dlc, (uint64_t *) data, true);
+    j1939decode_set_fields(J1939DECODE_FIELDS_ALL);
+
+    cJSON * json = cJSON_Parse(json_string);
+    cJSON * pretty = cJSON_Parse(pretty_string);
+    TEST_ASSERT_NOT_NULL(json);
+    TEST_ASSERT_TRUE(cJSON_Compare(json, pretty, true));
+
+    TEST_ASSERT_EQUAL_DOUBLE(pgn, cJSON_GetObjectItemCaseSensitive(json, "PGN")->valuedouble);
+    TEST_ASSERT_NULL(cJSON_GetObjectItemCaseSensitive(json, "ID"));
+    TEST_ASSERT_NULL(cJSON_GetObjectItemCaseSensitive(json, "SAName"));
+    TEST_ASSERT_NULL(cJSON_GetObjectItemCaseSensitive(json, "Decoded"));
+
+    cJSON * spn = cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(json, "SPNs"), "904");
+    TEST_ASSERT_NOT_NULL(spn);
+    TEST_ASSERT_EQUAL_INT(4, cJSON_GetArraySize(spn));
+    TEST_ASSERT_EQUAL_STRING("Front Axle Speed", cJSON_GetObjectItemCaseSensitive(spn, "Name")->valuestring);
+    TEST_ASSERT_EQUAL_STRING("km/h", cJSON_GetObjectItemCaseSensitive(spn, "Units")->valuestring);
+    TEST_ASSERT_EQUAL_DOUBLE(4010, cJSON_GetObjectItemCaseSensitive(spn, "ValueRaw")->valuedouble);
+    TEST_ASSERT_TRUE(cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(spn, "Valid")));
+
+    cJSON_Delete(pretty);
+    cJSON_Delete(json);
+    free(pretty_string);
+    free(json_string);
+
+    /* Nothing selected still gives a valid object */
+    j1939decode_set_fields(0);
+    json_string = j1939decode_to_json(get_id(pri, pgn, sa), dlc, (uint64_t *) data, false);
+    j1939decode_set_fields(J1939DECODE_FIELDS_ALL);
+
+    TEST_ASSERT_EQUAL_STRING("{}", json_string);
+    free(json_string);
+}
+
+void test_j1939decode_field_mask_struct(void)
+{
+    /* EEC1 message with engine speed (SPN 190) at start bit 24 */
+    pgn = 61444;
+    sa = 11;
+
+    j1939decode_msg msg;
+    j1939decode_set_fields(J1939DECODE_FIELD_PGN_NAME);
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgn, sa), dlc, (uint64_t *) data, &msg));
+    j1939decode_set_fields(J1939DECODE_FIELDS_ALL);
+
+    TEST_ASSERT_EQUAL_UINT32(61444, msg.pgn);
+    TEST_ASSERT_NULL(msg.sa_name);
+    TEST_ASSERT_EQUAL_STRING("Electronic Engine Controller 1", msg.pgn_name);
+    TEST_ASSERT_EQUAL_UINT32(0, msg.num_spns);
+    TEST_ASSERT_TRUE(msg.decoded);
+
+    /* Batch decode honors the same mask */
+    uint32_t id = get_id(pri, pgn, sa);
+    j1939decode_set_fields(J1939DECODE_FIELD_SPNS);
+    TEST_ASSERT_EQUAL_size_t(1, j1939decode_to_struct_batch(&id, &dlc, (uint64_t *) data, 1, &msg));
+    j1939decode_set_fields(J1939DECODE_FIELDS_ALL);
+
+    TEST_ASSERT_NULL(msg.sa_name);
+    TEST_ASSERT_NULL(msg.pgn_name);
+    TEST_ASSERT_GREATER_THAN(0, msg.num_spns);
+    TEST_ASSERT_TRUE(msg.decoded);
+}
+
+void test_j1939decode_subscribe(void)
+{
+    /* Engine speed (SPN 190, EEC1) and front axle speed (SPN 904) from source address 11 only */
+    const uint32_t spns[] = {904, 190};
+    const uint8_t sas[] = {11};
+    TEST_ASSERT_TRUE(j1939decode_subscribe(spns, 2, sas, 1));
+
+    pgn = 61444;
+    sa = 11;
+    data[3] = 0x83;
+    data[4] = 0x17;
+
+    char * json_string = j1939decode_to_json(get_id(pri, pgn, sa), dlc, (uint64_t *) data, false);
+    cJSON * json = cJSON_Parse(json_string);
+    TEST_ASSERT_NOT_NULL(json);
+
+    const cJSON * spn_object = cJSON_GetObjectItemCaseSensitive(json, "SPNs");
+    TEST_ASSERT_EQUAL_INT(1, cJSON_GetArraySize(spn_object));
+    TEST_ASSERT_EQUAL_DOUBLE(752.375, cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(spn_object, "190"),
+                                                                       "ValueDecoded")->valuedouble);
+    TEST_ASSERT_TRUE(cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(json, "Decoded")));
+
+    cJSON_Delete(json);
+    free(json_string);
+
+    j1939decode_msg msg;
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgn, sa), dlc, (uint64_t *) data, &msg));
+    TEST_ASSERT_EQUAL_UINT32(1, msg.num_spns);
+    TEST_ASSERT_EQUAL_UINT32(190, msg.spns[0].spn);
+
+    /* Other source addresses and unsubscribed PGNs are dropped */
+    TEST_ASSERT_NULL(j1939decode_to_json(get_id(pri, pgn, 0), dlc, (uint64_t *) data, false));
+    TEST_ASSERT_NULL(j1939decode_to_json(get_id(pri, 65262, sa), dlc, (uint64_t *) data, true));
+    TEST_ASSERT_FALSE(j1939decode_to_struct(get_id(pri, 65262, sa), dlc, (uint64_t *) data, &msg));
+
+    uint32_t ids[] = {get_id(pri, 65215, sa), get_id(pri, 65262, sa)};
+    uint8_t dlcs[] = {dlc, dlc};
+    uint64_t batch_data[2];
+    memcpy(&batch_data[0], data, sizeof(data));
+    memcpy(&batch_data[1], data, sizeof(data));
+    j1939decode_msg msgs[2];
+    TEST_ASSERT_EQUAL_size_t(2, j1939decode_to_struct_batch(ids, dlcs, batch_data, 2, msgs));
+    TEST_ASSERT_TRUE(msgs[0].decoded);
+    TEST_ASSERT_EQUAL_UINT32(1, msgs[0].num_spns);
+    TEST_ASSERT_EQUAL_UINT32(904, msgs[0].spns[0].spn);
+    TEST_ASSERT_FALSE(msgs[1].decoded);
+    TEST_ASSERT_EQUAL_UINT32(0, msgs[1].num_spns);
+
+    /* Removing the subscription decodes everything again */
+    TEST_ASSERT_TRUE(j1939decode_subscribe(NULL, 0, NULL, 0));
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, 65262, 0), dlc, (uint64_t *) data, &msg));
+    TEST_ASSERT_TRUE(msg.decoded);
+}
+
+void test_j1939decode_change_detection(void)
+{
+    j1939decode_set_timestamp(0.0);
+    TEST_ASSERT_TRUE(j1939decode_set_change_detection(true, 1.0));
+
+    pgn = 61444;
+    data[3] = 0x83;
+    data[4] = 0x17;
+
+    /* First message of the pair is produced in full */
+    j1939decode_msg msg;
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgn, sa), dlc, (uint64_t *) data, &msg));
+    uint32_t num_spns = msg.num_spns;
+    TEST_ASSERT_TRUE(num_spns > 1);
+
+    /* Same payload again is dropped, whatever the priority */
+    TEST_ASSERT_FALSE(j1939decode_to_struct(get_id(3, pgn, sa), dlc, (uint64_t *) data, &msg));
+    TEST_ASSERT_NULL(j1939decode_to_json(get_id(pri, pgn, sa), dlc, (uint64_t *) data, false));
+    TEST_ASSERT_EQUAL_size_t(0, j1939decode_to_json_buffer(get_id(pri, pgn, sa), dlc, (uint64_t *) data, NULL, 0));
+
+    /* Only engine speed changed */
+    data[4] = 0x18;
+    char buffer[2048];
+    TEST_ASSERT_TRUE(j1939decode_to_json_buffer(get_id(pri, pgn, sa), dlc, (uint64_t *) data, buffer, 1) > 1);
+    size_t length = j1939decode_to_json_buffer(get_id(pri, pgn, sa), dlc, (uint64_t *) data, buffer, sizeof(buffer));
+    TEST_ASSERT_TRUE(length > 0 && length < sizeof(buffer));
+
+    cJSON * json = cJSON_Parse(buffer);
+    TEST_ASSERT_NOT_NULL(json);
+    const cJSON * spn_object = cJSON_GetObjectItemCaseSensitive(json, "SPNs");
+    TEST_ASSERT_EQUAL_INT(1, cJSON_GetArraySize(spn_object));
+    TEST_ASSERT_NOT_NULL(cJSON_GetObjectItemCaseSensitive(spn_object, "190"));
+    cJSON_Delete(json);
+
+    /* Output fitting the buffer was produced, so the change is not produced again */
+    TEST_ASSERT_FALSE(j1939decode_to_struct(get_id(pri, pgn, sa), dlc, (uint64_t *) data, &msg));
+
+    /* Another source address is another pair */
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgn, 11), dlc, (uint64_t *) data, &msg));
+    TEST_ASSERT_EQUAL_UINT32(num_spns, msg.num_spns);
+
+    /* Heartbeat produces everything again */
+    j1939decode_set_timestamp(0.5);
+    TEST_ASSERT_FALSE(j1939decode_to_struct(get_id(pri, pgn, sa), dlc, (uint64_t *) data, &msg));
+    j1939decode_set_timestamp(1.0);
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgn, sa), dlc, (uint64_t *) data, &msg));
+    TEST_ASSERT_EQUAL_UINT32(num_spns, msg.num_spns);
+    TEST_ASSERT_FALSE(j1939decode_to_struct(get_id(pri, pgn, sa), dlc, (uint64_t *) data, &msg));
+
+    /* Batch keeps unchanged messages with the decoded flag cleared */
+    uint32_t ids[] = {get_id(pri, pgn, sa), get_id(pri, pgn, sa)};
+    uint8_t dlcs[] = {dlc, dlc};
+    uint64_t batch_data[2];
+    memcpy(&batch_data[0], data, sizeof(data));
+    memcpy(&batch_data[1], data, sizeof(data));
+    ((uint8_t *) &batch_data[1])[3] = 0x84;
+    j1939decode_msg msgs[2];
+    TEST_ASSERT_EQUAL_size_t(2, j1939decode_to_struct_batch(ids, dlcs, batch_data, 2, msgs));
+    TEST_ASSERT_FALSE(msgs[0].decoded);
+    TEST_ASSERT_EQUAL_UINT32(pgn, msgs[0].pgn);
+    TEST_ASSERT_TRUE(msgs[1].decoded);
+    TEST_ASSERT_EQUAL_UINT32(1, msgs[1].num_spns);
+    TEST_ASSERT_EQUAL_UINT32(190, msgs[1].spns[0].spn);
+
+    /* Many pairs grow the table */
+    for (uint32_t i = 0; i < 1024; i++)
+    {
+        TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, 0xEF00 + (i >> 8U), (uint8_t) i), dlc, (uint64_t *) data, &msg));
+    }
+    for (uint32_t i = 0; i < 1024; i++)
+    {
+        TEST_ASSERT_FALSE(j1939decode_to_struct(get_id(pri, 0xEF00 + (i >> 8U), (uint8_t) i), dlc, (uint64_t *) data, &msg));
+    }
+
+    /* Bytes past the DLC are not compared, with SPNs or without */
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgn, sa), 5, (uint64_t *) data, &msg));
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, 0xEF00, 0), 5, (uint64_t *) data, &msg));
+    data[6] ^= 0xFF;
+    TEST_ASSERT_FALSE(j1939decode_to_struct(get_id(pri, pgn, sa), 5, (uint64_t *) data, &msg));
+    TEST_ASSERT_FALSE(j1939decode_to_struct(get_id(pri, 0xEF00, 0), 5, (uint64_t *) data, &msg));
+    data[6] ^= 0xFF;
+
+    /* Disabled again, every message is produced */
+    TEST_ASSERT_TRUE(j1939decode_set_change_detection(false, 0.0));
+    TEST_ASSERT_TRUE(j1939decode_to_struct(get_id(pri, pgn, sa), dlc, (uint64_t *) data, &msg));
+}
+
+void test_j1939decode_cache(void)
+{
+    TEST_ASSERT_TRUE(j1939decode_set_cache(4));
+
+    pgn = 65215;
+    data[0] = 0xAA;
+
+    char expected[2048];
+    char buffer[2048];
+    j1939decode_cache_stats stats;
+
+    size_t length = j1939decode_to_json_buffer(get_id(pri, pgn, sa), dlc, (uint64_t *) data, expected, sizeof(expected));
+    TEST_ASSERT_EQUAL_size_t(length, j1939decode_to_json_buffer(get_id(pri, pgn, sa), dlc, (uint64_t *) data,
+                                                                buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING(expected, buffer);
+
+    /* Cached output is truncated like written output */
+    TEST_ASSERT_EQUAL_size_t(length, j1939decode_to_json_buffer(get_id(pri, pgn, sa), dlc, (uint64_t *) data, buffer, 8));
+    TEST_ASSERT_EQUAL_STRING_LEN(expected, buffer, 7);
+    TEST_ASSERT_EQUAL_size_t(7, strlen(buffer));
+
+    char * json_string = j1939decode_to_json(get_id(pri, pgn, sa), dlc, (uint64_t *) data, false);
+    TEST_ASSERT_EQUAL_STRING(expected, json_string);
+    free(json_string);
+
+    j1939decode_get_cache_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(3, stats.hits);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.misses);
+    TEST_ASSERT_EQUAL_size_t(1, stats.entries);
+
+    /* The priority is part of the output */
+    j1939decode_to_json_buffer(get_id(3, pgn, sa), dlc, (uint64_t *) data, buffer, sizeof(buffer));
+    j1939decode_get_cache_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(2, stats.misses);
+
+    /* Changing the field mask empties the cache */
+    j1939decode_set_fields(J1939DECODE_FIELD_PGN);
+    TEST_ASSERT_EQUAL_size_t(13, j1939decode_to_json_buffer(get_id(pri, pgn, sa), dlc, (uint64_t *) data,
+                                                            buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING("{\"PGN\":65215}", buffer);
+    j1939decode_set_fields(J1939DECODE_FIELDS_ALL);
+
+    j1939decode_get_cache_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(3, stats.misses);
+    TEST_ASSERT_EQUAL_size_t(0, stats.entries);
+
+    TEST_ASSERT_TRUE(j1939decode_set_cache(0));
+}
+
+void test_j1939decode_cache_replacement(void)
+{
+    j1939decode_db * db = j1939decode_db_load(NULL, NULL);
+    TEST_ASSERT_NOT_NULL(db);
+    j1939decode_ctx * cached = j1939decode_ctx_create(db);
+    j1939decode_ctx * uncached = j1939decode_ctx_create(db);
+    TEST_ASSERT_TRUE(j1939decode_ctx_set_cache(cached, 8));
+
+    const uint32_t pgns[] = {61444, 65215, 65262, 65265, 0xEF00};
+    char expected[2048];
+    char buffer[2048];
+
+    /* Enough distinct messages to replace entries all the time, with some repeating often */
+    uint64_t state = 1;
+    for (size_t i = 0; i < 2000; i++)
+    {
+        state = state * UINT64_C(6364136223846793005) + 1;
+        uint32_t id = get_id(6, pgns[(state >> 33U) % 5U], (uint8_t) ((state >> 40U) % 3U));
+        uint64_t payload = (state >> 50U) % (i % 2 ? 2U : 16U);
+
+        j1939decode_ctx_to_json_buffer(uncached, id, dlc, &payload, expected, sizeof(expected));
+        j1939decode_ctx_to_json_buffer(cached, id, dlc, &payload, buffer, sizeof(buffer));
+        TEST_ASSERT_EQUAL_STRING(expected, buffer);
+    }
+
+    j1939decode_cache_stats stats;
+    j1939decode_ctx_get_cache_stats(cached, &stats);
+    TEST_ASSERT_EQUAL_UINT64(2000, stats.hits + stats.misses);
+    TEST_ASSERT_TRUE(stats.hits > 0);
+    TEST_ASSERT_EQUAL_size_t(8, stats.entries);
+
+    /* Output that first had to grow the scratch buffer of a new context is cached too */
+    j1939decode_ctx * fresh = j1939decode_ctx_create(db);
+    TEST_ASSERT_TRUE(j1939decode_ctx_set_cache(fresh, 8));
+    uint64_t payload = 0;
+    for (size_t i = 0; i < 2; i++)
+    {
+        char * json_string = j1939decode_ctx_to_json(fresh, get_id(6, 61444, 0), dlc, &payload, false);
+        TEST_ASSERT_NOT_NULL(json_string);
+        free(json_string);
+    }
+    j1939decode_ctx_get_cache_stats(fresh, &stats);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.hits);
+    TEST_ASSERT_EQUAL_size_t(1, stats.entries);
+    j1939decode_ctx_destroy(fresh);
+
+    j1939decode_ctx_destroy(cached);
+    j1939decode_ctx_destroy(uncached);
+    j1939decode_db_free(db);
+}
+
+void test_j1939decode_spn_locations(void)
+{
+    /* Engine speed is carried by EEC1 at start bit 24 */
+    j1939decode_spn_location locations[4];
+    TEST_ASSERT_EQUAL_size_t(1, j1939decode_spn_locations(190, locations, 4));
+    TEST_ASSERT_EQUAL_UINT32(61444, locations[0].pgn);
+    TEST_ASSERT_EQUAL_UINT32(24, locations[0].start_bit);
+    TEST_ASSERT_EQUAL_STRING("Engine Speed", locations[0].info->name);
+
+    /* Count only */
+    TEST_ASSERT_EQUAL_size_t(1, j1939decode_spn_locations(190, NULL, 0));
+
+    TEST_ASSERT_EQUAL_size_t(0, j1939decode_spn_locations(1, locations, 4));
+
+    /* Make is a variable-length field of component identification, with no start bit */
+    TEST_ASSERT_EQUAL_size_t(1, j1939decode_spn_locations(586, locations, 4));
+    TEST_ASSERT_EQUAL_UINT32(65259, locations[0].pgn);
+    TEST_ASSERT_EQUAL_UINT32(J1939DECODE_NO_START_BIT, locations[0].start_bit);
+
+    j1939decode_can_filter filter;
+    const uint32_t spn = 586;
+    TEST_ASSERT_EQUAL_size_t(1, j1939decode_can_filters(NULL, 0, &spn, 1, NULL, 0, &filter, 1));
+}
@@ -0,0 +1,160 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "j1939decode.h"
+
+static j1939decode_dm_table * table;
+static j1939decode_dm_msg msg;
+static j1939decode_dm_event events[8];
+
+/* Write a trouble code record into a DM payload */
+static void put_dtc(uint8_t * record, uint32_t spn, uint8_t fmi, uint8_t oc)
+{
+    record[0] = (uint8_t) spn;
+    record[1] = (uint8_t) (spn >> 8U);
+    record[2] = (uint8_t) (((spn >> 11U) & 0xE0U) | fmi);
+    record[3] = oc;
+}
+
+/* Decode a DM1 from sa carrying the given SPN and FMI pairs and update the table with it */
+static size_t update(uint8_t sa, const uint32_t * spns, const uint8_t * fmis, size_t count)
+{
+    uint8_t payload[2 + 4 * 8];
+    size_t length = 2 + 4 * count;
+    payload[0] = 0x04;
+    payload[1] = 0xFF;
+    for (size_t i = 0; i < count; i++)
+    {
+        put_dtc(&payload[2 + 4 * i], spns[i], fmis[i], 1);
+    }
+
+    /* No fault is sent as an all-zero record */
+    if (count == 0)
+    {
+        memset(&payload[2], 0, 4);
+        length = 6;
+    }
+
+    j1939decode_dm_decode(65226, sa, payload, length, &msg);
+    return j1939decode_dm_table_update(table, &msg, events, 8);
+}
+
+void setUp(void)
+{
+    table = j1939decode_dm_table_create(NULL);
+    memset(&msg, 0, sizeof(msg));
+}
+
+void tearDown(void)
+{
+    j1939decode_dm_table_destroy(table);
+}
+
+void test_j1939dm_decode(void)
+{
+    /* Single frame DM1: MIL on, amber warning flashing, SPN 100 (oil pressure) FMI 1, 3 occurrences */
+    uint8_t frame[8] = {0x44, 0xF7, 0, 0, 0, 0, 0xFF, 0xFF};
+    put_dtc(&frame[2], 100, 1, 3);
+
+    TEST_ASSERT_TRUE(j1939decode_dm_decode(65226, 0, frame, sizeof(frame), &msg));
+    TEST_ASSERT_EQUAL_UINT32(65226, msg.pgn);
+    TEST_ASSERT_EQUAL_UINT8(1, msg.lamps[J1939DECODE_LAMP_MIL]);
+    TEST_ASSERT_EQUAL_UINT8(0, msg.lamps[J1939DECODE_LAMP_RED_STOP]);
+    TEST_ASSERT_EQUAL_UINT8(1, msg.lamps[J1939DECODE_LAMP_AMBER_WARNING]);
+    TEST_ASSERT_EQUAL_UINT8(0, msg.lamps[J1939DECODE_LAMP_PROTECT]);
+    TEST_ASSERT_EQUAL_UINT8(3, msg.flash[J1939DECODE_LAMP_MIL]);
+    TEST_ASSERT_EQUAL_UINT8(1, msg.flash[J1939DECODE_LAMP_AMBER_WARNING]);
+    TEST_ASSERT_EQUAL_size_t(1, msg.num_dtcs);
+    TEST_ASSERT_EQUAL_UINT32(100, msg.dtcs[0].spn);
+    TEST_ASSERT_EQUAL_UINT8(1, msg.dtcs[0].fmi);
+    TEST_ASSERT_EQUAL_UINT8(3, msg.dtcs[0].oc);
+
+    /* Multi-packet DM2 with SPNs using all 19 bits */
+    uint8_t payload[14] = {0x00, 0xFF};
+    put_dtc(&payload[2], 524000, 31, 127);
+    put_dtc(&payload[6], 5246, 16, 0x80 | 2);
+    put_dtc(&payload[10], 0x7FFFF, 31, 127);
+    payload[13] = 0xFF;
+    TEST_ASSERT_TRUE(j1939decode_dm_decode(65227, 3, payload, sizeof(payload), &msg));
+    TEST_ASSERT_EQUAL_UINT8(3, msg.sa);
+    TEST_ASSERT_EQUAL_size_t(2, msg.num_dtcs);
+    TEST_ASSERT_EQUAL_UINT32(524000, msg.dtcs[0].spn);
+    TEST_ASSERT_EQUAL_UINT8(31, msg.dtcs[0].fmi);
+    TEST_ASSERT_EQUAL_UINT8(127, msg.dtcs[0].oc);
+    TEST_ASSERT_EQUAL_UINT32(5246, msg.dtcs[1].spn);
+    TEST_ASSERT_EQUAL_UINT8(2, msg.dtcs[1].oc);
+
+    /* Truncated records are left out, other PGNs and payloads without lamp status are not DMs */
+    TEST_ASSERT_TRUE(j1939decode_dm_decode(65227, 3, payload, 9, &msg));
+    TEST_ASSERT_EQUAL_size_t(1, msg.num_dtcs);
+    TEST_ASSERT_FALSE(j1939decode_dm_decode(61444, 0, frame, sizeof(frame), &msg));
+    TEST_ASSERT_FALSE(j1939decode_dm_decode(65226, 0, frame, 1, &msg));
+}
+
+void test_j1939dm_table(void)
+{
+    TEST_ASSERT_NOT_NULL(table);
+
+    /* First faults of an address are all set, in SPN and FMI order */
+    const uint32_t spns[] = {190, 100, 100};
+    const uint8_t fmis[] = {2, 4, 1};
+    TEST_ASSERT_EQUAL_size_t(3, update(0, spns, fmis, 3));
+    TEST_ASSERT_EQUAL_UINT32(100, events[0].dtc.spn);
+    TEST_ASSERT_EQUAL_UINT8(1, events[0].dtc.fmi);
+    TEST_ASSERT_EQUAL_UINT8(4, events[1].dtc.fmi);
+    TEST_ASSERT_EQUAL_UINT32(190, events[2].dtc.spn);
+    for (size_t i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_TRUE(events[i].active);
+        TEST_ASSERT_EQUAL_UINT8(0, events[i].sa);
+    }
+
+    /* The same faults in another order change nothing */
+    const uint32_t same_spns[] = {100, 190, 100};
+    const uint8_t same_fmis[] = {4, 2, 1};
+    TEST_ASSERT_EQUAL_size_t(0, update(0, same_spns, same_fmis, 3));
+
+    /* Other addresses are kept apart */
+    TEST_ASSERT_EQUAL_size_t(1, update(3, spns, fmis, 1));
+
+    /* One fault cleared and one set */
+    const uint32_t next_spns[] = {100, 110, 190};
+    const uint8_t next_fmis[] = {1, 0, 2};
+    memset(events, 0, sizeof(events));
+    TEST_ASSERT_EQUAL_size_t(2, update(0, next_spns, next_fmis, 3));
+    TEST_ASSERT_FALSE(events[0].active);
+    TEST_ASSERT_EQUAL_UINT32(100, events[0].dtc.spn);
+    TEST_ASSERT_EQUAL_UINT8(4, events[0].dtc.fmi);
+    TEST_ASSERT_TRUE(events[1].active);
+    TEST_ASSERT_EQUAL_UINT32(110, events[1].dtc.spn);
+
+    j1939decode_dtc dtcs[4];
+    TEST_ASSERT_EQUAL_size_t(3, j1939decode_dm_table_get(table, 0, dtcs, 4));
+    TEST_ASSERT_EQUAL_UINT32(100, dtcs[0].spn);
+    TEST_ASSERT_EQUAL_UINT32(110, dtcs[1].spn);
+    TEST_ASSERT_EQUAL_UINT32(190, dtcs[2].spn);
+
+    /* DM2 leaves the active faults alone */
+    uint8_t dm2[6] = {0};
+    TEST_ASSERT_TRUE(j1939decode_dm_decode(65227, 0, dm2, sizeof(dm2), &msg));
+    TEST_ASSERT_EQUAL_size_t(0, j1939decode_dm_table_update(table, &msg, events, 8));
+    TEST_ASSERT_EQUAL_size_t(3, j1939decode_dm_table_get(table, 0, dtcs, 4));
+
+    /* No fault clears them all */
+    TEST_ASSERT_EQUAL_size_t(3, update(0, NULL, NULL, 0));
+    TEST_ASSERT_EQUAL_size_t(0, j1939decode_dm_table_get(table, 0, dtcs, 4));
+    TEST_ASSERT_EQUAL_size_t(1, j1939decode_dm_table_get(table, 3, dtcs, 4));
+
+    /* Events that do not fit are counted, and the table is still updated */
+    uint8_t payload[14] = {0x00, 0xFF};
+    put_dtc(&payload[2], 100, 1, 1);
+    put_dtc(&payload[6], 110, 0, 1);
+    put_dtc(&payload[10], 190, 2, 1);
+    TEST_ASSERT_TRUE(j1939decode_dm_decode(65226, 5, payload, sizeof(payload), &msg));
+    TEST_ASSERT_EQUAL_size_t(3, j1939decode_dm_table_update(table, &msg, events, 1));
+    TEST_ASSERT_EQUAL_size_t(3, j1939decode_dm_table_get(table, 5, dtcs, 4));
+}
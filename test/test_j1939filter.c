@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "unity.h"
+
+#include "j1939decode.h"
+
+#define MAX_FILTERS 64U
+
+static j1939decode_can_filter filters[MAX_FILTERS];
+
+/* Check if a CAN identifier gets through a set of filters the way the kernel does */
+static bool passes(uint32_t id, size_t num_filters)
+{
+    id |= J1939DECODE_CAN_EFF_FLAG;
+    for (size_t i = 0; i < num_filters; i++)
+    {
+        if ((id & filters[i].can_mask) == (filters[i].can_id & filters[i].can_mask))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t get_id(uint8_t pri, uint32_t pgn, uint8_t sa)
+{
+    return ((uint32_t) pri << 26U) | (pgn << 8U) | sa;
+}
+
+void setUp(void)
+{
+    j1939decode_init();
+}
+
+void tearDown(void)
+{
+    j1939decode_deinit();
+}
+
+void test_j1939filter_spns_exact(void)
+{
+    /* Engine speed in EEC1 (PGN 61444) and front axle speed in PGN 65215 */
+    const uint32_t spns[] = {190, 904};
+    size_t num_filters = j1939decode_can_filters(NULL, 0, spns, 2, NULL, 0, filters, MAX_FILTERS);
+    TEST_ASSERT_EQUAL_size_t(2, num_filters);
+
+    for (uint32_t pgn = 0; pgn < (1UL << 18U); pgn++)
+    {
+        bool expected = pgn == 61444 || pgn == 65215;
+        TEST_ASSERT_EQUAL(expected, passes(get_id(6, pgn, 0), num_filters));
+        TEST_ASSERT_EQUAL(expected, passes(get_id(3, pgn, 0xFE), num_filters));
+    }
+
+    /* Standard frames never get through */
+    for (size_t i = 0; i < num_filters; i++)
+    {
+        TEST_ASSERT_TRUE(filters[i].can_mask & J1939DECODE_CAN_EFF_FLAG);
+        TEST_ASSERT_TRUE(filters[i].can_id & J1939DECODE_CAN_EFF_FLAG);
+    }
+}
+
+void test_j1939filter_adjacent_pgns_merged(void)
+{
+    /* 65264 and 65265 differ in the lowest bit only */
+    const uint32_t pgns[] = {65265, 65264};
+    TEST_ASSERT_EQUAL_size_t(1, j1939decode_can_filters(pgns, 2, NULL, 0, NULL, 0, filters, MAX_FILTERS));
+    TEST_ASSERT_TRUE(passes(get_id(6, 65264, 0), 1));
+    TEST_ASSERT_TRUE(passes(get_id(6, 65265, 0), 1));
+    TEST_ASSERT_FALSE(passes(get_id(6, 65266, 0), 1));
+    TEST_ASSERT_FALSE(passes(get_id(6, 65267, 0), 1));
+}
+
+void test_j1939filter_pdu1_any_destination(void)
+{
+    /* Request PGN 59904 is PDU1, its PS field is the destination address */
+    const uint32_t pgns[] = {59904};
+    size_t num_filters = j1939decode_can_filters(pgns, 1, NULL, 0, NULL, 0, filters, MAX_FILTERS);
+    TEST_ASSERT_EQUAL_size_t(1, num_filters);
+    TEST_ASSERT_TRUE(passes(get_id(6, 59904 + 0x12, 0), num_filters));
+    TEST_ASSERT_TRUE(passes(get_id(6, 59904 + 0xFF, 0), num_filters));
+    TEST_ASSERT_FALSE(passes(get_id(6, 59904 + 0x100, 0), num_filters));
+}
+
+void test_j1939filter_source_addresses(void)
+{
+    const uint32_t pgns[] = {65215};
+    const uint8_t sas[] = {0, 1, 11};
+    size_t num_filters = j1939decode_can_filters(pgns, 1, NULL, 0, sas, 3, filters, MAX_FILTERS);
+
+    /* Source addresses 0 and 1 merge into one filter */
+    TEST_ASSERT_EQUAL_size_t(2, num_filters);
+    for (uint32_t sa = 0; sa < 256; sa++)
+    {
+        bool expected = sa == 0 || sa == 1 || sa == 11;
+        TEST_ASSERT_EQUAL(expected, passes(get_id(6, 65215, (uint8_t) sa), num_filters));
+        TEST_ASSERT_FALSE(passes(get_id(6, 65214, (uint8_t) sa), num_filters));
+    }
+}
+
+void test_j1939filter_max_filters(void)
+{
+    const uint32_t pgns[] = {61444, 65215, 65262, 65265, 65270, 0xEA00};
+    size_t num_filters = j1939decode_can_filters(pgns, 6, NULL, 0, NULL, 0, filters, 2);
+    TEST_ASSERT_EQUAL_size_t(2, num_filters);
+
+    /* Fewer filters let more through, but never drop a subscribed PGN */
+    for (size_t i = 0; i < 6; i++)
+    {
+        TEST_ASSERT_TRUE(passes(get_id(6, pgns[i], 0x33), num_filters));
+    }
+
+    TEST_ASSERT_EQUAL_size_t(0, j1939decode_can_filters(pgns, 6, NULL, 0, NULL, 0, filters, 0));
+}
+
+void test_j1939filter_nothing_subscribed(void)
+{
+    /* SPN 1 is not in the database */
+    const uint32_t spns[] = {1};
+    TEST_ASSERT_EQUAL_size_t(0, j1939decode_can_filters(NULL, 0, spns, 1, NULL, 0, filters, MAX_FILTERS));
+}
@@ -0,0 +1,100 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "j1939json.h"
+
+static char buffer[64];
+static j1939json_writer writer;
+
+/* Number formatted the way cJSON prints it */
+static void cjson_number(double d, char * out, size_t size)
+{
+    double test;
+
+    if ((d * 0) != 0)
+    {
+        snprintf(out, size, "null");
+        return;
+    }
+
+    snprintf(out, size, "%1.15g", d);
+    if ((sscanf(out, "%lg", &test) != 1) || (test != d))
+    {
+        snprintf(out, size, "%1.17g", d);
+    }
+}
+
+static const char * write_number(double d)
+{
+    j1939json_init(&writer, buffer, sizeof(buffer));
+    j1939json_write_number(&writer, d);
+    j1939json_finish(&writer);
+    return buffer;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_j1939json_numbers_match_cjson(void)
+{
+    const double numbers[] = {0.0, -0.0, 1.0, -1.0, 0.1, 0.3, 0.0001, 0.00001, 15.6640625, -40.0, 250.996,
+                              419348235.0, 1e15, 1e15 - 1, 999999999999999.9, 1700000000.123456,
+                              123456789.123456789, 5e-324, 1e300, 18446744073709551615.0};
+    char expected[64];
+
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++)
+    {
+        cjson_number(numbers[i], expected, sizeof(expected));
+        TEST_ASSERT_EQUAL_STRING(expected, write_number(numbers[i]));
+    }
+
+    /* Scaled values of the kind found in J1939 data */
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < 100000; i++)
+    {
+        state ^= state << 13U;
+        state ^= state >> 7U;
+        state ^= state << 17U;
+
+        double d = (double) (state % 65536U) * 0.03125 - 273.0;
+        if (i % 2 != 0)
+        {
+            memcpy(&d, &state, sizeof(d));
+        }
+
+        cjson_number(d, expected, sizeof(expected));
+        TEST_ASSERT_EQUAL_STRING(expected, write_number(d));
+    }
+}
+
+void test_j1939json_string_escaped(void)
+{
+    j1939json_init(&writer, buffer, sizeof(buffer));
+    j1939json_write_string(&writer, "a\"b\\c\n\x01");
+    j1939json_finish(&writer);
+
+    TEST_ASSERT_EQUAL_STRING("\"a\\\"b\\\\c\\n\\u0001\"", buffer);
+}
+
+void test_j1939json_truncated(void)
+{
+    char small[4];
+
+    j1939json_init(&writer, small, sizeof(small));
+    J1939JSON_WRITE_LITERAL(&writer, "{\"ID\":");
+    j1939json_write_bool(&writer, true);
+
+    /* Full length is returned, output is cut short and terminated */
+    TEST_ASSERT_EQUAL_size_t(10, j1939json_finish(&writer));
+    TEST_ASSERT_EQUAL_STRING("{\"I", small);
+}
@@ -0,0 +1,345 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+
+#include "j1939decode.h"
+
+/* Connection management and data transfer PGNs */
+#define TP_CM 0xEC00U
+#define TP_DT 0xEB00U
+#define ETP_CM 0xC800U
+#define ETP_DT 0xC700U
+
+static j1939decode_tp * tp;
+static j1939decode_tp_msg msg;
+
+static uint32_t get_id(uint8_t pri, uint32_t pgn, uint8_t sa)
+{
+    return ((uint32_t) pri << 26U) | (pgn << 8U) | sa;
+}
+
+/* Feed one frame from sa to da */
+static bool feed(uint32_t pgn, uint8_t sa, uint8_t da, const uint8_t bytes[8], double timestamp)
+{
+    uint64_t data;
+    memcpy(&data, bytes, sizeof(data));
+    return j1939decode_tp_feed(tp, get_id(7, pgn | da, sa), 8, &data, timestamp, &msg);
+}
+
+/* Feed a connection management frame announcing or answering a transfer of pgn */
+static bool feed_cm(uint8_t control, uint8_t sa, uint8_t da, uint16_t size, uint8_t packets, uint8_t extra,
+                    uint32_t pgn, double timestamp)
+{
+    const uint8_t bytes[8] = {control, (uint8_t) size, (uint8_t) (size >> 8U), packets, extra,
+                              (uint8_t) pgn, (uint8_t) (pgn >> 8U), (uint8_t) (pgn >> 16U)};
+    return feed(TP_CM, sa, da, bytes, timestamp);
+}
+
+/* Feed data transfer packet number seq of payload */
+static bool feed_dt(uint8_t sa, uint8_t da, const uint8_t * payload, size_t size, uint8_t seq, double timestamp)
+{
+    uint8_t bytes[8] = {seq, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    size_t offset = (size_t) (seq - 1U) * 7U;
+    memcpy(&bytes[1], &payload[offset], size - offset < 7U ? size - offset : 7U);
+    return feed(TP_DT, sa, da, bytes, timestamp);
+}
+
+/* Feed an extended connection management frame with a 32-bit value in bytes 1 to 4 */
+static bool feed_etp_cm(uint8_t control, uint8_t sa, uint8_t da, uint32_t value, uint32_t pgn, double timestamp)
+{
+    const uint8_t bytes[8] = {control, (uint8_t) value, (uint8_t) (value >> 8U), (uint8_t) (value >> 16U),
+                              (uint8_t) (value >> 24U), (uint8_t) pgn, (uint8_t) (pgn >> 8U), (uint8_t) (pgn >> 16U)};
+    return feed(ETP_CM, sa, da, bytes, timestamp);
+}
+
+/* Feed extended data transfer packet number seq after the data packet offset of payload */
+static bool feed_etp_dt(uint8_t sa, uint8_t da, const uint8_t * payload, size_t size, uint32_t offset, uint8_t seq,
+                        double timestamp)
+{
+    uint8_t bytes[8] = {seq, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    size_t start = (size_t) (offset + seq - 1U) * 7U;
+    memcpy(&bytes[1], &payload[start], size - start < 7U ? size - start : 7U);
+    return feed(ETP_DT, sa, da, bytes, timestamp);
+}
+
+static j1939decode_tp_stats get_stats(void)
+{
+    j1939decode_tp_stats stats;
+    j1939decode_tp_get_stats(tp, &stats);
+    return stats;
+}
+
+void setUp(void)
+{
+    j1939decode_init();
+    tp = j1939decode_tp_create(4, NULL);
+    memset(&msg, 0, sizeof(msg));
+}
+
+void tearDown(void)
+{
+    j1939decode_tp_destroy(tp);
+    j1939decode_deinit();
+}
+
+void test_j1939tp_bam(void)
+{
+    TEST_ASSERT_NOT_NULL(tp);
+
+    /* Vehicle identification (PGN 65260) broadcast by the engine in three packets */
+    const uint8_t * vin = (const uint8_t *) "1M8GDM9AXKP042788*";
+    TEST_ASSERT_FALSE(feed_cm(32, 0, 0xFF, 18, 3, 0xFF, 65260, 0.0));
+    TEST_ASSERT_FALSE(feed_dt(0, 0xFF, vin, 18, 1, 0.05));
+    TEST_ASSERT_FALSE(feed_dt(0, 0xFF, vin, 18, 2, 0.10));
+    TEST_ASSERT_EQUAL_size_t(1, get_stats().open);
+    TEST_ASSERT_TRUE(feed_dt(0, 0xFF, vin, 18, 3, 0.15));
+
+    TEST_ASSERT_EQUAL_UINT32(65260, msg.pgn);
+    TEST_ASSERT_EQUAL_UINT8(0, msg.sa);
+    TEST_ASSERT_EQUAL_UINT8(0xFF, msg.da);
+    TEST_ASSERT_EQUAL_size_t(18, msg.length);
+    TEST_ASSERT_EQUAL_MEMORY(vin, msg.data, 18);
+
+    /* The reassembled payload decodes like any other */
+    j1939decode_spn_string vin_string;
+    TEST_ASSERT_EQUAL_size_t(1, j1939decode_to_strings(msg.pgn, msg.data, msg.length, &vin_string, 1));
+    TEST_ASSERT_EQUAL_size_t(17, vin_string.length);
+    TEST_ASSERT_TRUE(vin_string.complete);
+
+    j1939decode_tp_stats stats = get_stats();
+    TEST_ASSERT_EQUAL_UINT64(1, stats.completed);
+    TEST_ASSERT_EQUAL_size_t(0, stats.open);
+}
+
+void test_j1939tp_rts_cts(void)
+{
+    uint8_t payload[20];
+    for (size_t i = 0; i < sizeof(payload); i++)
+    {
+        payload[i] = (uint8_t) i;
+    }
+
+    /* Engine (0) sends 20 bytes to the body controller (33), two packets per clear to send */
+    feed_cm(16, 0, 33, 20, 3, 2, 65226, 0.0);
+    feed_cm(17, 33, 0, 0, 2, 1, 65226, 0.01);
+    feed_dt(0, 33, payload, 20, 1, 0.02);
+
+    /* Out of sequence packets wait for the receiver to ask for the missing ones again */
+    TEST_ASSERT_FALSE(feed_dt(0, 33, payload, 20, 3, 0.03));
+    feed_cm(17, 33, 0, 0, 2, 2, 65226, 0.04);
+    TEST_ASSERT_FALSE(feed_dt(0, 33, payload, 20, 2, 0.05));
+    TEST_ASSERT_TRUE(feed_dt(0, 33, payload, 20, 3, 0.06));
+
+    TEST_ASSERT_EQUAL_UINT32(65226, msg.pgn);
+    TEST_ASSERT_EQUAL_UINT8(0, msg.sa);
+    TEST_ASSERT_EQUAL_UINT8(33, msg.da);
+    TEST_ASSERT_EQUAL_size_t(20, msg.length);
+    TEST_ASSERT_EQUAL_MEMORY(payload, msg.data, 20);
+
+    /* End of message acknowledgment after completion changes nothing */
+    feed_cm(19, 33, 0, 20, 3, 0xFF, 65226, 0.08);
+    j1939decode_tp_stats stats = get_stats();
+    TEST_ASSERT_EQUAL_UINT64(1, stats.completed);
+    TEST_ASSERT_EQUAL_UINT64(0, stats.aborted);
+    TEST_ASSERT_EQUAL_size_t(0, stats.open);
+
+    /* A clear to send skipping packets not received yet aborts, rather than leave a hole in the message */
+    feed_cm(16, 0, 33, 20, 3, 2, 65226, 1.0);
+    feed_dt(0, 33, payload, 20, 1, 1.01);
+    feed_cm(17, 33, 0, 1U | (2U << 8U), 0xFF, 0xFF, 65226, 1.02);
+    feed_cm(17, 33, 0, 1U | (3U << 8U), 0xFF, 0xFF, 65226, 1.03);
+    TEST_ASSERT_FALSE(feed_dt(0, 33, payload, 20, 3, 1.04));
+    stats = get_stats();
+    TEST_ASSERT_EQUAL_UINT64(1, stats.aborted);
+    TEST_ASSERT_EQUAL_size_t(0, stats.open);
+}
+
+void test_j1939tp_interleaved(void)
+{
+    j1939decode_tp_destroy(tp);
+    tp = j1939decode_tp_create(256, NULL);
+    TEST_ASSERT_NOT_NULL(tp);
+
+    /* Every address broadcasts a full size message at the same time, one packet each in turn */
+    uint8_t payload[J1939DECODE_TP_MAX_SIZE];
+    for (size_t i = 0; i < sizeof(payload); i++)
+    {
+        payload[i] = (uint8_t) (i * 7U);
+    }
+
+    for (uint32_t sa = 0; sa < 256; sa++)
+    {
+        payload[0] = (uint8_t) sa;
+        TEST_ASSERT_FALSE(feed_cm(32, (uint8_t) sa, 0xFF, J1939DECODE_TP_MAX_SIZE, 255, 0xFF, 65260, 0.0));
+    }
+
+    size_t completed = 0;
+    for (uint32_t seq = 1; seq <= 255; seq++)
+    {
+        for (uint32_t sa = 0; sa < 256; sa++)
+        {
+            payload[0] = (uint8_t) sa;
+            if (feed_dt((uint8_t) sa, 0xFF, payload, sizeof(payload), (uint8_t) seq, seq * 0.01))
+            {
+                TEST_ASSERT_EQUAL_UINT8(sa, msg.sa);
+                TEST_ASSERT_EQUAL_size_t(J1939DECODE_TP_MAX_SIZE, msg.length);
+                TEST_ASSERT_EQUAL_UINT8(sa, msg.data[0]);
+                TEST_ASSERT_EQUAL_MEMORY(&payload[1], &msg.data[1], sizeof(payload) - 1U);
+                completed++;
+            }
+        }
+    }
+
+    TEST_ASSERT_EQUAL_size_t(256, completed);
+    TEST_ASSERT_EQUAL_size_t(0, get_stats().open);
+}
+
+void test_j1939tp_abort(void)
+{
+    uint8_t payload[20] = {0};
+
+    /* Connection abort from the receiver */
+    feed_cm(16, 0, 33, 20, 3, 2, 65226, 0.0);
+    feed_cm(255, 33, 0, 0xFFFF, 0xFF, 0xFF, 65226, 0.01);
+    TEST_ASSERT_FALSE(feed_dt(0, 33, payload, 20, 1, 0.02));
+
+    /* Broadcast packet lost */
+    feed_cm(32, 3, 0xFF, 20, 3, 0xFF, 65226, 0.0);
+    feed_dt(3, 0xFF, payload, 20, 1, 0.03);
+    feed_dt(3, 0xFF, payload, 20, 3, 0.04);
+
+    /* Broadcast announced again before the last one completed */
+    feed_cm(32, 1, 0xFF, 20, 3, 0xFF, 65226, 0.05);
+    feed_dt(1, 0xFF, payload, 20, 1, 0.06);
+    feed_cm(32, 1, 0xFF, 20, 3, 0xFF, 65226, 0.07);
+
+    j1939decode_tp_stats stats = get_stats();
+    TEST_ASSERT_EQUAL_UINT64(3, stats.aborted);
+    TEST_ASSERT_EQUAL_UINT64(0, stats.completed);
+    TEST_ASSERT_EQUAL_size_t(1, stats.open);
+}
+
+void test_j1939tp_timeout(void)
+{
+    uint8_t payload[20] = {0};
+
+    feed_cm(32, 0, 0xFF, 20, 3, 0xFF, 65226, 0.0);
+    feed_cm(16, 1, 0, 20, 3, 2, 65226, 0.0);
+    feed_dt(0, 0xFF, payload, 20, 1, 0.5);
+
+    /* Broadcast packets time out after 750 ms, connection mode waits after 1250 ms */
+    TEST_ASSERT_FALSE(feed_dt(0, 0xFF, payload, 20, 2, 1.3));
+    j1939decode_tp_stats stats = get_stats();
+    TEST_ASSERT_EQUAL_UINT64(2, stats.timed_out);
+    TEST_ASSERT_EQUAL_size_t(0, stats.open);
+}
+
+void test_j1939tp_table_full(void)
+{
+    /* Only four sessions fit */
+    for (uint8_t sa = 0; sa < 5; sa++)
+    {
+        feed_cm(32, sa, 0xFF, 20, 3, 0xFF, 65226, 0.0);
+    }
+
+    /* Invalid announcements are ignored without taking a session */
+    feed_cm(32, 9, 0xFF, 20, 4, 0xFF, 65226, 0.0);
+    feed_cm(32, 9, 33, 20, 3, 0xFF, 65226, 0.0);
+    feed_cm(16, 9, 33, J1939DECODE_TP_MAX_SIZE + 1U, 0xFF, 0xFF, 65226, 0.0);
+
+    j1939decode_tp_stats stats = get_stats();
+    TEST_ASSERT_EQUAL_UINT64(1, stats.dropped);
+    TEST_ASSERT_EQUAL_size_t(4, stats.open);
+
+    /* Overdue sessions make room for new ones */
+    feed_cm(32, 5, 0xFF, 20, 3, 0xFF, 65226, 1.0);
+    stats = get_stats();
+    TEST_ASSERT_EQUAL_UINT64(4, stats.timed_out);
+    TEST_ASSERT_EQUAL_size_t(1, stats.open);
+}
+
+void test_j1939tp_etp(void)
+{
+    /* 5000 bytes from the engine (0) to a service tool (249), 255 packets per data packet offset */
+    static uint8_t payload[5000];
+    for (size_t i = 0; i < sizeof(payload); i++)
+    {
+        payload[i] = (uint8_t) (i ^ (i >> 8U));
+    }
+    const uint32_t num_packets = (sizeof(payload) + 6U) / 7U;
+
+    for (int round = 0; round < 2; round++)
+    {
+        double t = round * 10.0;
+        TEST_ASSERT_FALSE(feed_etp_cm(20, 0, 249, sizeof(payload), 0xDA00, t));
+
+        /* A TP session between the same addresses runs alongside */
+        uint8_t small[20] = {0};
+        feed_cm(16, 0, 249, 20, 3, 0xFF, 0xDA00, t);
+
+        size_t completed = 0;
+        for (uint32_t offset = 0; offset < num_packets; offset += 255U)
+        {
+            uint32_t count = num_packets - offset < 255U ? num_packets - offset : 255U;
+            feed_etp_cm(21, 249, 0, count | ((offset + 1U) << 8U), 0xDA00, t += 0.01);
+            feed_etp_cm(22, 0, 249, count | (offset << 8U), 0xDA00, t += 0.01);
+
+            for (uint32_t seq = 1; seq <= count; seq++)
+            {
+                /* Packets out of sequence are ignored */
+                if (seq < count)
+                {
+                    TEST_ASSERT_FALSE(feed_etp_dt(0, 249, payload, sizeof(payload), offset, (uint8_t) (seq + 1U), t));
+                }
+                if (feed_etp_dt(0, 249, payload, sizeof(payload), offset, (uint8_t) seq, t += 0.001))
+                {
+                    completed++;
+                }
+            }
+        }
+
+        TEST_ASSERT_EQUAL_size_t(1, completed);
+        TEST_ASSERT_EQUAL_UINT32(0xDA00, msg.pgn);
+        TEST_ASSERT_EQUAL_UINT8(0, msg.sa);
+        TEST_ASSERT_EQUAL_UINT8(249, msg.da);
+        TEST_ASSERT_EQUAL_size_t(sizeof(payload), msg.length);
+        TEST_ASSERT_EQUAL_MEMORY(payload, msg.data, sizeof(payload));
+
+        TEST_ASSERT_FALSE(feed_dt(0, 249, small, 20, 1, t));
+        TEST_ASSERT_FALSE(feed_dt(0, 249, small, 20, 2, t));
+        TEST_ASSERT_TRUE(feed_dt(0, 249, small, 20, 3, t));
+        TEST_ASSERT_EQUAL_size_t(20, msg.length);
+    }
+
+    /* The second message reused the pooled buffer of the first */
+    j1939decode_tp_stats stats = get_stats();
+    TEST_ASSERT_EQUAL_UINT64(4, stats.completed);
+    TEST_ASSERT_EQUAL_size_t(sizeof(payload), stats.buffer_size);
+
+    /* Messages small enough for TP, and broadcasts, are not ETP sessions */
+    feed_etp_cm(20, 0, 249, J1939DECODE_TP_MAX_SIZE, 0xDA00, 20.0);
+    feed_etp_cm(20, 0, 0xFF, sizeof(payload), 0xDA00, 20.0);
+    TEST_ASSERT_EQUAL_size_t(0, get_stats().open);
+
+    /* Aborted by the receiver halfway through */
+    feed_etp_cm(20, 0, 249, sizeof(payload), 0xDA00, 30.0);
+    feed_etp_cm(22, 0, 249, 255U, 0xDA00, 30.0);
+    feed_etp_dt(0, 249, payload, sizeof(payload), 0, 1, 30.0);
+    feed_etp_cm(255, 249, 0, 0xFFFFFF03U, 0xDA00, 30.0);
+    stats = get_stats();
+    TEST_ASSERT_EQUAL_UINT64(1, stats.aborted);
+    TEST_ASSERT_EQUAL_size_t(0, stats.open);
+
+    /* A data packet offset skipping packets not received yet aborts, rather than leave a hole in the message */
+    feed_etp_cm(20, 0, 249, sizeof(payload), 0xDA00, 40.0);
+    feed_etp_cm(22, 0, 249, 255U, 0xDA00, 40.0);
+    feed_etp_dt(0, 249, payload, sizeof(payload), 0, 1, 40.0);
+    feed_etp_cm(22, 0, 249, 255U | (255U << 8U), 0xDA00, 40.0);
+    TEST_ASSERT_FALSE(feed_etp_dt(0, 249, payload, sizeof(payload), 255, 1, 40.0));
+    stats = get_stats();
+    TEST_ASSERT_EQUAL_UINT64(2, stats.aborted);
+    TEST_ASSERT_EQUAL_size_t(0, stats.open);
+}
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "j1939decode.h"
+
+/* Most filters printed, the kernel accepts up to 512 per socket */
+#define MAX_FILTERS 512U
+
+/* Print SocketCAN filters for a set of SPNs, PGNs and source addresses
+ *
+ * Filters are printed as comma separated can_id:can_mask pairs, which candump
+ * takes as is, e.g. candump vcan0,$(j1939canfilter 190 904) */
+int main(int argc, char ** argv)
+{
+    static uint32_t pgns[MAX_FILTERS];
+    static uint32_t spns[MAX_FILTERS];
+    static uint8_t sas[256];
+    static j1939decode_can_filter filters[MAX_FILTERS];
+    size_t num_pgns = 0;
+    size_t num_spns = 0;
+    size_t num_sas = 0;
+    size_t max_filters = MAX_FILTERS;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "-p") == 0 && has_value && num_pgns < MAX_FILTERS)
+        {
+            pgns[num_pgns++] = (uint32_t) strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-s") == 0 && has_value && num_sas < 256)
+        {
+            sas[num_sas++] = (uint8_t) strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-n") == 0 && has_value)
+        {
+            max_filters = strtoul(argv[++i], NULL, 0);
+            max_filters = max_filters < MAX_FILTERS ? max_filters : MAX_FILTERS;
+        }
+        else if (argv[i][0] != '-' && num_spns < MAX_FILTERS)
+        {
+            spns[num_spns++] = (uint32_t) strtoul(argv[i], NULL, 0);
+        }
+        else
+        {
+            fprintf(stderr, "j1939canfilter %s\n", j1939decode_version());
+            fprintf(stderr, "Usage: %s [-p PGN]... [-s SA]... [-n max filters] [SPN]...\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    j1939decode_init();
+
+    size_t num_filters = j1939decode_can_filters(pgns, num_pgns, spns, num_spns, sas, num_sas, filters, max_filters);
+    for (size_t i = 0; i < num_filters; i++)
+    {
+        /* candump sets the extended frame flag itself for 8 digit identifiers */
+        printf("%s%08X:%08X", i > 0 ? "," : "",
+               (unsigned int) (filters[i].can_id & ~J1939DECODE_CAN_EFF_FLAG), (unsigned int) filters[i].can_mask);
+    }
+    printf("\n");
+
+    j1939decode_deinit();
+
+    return num_filters > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
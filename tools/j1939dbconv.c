@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "j1939decode.h"
+#include "j1939db.h"
+
+/* Convert a J1939 JSON database into a binary database image, or into C source
+ *
+ * The image can be memory-mapped by j1939decode_init() by pointing J1939DECODE_DB at it,
+ * which avoids parsing the JSON database at startup.
+ * The C source is compiled into the library when J1939DECODE_EMBED_DB is set in CMake,
+ * which removes the database file altogether. */
+int main(int argc, char ** argv)
+{
+    bool c_source = argc == 4 && strcmp(argv[1], "--c-source") == 0;
+
+    if (argc != 3 && !c_source)
+    {
+        fprintf(stderr, "j1939dbconv %s\n", j1939decode_version());
+        fprintf(stderr, "Usage: %s [--c-source] <J1939db.json> <output file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char * input = argv[argc - 2];
+    const char * output = argv[argc - 1];
+
+    /* NULL log handler logs to stderr */
+    j1939db * db = j1939db_load(input, NULL);
+    if (db == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    bool ok = c_source ? j1939db_write_c_source(db, output) : j1939db_write_image(db, output);
+    if (ok)
+    {
+        printf("Wrote %zu PGNs and %zu SPNs to %s\n", db->num_pgns, db->num_spns, output);
+    }
+
+    j1939db_free(db);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}